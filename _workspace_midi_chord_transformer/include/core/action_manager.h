@@ -13,11 +13,12 @@ class MidiProcessor;
 
 // For tracking user actions for undo/redo functionality
 struct TransformationAction {
-    enum class ActionType { TRANSFORM, REVERT, BATCH_TRANSFORM };
+    enum class ActionType { TRANSFORM, REVERT, BATCH_TRANSFORM, NOTE_EDIT };
     ActionType type;
     std::vector<int> affectedChordIndices;
     std::vector<Chord> previousState;
     std::vector<Chord> newState;
+    NoteEdit noteEdit;              // For NOTE_EDIT; the chord states above stay empty
     std::string description;        // Human-readable description
     std::chrono::system_clock::time_point timestamp;
 };
@@ -34,6 +35,8 @@ private:
     std::unique_ptr<ActionHistory> history;
     MidiProcessor& processor;
     
+    void pushAction(const TransformationAction& action);
+    
 public:
     ActionManager(MidiProcessor& proc);
     
@@ -43,6 +46,8 @@ public:
         const std::vector<std::shared_ptr<Chord>>& after,
         const std::string& description);
     
+    void recordNoteEdit(const NoteEdit& edit, const std::string& description);
+    
     bool undo();
     bool redo();
     
@@ -52,6 +57,10 @@ public:
     std::string getUndoDescription() const;
     std::string getRedoDescription() const;
     
+    // Chords the next undo or redo would change; empty when there is none
+    std::vector<int> getUndoIndices() const;
+    std::vector<int> getRedoIndices() const;
+    
     void clearHistory();
     size_t getHistorySize() const;
 };
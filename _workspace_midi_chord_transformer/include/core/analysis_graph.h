@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Analysis stages of a loaded file; a stage only reads stages before it
+enum class AnalysisStage : uint8_t {
+    TRACKS,                         // Decode the active tracks
+    NOTES,                          // Extract notes and sustain spans
+    TOLERANCE,                      // Calibrate the time tolerance when automatic
+    CHORDS,                         // Detect chords
+    KEY,                            // Detect the key timeline
+    PROGRESSIONS,                   // Match progression patterns
+    COUNT
+};
+
+const size_t ANALYSIS_STAGE_COUNT = static_cast<size_t>(AnalysisStage::COUNT);
+
+// Memoized stage dependencies. Each stage declares the stages it reads;
+// invalidating a stage marks it and everything downstream dirty, and
+// requiring a stage recomputes only its dirty inputs and then itself.
+// Results live with the owner; the graph only tracks whether they are current.
+class AnalysisGraph {
+private:
+    struct Stage {
+        std::vector<AnalysisStage> inputs;
+        std::vector<AnalysisStage> dependents;
+        std::function<bool()> compute;
+        std::function<bool()> restore;  // Memo lookup tried before computing
+        bool dirty;
+        bool failed;                    // Not retried until invalidated again
+        size_t computeCount;
+        
+        Stage() : dirty(true), failed(false), computeCount(0) {}
+    };
+    
+    Stage stages[ANALYSIS_STAGE_COUNT];
+    
+    Stage& stageAt(AnalysisStage stage);
+    const Stage& stageAt(AnalysisStage stage) const;
+    void markDependentsDirty(AnalysisStage stage);
+    
+public:
+    // Inputs must be earlier stages. restore, when given, may fill in the
+    // result from a memo once the inputs are current; it returns false on a miss.
+    void define(
+        AnalysisStage stage,
+        const std::vector<AnalysisStage>& inputs,
+        std::function<bool()> compute,
+        std::function<bool()> restore = nullptr);
+    
+    // Marks the stage and everything downstream dirty
+    void invalidate(AnalysisStage stage);
+    void invalidateAll();
+    
+    // For results supplied from outside, e.g. a session file
+    void markComputed(AnalysisStage stage);
+    
+    // Brings the stage up to date; false if it or an input failed
+    bool require(AnalysisStage stage);
+    
+    bool isDirty(AnalysisStage stage) const;
+    size_t getComputeCount(AnalysisStage stage) const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "midi_structures.h"
+#include "input_deduplicator.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+class MidiProcessor;
+struct BatchQueue;
+
+enum class BatchJobStatus {
+    PENDING,
+    DONE,                           // Output written
+    FAILED,                         // The file could not be loaded or written
+    QUARANTINED                     // Crashed or hung its worker too often and was given up
+};
+
+struct BatchJob {
+    std::string inputPath;
+    std::string outputPath;
+    BatchJobStatus status;
+    uint32_t crashCount;            // Workers that died or were killed while on this file
+    bool fromCache;                 // Analysis was restored from the session cache
+    
+    // Filled in by run: the content of the input, and the earlier job with
+    // the same content, whose output a byte-identical input copies
+    InputFingerprint fingerprint;
+    DuplicateKind duplicateKind;
+    size_t duplicateOf;
+    
+    BatchJob() 
+        : status(BatchJobStatus::PENDING), crashCount(0), fromCache(false),
+          duplicateKind(DuplicateKind::UNIQUE), duplicateOf(0) {}
+    BatchJob(const std::string& inputPath, const std::string& outputPath)
+        : inputPath(inputPath), outputPath(outputPath),
+          status(BatchJobStatus::PENDING), crashCount(0), fromCache(false),
+          duplicateKind(DuplicateKind::UNIQUE), duplicateOf(0) {}
+};
+
+struct BatchSupervisorOptions {
+    unsigned workerCount;           // Worker processes; hardware concurrency when 0
+    size_t shardSize;               // Files a worker claims from the queue at a time
+    uint32_t fileTimeoutSeconds;    // A worker longer on one file is killed as hung; 0 never
+    uint32_t maxCrashes;            // Worker deaths on a file before it is quarantined
+    std::string cacheDirectory;     // Session files of analyzed inputs; no cache when empty
+    
+    // Processor settings every worker analyzes with
+    ParseOptions parseOptions;
+    ChordDetectionMode detectionMode;
+    uint32_t timeTolerance;
+    bool autoTimeTolerance;
+    
+    BatchSupervisorOptions()
+        : workerCount(0),
+          shardSize(4),
+          fileTimeoutSeconds(60),
+          maxCrashes(2),
+          detectionMode(ChordDetectionMode::ONSET_GROUPING),
+          timeTolerance(120),
+          autoTimeTolerance(true) {}
+};
+
+// Runs a batch in forked worker processes, so a file that crashes or hangs
+// the parser takes down only its worker. Inputs are fingerprinted first:
+// byte-identical inputs copy the output of the first one, and inputs with
+// the same tracks share one cached session. Workers claim shards of the
+// remaining jobs from a queue in shared memory and write each file's output,
+// and its session to the on-disk cache. The supervisor restarts dead
+// workers, puts the file a worker died on back in the queue and quarantines
+// it after maxCrashes deaths. Without fork the jobs run in this process.
+class BatchSupervisor {
+private:
+    BatchSupervisorOptions options;
+    size_t workerRestarts;
+    
+    void configure(MidiProcessor& processor) const;
+    std::string cachePath(uint64_t musicHash) const;
+    
+    // Analyzes one file, or restores it from the cache, and writes its output
+    bool processJob(MidiProcessor& processor, const BatchJob& job, bool& fromCache) const;
+    void runWorker(BatchQueue& queue, const std::vector<BatchJob>& jobs, size_t slot) const;
+    bool runInWorkers(std::vector<BatchJob>& jobs);
+    bool runInProcess(std::vector<BatchJob>& jobs);
+    void copyDuplicateOutputs(std::vector<BatchJob>& jobs) const;
+    
+public:
+    explicit BatchSupervisor(const BatchSupervisorOptions& options = BatchSupervisorOptions());
+    
+    // One job per input, writing <stem><suffix>.mid into outputDirectory.
+    // Stems shared by several inputs also get a hash of the input path, so
+    // files from different folders never write the same output.
+    static std::vector<BatchJob> makeJobs(
+        const std::vector<std::string>& inputPaths,
+        const std::string& outputDirectory,
+        const std::string& suffix);
+    
+    // Fills in the status of every job; false when the workers could not be
+    // started and some jobs were left unprocessed
+    bool run(std::vector<BatchJob>& jobs);
+    
+    size_t getWorkerRestartCount() const;
+    static size_t countStatus(const std::vector<BatchJob>& jobs, BatchJobStatus status);
+};
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "midi_structures.h"
+#include "chord_quality.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Inverted index from chord n-grams to the files and chord positions they
+// occur at, for searching a whole corpus for a progression in any key.
+//
+// A gram is gramLength consecutive chords reduced to their qualities and the
+// roots' distances above the first root, so "Dm7 G7 Cmaj7" and "Em7 A7 Dmaj7"
+// are the same gram. Chords that are not plain chord symbols break the grams
+// spanning them. The file uses the same conventions as session files and
+// compiled rule images (fixed-size, 8-byte aligned records in host byte
+// order) and is mapped read-only for queries.
+//
+//   ChordIndexHeader | ChordIndexTerm[termCount] | ChordIndexFile[fileCount] | path pool | postings
+//
+// Terms are sorted by gram. The postings of a term are (file id, chord
+// offset) pairs sorted by file then offset, each stored as two LEB128
+// varints: the file id delta, then the offset delta from the previous
+// posting in the same file (from 0 in a new file).
+
+const uint32_t CHORD_INDEX_VERSION = 1;
+const uint32_t CHORD_INDEX_DEFAULT_GRAM_LENGTH = 3;
+const uint32_t CHORD_INDEX_MAX_GRAM_LENGTH = 7;    // 9 bits per chord in a 64-bit gram
+
+struct ChordIndexHeader {
+    char magic[8];                  // "MCTGRAM" plus a terminating zero
+    uint32_t version;               // CHORD_INDEX_VERSION
+    uint32_t gramLength;
+    uint64_t fileSize;
+    uint64_t termCount;
+    uint64_t fileCount;
+    uint64_t pathPoolOffset;        // From the start of the file
+    uint64_t pathPoolSize;
+    uint64_t postingsOffset;        // From the start of the file
+    uint64_t postingsSize;
+};
+
+struct ChordIndexTerm {
+    uint64_t gram;
+    uint64_t postingsOffset;        // Into the postings
+    uint32_t postingCount;
+    uint32_t postingsSize;          // Bytes
+};
+
+struct ChordIndexFile {
+    uint64_t pathOffset;            // Into the path pool
+    uint32_t pathLength;
+    uint32_t chordCount;
+};
+
+// A chord as grams see it: root pitch class and quality of a plain chord symbol
+struct GramChord {
+    int root;
+    ChordQuality quality;
+    bool parsed;
+    
+    GramChord() : root(0), quality(ChordQuality::MAJOR), parsed(false) {}
+};
+
+GramChord gramChord(const std::string& chordName);
+
+// Gram of the chords [first, first + length): per chord, the quality id in
+// the low 5 bits and the root's distance above the first root in the next
+// 4, the first chord in the top bits. False if one of them is not parsed.
+bool packGram(const std::vector<GramChord>& chords, size_t first, size_t length, uint64_t& gram);
+
+// Where a chord sequence starts: the index of its first chord in the file's chord list
+struct ChordIndexHit {
+    uint32_t fileId;
+    uint32_t offset;
+    
+    ChordIndexHit() : fileId(0), offset(0) {}
+    ChordIndexHit(uint32_t file, uint32_t chordOffset) : fileId(file), offset(chordOffset) {}
+    
+    bool operator==(const ChordIndexHit& other) const {
+        return fileId == other.fileId && offset == other.offset;
+    }
+    bool operator<(const ChordIndexHit& other) const {
+        return fileId != other.fileId ? fileId < other.fileId : offset < other.offset;
+    }
+};
+
+// Collects the grams of a corpus and writes the index file. Files may be
+// added from several threads at once.
+class ChordIndexBuilder {
+private:
+    uint32_t gramLength;
+    std::vector<std::string> paths;
+    std::vector<uint32_t> chordCounts;
+    std::unordered_map<uint64_t, std::vector<ChordIndexHit>> postings;
+    mutable std::mutex mutex;
+    
+    uint32_t reserveFiles(const std::vector<std::string>& filePaths);
+    void fillFile(uint32_t fileId, const std::vector<std::shared_ptr<Chord>>& chords);
+    
+public:
+    explicit ChordIndexBuilder(uint32_t gramLength = CHORD_INDEX_DEFAULT_GRAM_LENGTH);
+    
+    // Adds the chords of one file and returns its file id
+    uint32_t addFile(const std::string& path, const std::vector<std::shared_ptr<Chord>>& chords);
+    
+    // Detects the chords of MIDI files on a pool of threads (hardware
+    // concurrency when 0). File ids follow the list order; files that fail
+    // to load are kept, without chords. Returns false if none loaded.
+    bool ingest(const std::vector<std::string>& midiFiles, unsigned threadCount = 0);
+    
+    bool write(const std::string& indexFilename);
+    
+    uint32_t getGramLength() const;
+    size_t getFileCount() const;
+};
+
+// Read-only view of an index file, mapped where the platform allows it
+class ChordIndex {
+private:
+    const uint8_t* data;
+    size_t size;
+    void* mapping;                  // Platform mapping, if mapped
+    std::vector<uint8_t> buffer;    // File contents when not mapped
+    const ChordIndexHeader* header;
+    const ChordIndexTerm* terms;
+    const ChordIndexFile* files;
+    const char* pathPool;
+    const uint8_t* postings;
+    
+    bool validate(const std::string& name);
+    const ChordIndexTerm* findTerm(uint64_t gram) const;
+    
+    // Postings of a term with every offset moved back by shift; postings
+    // before the shift are dropped
+    void decodePostings(const ChordIndexTerm& term, uint32_t shift, std::vector<ChordIndexHit>& hits) const;
+    
+public:
+    ChordIndex();
+    ~ChordIndex();
+    
+    ChordIndex(const ChordIndex&) = delete;
+    ChordIndex& operator=(const ChordIndex&) = delete;
+    
+    bool open(const std::string& indexFilename);
+    
+    bool isOpen() const;
+    bool isMapped() const;
+    uint32_t getGramLength() const;
+    size_t getFileCount() const;
+    size_t getTermCount() const;
+    std::string getFilePath(uint32_t fileId) const;
+    uint32_t getChordCount(uint32_t fileId) const;
+    
+    // Every position where the chord symbols occur in order, in any key,
+    // sorted by file and offset. Needs at least gramLength plain chord
+    // symbols, e.g. {"Dm7", "G7", "Cmaj7", "A7"}.
+    bool search(const std::vector<std::string>& chordNames, std::vector<ChordIndexHit>& hits) const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
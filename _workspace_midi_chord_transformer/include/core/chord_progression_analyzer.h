@@ -1,12 +1,15 @@
 #pragma once
 
 #include "midi_structures.h"
+#include "rcu_snapshot.h"
 #include <vector>
 #include <string>
 #include <memory>
 
 namespace midi_transformer {
 
+class RuleDatabase;
+
 // For storing common progression patterns
 struct ProgressionPattern {
     std::vector<std::string> chordQualities;  // e.g., ["m7", "7", "maj7"] for ii-V-I
@@ -21,20 +24,104 @@ struct ChordProgression {
     double confidence;              // Confidence level of the detection
 };
 
+// One immutable generation of progression patterns
+struct PatternSet {
+    std::vector<std::shared_ptr<const ProgressionPattern>> patterns;
+    size_t customBegin;             // Patterns from here on were added at run time
+    
+    PatternSet() : customBegin(0) {}
+};
+
+// Where a detected progression came from; kept beside each result so edits
+// can find the matches they invalidate
+struct ProgressionMatch {
+    size_t patternIndex;            // Index in the pattern set
+    size_t startIndex;              // First chord of the window
+    size_t length;                  // Chords in the window
+    double confidence;
+    
+    ProgressionMatch() : patternIndex(0), startIndex(0), length(0), confidence(0.0) {}
+    
+    ProgressionMatch(size_t pattern, size_t start, size_t count, double conf)
+        : patternIndex(pattern), startIndex(start), length(count), confidence(conf) {}
+};
+
+// Match state of one detection, so edits re-scan only the windows that
+// overlap changed chords. Owned by the caller: the analyzer keeps no state
+// between calls and can be shared by threads detecting at the same time.
+struct ProgressionMatchState {
+    typedef std::pair<std::string, std::string> ChordParts;
+    std::vector<ChordParts> chordParts;     // Root and quality of every chord
+    std::vector<ProgressionMatch> matches;  // Parallel to the results
+    std::vector<std::shared_ptr<const ProgressionPattern>> matchedPatterns;
+    bool valid;
+    
+    ProgressionMatchState() : valid(false) {}
+};
+
 class ChordProgressionAnalyzer {
 private:
-    std::vector<std::shared_ptr<ProgressionPattern>> knownPatterns;
+    std::shared_ptr<const RuleDatabase> database; // Source of the first pattern set
     
-    void loadPatterns();
+    // Built on first use; readers use the current set without locking and
+    // changes publish a new one
+    mutable RcuSnapshot<PatternSet> patternSet;
+    
+    static void loadPatterns(PatternSet& set);
+    static std::unique_ptr<PatternSet> buildPatternSet(const std::shared_ptr<const RuleDatabase>& database);
+    
+    // Current set; only valid under an RcuReadGuard
+    const PatternSet& currentPatterns() const;
+    
+    typedef ProgressionMatchState::ChordParts ChordParts;
+    
+    // Confidence of the pattern over the window; false below the threshold
+    static bool matchWindow(
+        const ProgressionPattern& pattern,
+        const std::vector<ChordParts>& parts,
+        size_t startIndex,
+        double& confidence);
+    
+    static std::shared_ptr<ChordProgression> makeProgression(
+        const ProgressionPattern& pattern,
+        const std::vector<ChordParts>& parts,
+        const ProgressionMatch& match);
+    
+    // Result order: highest confidence first, then by window and pattern
+    static bool resultBefore(const ProgressionMatch& a, const ProgressionMatch& b);
     
 public:
+    // Uses RuleDatabase::shared() when one is set
     ChordProgressionAnalyzer();
+    explicit ChordProgressionAnalyzer(std::shared_ptr<const RuleDatabase> database);
     
     std::vector<std::shared_ptr<ChordProgression>> detectProgressions(
-        const std::vector<std::shared_ptr<Chord>>& chords);
+        const std::vector<std::shared_ptr<Chord>>& chords) const;
     
+    // Also records the match state for later updates
+    std::vector<std::shared_ptr<ChordProgression>> detectProgressions(
+        const std::vector<std::shared_ptr<Chord>>& chords,
+        ProgressionMatchState& state) const;
+    
+    // Patches the results of the detection that filled the state after the
+    // chords at changedIndices were edited, re-scanning only the windows that
+    // overlap them. Falls back to a full detection when the chord count or
+    // the pattern set changed, or the state holds no detection.
+    void updateProgressions(
+        const std::vector<std::shared_ptr<Chord>>& chords,
+        const std::vector<int>& changedIndices,
+        ProgressionMatchState& state,
+        std::vector<std::shared_ptr<ChordProgression>>& results) const;
+    
+    // Publishes a new pattern set; detections in progress keep the old one
     void addPattern(const ProgressionPattern& pattern);
-    std::vector<std::shared_ptr<ProgressionPattern>> getKnownPatterns() const;
+    
+    // Swaps in the database's patterns (the built-in ones when null) plus
+    // every added pattern, without pausing detection
+    void reloadPatterns(std::shared_ptr<const RuleDatabase> database);
+    
+    // Patterns of the current set; they stay valid after later changes
+    std::vector<std::shared_ptr<const ProgressionPattern>> getKnownPatterns() const;
 };
 
 } // namespace midi_transformer
\ No newline at end of file
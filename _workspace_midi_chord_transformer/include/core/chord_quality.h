@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace midi_transformer {
+
+// Chord qualities known to the chord-name utilities, as compact ids
+enum class ChordQuality : uint8_t {
+    MAJOR,
+    MINOR,
+    DOMINANT_7,
+    MAJOR_7,
+    MINOR_7,
+    DIMINISHED_7,
+    HALF_DIMINISHED_7,
+    DOMINANT_9,
+    MAJOR_9,
+    MINOR_9,
+    DOMINANT_13,
+    SIXTH,
+    MINOR_6,
+    SUS4,
+    SUS2,
+    DOMINANT_7_SUS4,
+    AUGMENTED,
+    DIMINISHED,
+    ADD_9,
+    MINOR_ADD_9,
+    COUNT
+};
+
+const size_t CHORD_QUALITY_COUNT = static_cast<size_t>(ChordQuality::COUNT);
+
+// Suffix written after the root, e.g. "m7" for MINOR_7
+const char* chordQualitySuffix(ChordQuality quality);
+
+// Intervals above the root as a 12-bit mask, bit i for i semitones;
+// compound intervals such as the ninth are folded into the octave
+uint16_t chordQualityIntervals(ChordQuality quality);
+
+bool chordQualityFromSuffix(const std::string& suffix, ChordQuality& quality);
+
+// Root pitch class and quality of a plain chord symbol such as "Bbm7".
+// Slash chords and unknown suffixes are rejected.
+bool parseChordSymbol(const std::string& chordName, int& rootPitchClass, ChordQuality& quality);
+
+// Chord symbol with the root spelled with flats, e.g. "Db7"
+std::string chordSymbol(int rootPitchClass, ChordQuality quality);
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -1,11 +1,17 @@
 #pragma once
 
+#include "chord_quality.h"
+#include "rcu_snapshot.h"
 #include <string>
 #include <vector>
 #include <memory>
+#include <utility>
+#include <functional>
 
 namespace midi_transformer {
 
+class RuleDatabase;
+
 // For suggesting chord substitutions
 struct ChordSubstitution {
     std::string originalChord;
@@ -23,14 +29,109 @@ struct SubstitutionOptions {
     std::vector<ChordSubstitution> reharmonizations; // Complete reharmonization options
 };
 
+// A substitution stated relative to the source chord's root, so one rule
+// covers all twelve keys
+struct SubstitutionRule {
+    ChordQuality sourceQuality;
+    ChordQuality targetQuality;
+    uint8_t rootInterval;           // Semitones from the source root up to the target root
+    uint8_t relationshipId;         // Index into the engine's relationship names
+    float tensionChange;
+    int functionalSimilarity;
+    
+    SubstitutionRule()
+        : sourceQuality(ChordQuality::MAJOR), targetQuality(ChordQuality::MAJOR),
+          rootInterval(0), relationshipId(0), tensionChange(0.0f), functionalSimilarity(0) {}
+};
+
+// Scoring and search settings for whole-progression reharmonization. A chord
+// choice earns functionWeight per point of functional similarity, loses
+// tensionWeight per unit its tension change misses targetTension, and loses
+// voiceLeadingWeight per semitone of voice movement from the previous chord.
+struct ReharmonizationOptions {
+    size_t beamWidth;               // Partial reharmonizations kept per chord
+    size_t resultCount;             // Reharmonizations returned, best first
+    float functionWeight;
+    float tensionWeight;
+    float targetTension;            // Preferred tension change per chord
+    float voiceLeadingWeight;
+    unsigned threadCount;           // Scoring threads, 0 for the hardware count
+    
+    ReharmonizationOptions()
+        : beamWidth(32),
+          resultCount(5),
+          functionWeight(1.0f),
+          tensionWeight(4.0f),
+          targetTension(0.0f),
+          voiceLeadingWeight(0.25f),
+          threadCount(0) {}
+};
+
+// One reharmonized progression
+struct Reharmonization {
+    std::vector<std::string> chords;
+    std::vector<std::string> relationships; // "original" where the chord was kept
+    float score;
+    int substitutionCount;
+    
+    Reharmonization() : score(0.0f), substitutionCount(0) {}
+};
+
+// One immutable generation of substitution rules. Rules are grouped by
+// source quality; ruleRanges[q] is the [begin, end) range of rules for
+// quality id q. With a database these hold only the custom rules added on
+// top of it.
+struct SubstitutionRuleSet {
+    std::shared_ptr<const RuleDatabase> database; // Compiled rules read in place; null for the built-in rules
+    std::vector<SubstitutionRule> rules;
+    std::pair<uint32_t, uint32_t> ruleRanges[CHORD_QUALITY_COUNT];
+    std::vector<std::string> relationshipNames; // Starts with the database's names
+    
+    // Records whose chords are not plain chord symbols, matched by name
+    std::vector<ChordSubstitution> literalSubstitutions;
+    
+    // Added at run time; applied again when the rules are reloaded
+    std::vector<ChordSubstitution> customSubstitutions;
+    
+    SubstitutionRuleSet() {
+        for (auto& range : ruleRanges) {
+            range = {0, 0};
+        }
+    }
+    
+    // Stores a rule, or a literal record when either chord is not a plain
+    // symbol; duplicates of an existing rule are ignored
+    void add(const ChordSubstitution& substitution);
+    
+    uint8_t getRelationshipId(const std::string& relationship);
+};
+
 class ChordSubstitutionEngine {
 private:
-    std::vector<ChordSubstitution> substitutionDatabase;
+    // Readers use the current set without locking; changes publish a new one
+    RcuSnapshot<SubstitutionRuleSet> ruleSet;
+    
+    static void initializeSubstitutionDatabase(SubstitutionRuleSet& set);
     
-    void initializeSubstitutionDatabase();
+    static std::unique_ptr<SubstitutionRuleSet> buildRuleSet(
+        std::shared_ptr<const RuleDatabase> database,
+        const std::vector<ChordSubstitution>& customSubstitutions);
+    
+    // Substitutions for the chord that pass the filter: its quality's rules
+    // applied to its root, then any literal records for the exact name.
+    // Database entries come before custom ones. Rules are filtered before
+    // their records are built.
+    std::vector<ChordSubstitution> lookupSubstitutions(
+        const std::string& chordName,
+        const std::function<bool(const std::string&, float, int)>& accept = nullptr) const;
+    
+    // Keeping the chord plus every database substitution for it
+    std::vector<ChordSubstitution> getChoices(const std::string& chordName) const;
     
 public:
+    // Uses RuleDatabase::shared() when one is set
     ChordSubstitutionEngine();
+    explicit ChordSubstitutionEngine(std::shared_ptr<const RuleDatabase> database);
     
     SubstitutionOptions getSubstitutionOptions(const std::string& chordName);
     
@@ -47,7 +148,27 @@ public:
         float minTension = -0.5f, 
         float maxTension = 0.5f);
     
+    // Stored as a rule when both chords are plain chord symbols, so it then
+    // applies in every key; duplicates of an existing rule are ignored.
+    // Publishes a new rule set; lookups in progress keep the old one.
     void addCustomSubstitution(const ChordSubstitution& substitution);
+    
+    // Swaps in rules from the database (the built-in rules when null) plus
+    // every custom substitution, without pausing lookups
+    void reloadRules(std::shared_ptr<const RuleDatabase> database);
+    
+    size_t getRuleCount() const;
+    
+    // Rule for a substitution between two plain chord symbols, without its
+    // relationship id; false when either chord is not a plain symbol
+    static bool makeRule(const ChordSubstitution& substitution, SubstitutionRule& rule);
+    
+    // Beam search over a whole chord sequence for the top-scoring
+    // reharmonizations. Choice and transition scores are computed in
+    // parallel before the search.
+    std::vector<Reharmonization> reharmonize(
+        const std::vector<std::string>& progression,
+        const ReharmonizationOptions& options = ReharmonizationOptions()) const;
 };
 
 } // namespace midi_transformer
\ No newline at end of file
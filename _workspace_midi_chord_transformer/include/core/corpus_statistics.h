@@ -0,0 +1,114 @@
+#pragma once
+
+#include "midi_structures.h"
+#include "chord_quality.h"
+#include "key_detector.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Count-min sketch: approximate counts for a key space too large to count
+// exactly. Estimates never undercount; sketches of equal size merge by
+// adding their counters.
+class CountMinSketch {
+private:
+    size_t width;                   // Counters per row, a power of two
+    size_t depth;
+    std::vector<uint32_t> counters; // depth rows of width counters
+    
+public:
+    CountMinSketch(size_t width = 1 << 16, size_t depth = 4);
+    
+    void add(uint64_t key, uint32_t count = 1);
+    uint32_t estimate(uint64_t key) const;
+    bool merge(const CountMinSketch& other);
+    
+    size_t getWidth() const;
+    size_t getDepth() const;
+};
+
+// HyperLogLog: approximate number of distinct keys in 2^precision
+// registers; sketches of equal precision merge by taking register maxima
+class HyperLogLog {
+private:
+    uint32_t precision;
+    std::vector<uint8_t> registers;
+    
+public:
+    explicit HyperLogLog(uint32_t precision = 14);
+    
+    void add(uint64_t key);
+    double estimate() const;
+    bool merge(const HyperLogLog& other);
+};
+
+struct CorpusStatisticsOptions {
+    unsigned threadCount;           // Hardware concurrency when 0
+    uint32_t gramLength;            // Chords per sketched n-gram
+    size_t topGramCount;            // Most frequent n-grams to report
+    
+    CorpusStatisticsOptions() : threadCount(0), gramLength(4), topGramCount(50) {}
+};
+
+// Chord statistics of a corpus. Chord quality frequencies, quality
+// transitions, root motion and key distribution are counted exactly;
+// transposition-normalized chord n-grams go into a count-min sketch and a
+// HyperLogLog, with a bounded set of heavy-hitter candidates. Accumulators
+// filled on different threads merge into one.
+class CorpusStatistics {
+private:
+    uint32_t gramLength;
+    size_t topGramCount;
+    
+    uint64_t fileCount;
+    uint64_t failedFileCount;
+    uint64_t noteCount;
+    uint64_t chordCount;
+    std::vector<uint64_t> qualityCounts;    // Per quality id, other chords last
+    std::vector<uint64_t> transitions;      // From quality row to quality column, same ids
+    uint64_t rootMotion[12];                // Root steps up between consecutive chords
+    std::map<std::string, uint64_t> keyChordCounts;  // Chords per detected key
+    
+    uint64_t gramCount;
+    CountMinSketch gramSketch;
+    HyperLogLog distinctGrams;
+    std::unordered_map<uint64_t, uint32_t> gramCandidates;  // Gram to estimate when last seen
+    uint32_t candidateFloor;                // Smallest estimate among full candidates
+    
+    void offerCandidate(uint64_t gram, uint32_t estimate);
+    std::vector<std::pair<uint64_t, uint32_t>> topGrams() const;
+    std::string gramName(uint64_t gram) const;
+    
+public:
+    explicit CorpusStatistics(uint32_t gramLength = 4, size_t topGramCount = 50);
+    
+    // Adds one file's chords, with the key timeline they were detected in
+    void addFile(const std::vector<std::shared_ptr<Chord>>& chords,
+                 const std::vector<KeyRegion>& keyTimeline, size_t fileNoteCount);
+    void addFailedFile();
+    bool merge(const CorpusStatistics& other);
+    
+    // Loads and analyzes the MIDI files on a pool of threads, each filling
+    // its own accumulator, and merges them
+    static bool collect(const std::vector<std::string>& midiFiles,
+                        const CorpusStatisticsOptions& options, CorpusStatistics& statistics);
+    
+    // Machine-readable report
+    std::string toJson() const;
+    bool writeJson(const std::string& filename) const;
+    
+    uint64_t getFileCount() const;
+    uint64_t getChordCount() const;
+    uint64_t getQualityCount(ChordQuality quality) const;
+    uint64_t getTransitionCount(ChordQuality from, ChordQuality to) const;
+    uint64_t getGramEstimate(const std::vector<std::string>& chordNames) const;
+    double getDistinctGramEstimate() const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
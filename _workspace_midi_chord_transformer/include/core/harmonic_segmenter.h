@@ -0,0 +1,50 @@
+#pragma once
+
+#include "midi_structures.h"
+#include <vector>
+#include <cstdint>
+
+namespace midi_transformer {
+
+// Options for overlap-aware harmonic segmentation
+struct SegmentationOptions {
+    bool useSustainPedal;           // Extend released notes while CC64 is held
+    uint32_t minSegmentDuration;    // Segments shorter than this are dropped
+    size_t minSegmentNotes;         // Minimum distinct pitches for a segment
+    bool mergeEqualHarmony;         // Merge adjacent segments with the same bass and pitch classes
+    
+    SegmentationOptions()
+        : useSustainPedal(true),
+          minSegmentDuration(120),
+          minSegmentNotes(3),
+          mergeEqualHarmony(true) {}
+};
+
+// Splits a note list into segments with a constant set of sounding pitches.
+// Note-on and note-off boundaries are swept once in time order, so held notes,
+// arpeggios and pedalled passages all contribute to later segments.
+class HarmonicSegmenter {
+private:
+    SegmentationOptions options;
+    
+    // Sounding end of a note once the sustain pedal on its channel is considered
+    uint32_t effectiveEndTime(
+        const Note& note,
+        const std::vector<std::vector<SustainSpan>>& spansByChannel) const;
+    
+public:
+    HarmonicSegmenter(const SegmentationOptions& opts = SegmentationOptions());
+    
+    void setOptions(const SegmentationOptions& opts);
+    SegmentationOptions getOptions() const;
+    
+    std::vector<HarmonicSegment> segment(
+        const std::vector<Note>& notes,
+        const std::vector<SustainSpan>& sustainSpans) const;
+    
+    // Bass note followed by the remaining pitch classes in close position,
+    // suitable for chord naming of widely spread or doubled segments
+    static std::vector<uint8_t> reduceToClosePosition(const std::vector<uint8_t>& notes);
+};
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Content hashes of one input file. Two files with equal musicHash decode
+// to the same notes and pedal spans, and so analyze identically, even when
+// their bytes differ in track names, text, tempo or other meta events.
+struct InputFingerprint {
+    uint64_t size;                  // File size in bytes
+    uint64_t contentHash;           // utils::hashBytes over the whole file
+    uint64_t musicHash;             // Division plus the track hashes in order
+    std::vector<uint64_t> trackHashes;  // Channel events of each track at their absolute ticks
+    bool valid;                     // Parsed as a standard MIDI file; musicHash is set
+    
+    InputFingerprint() : size(0), contentHash(0), musicHash(0), valid(false) {}
+};
+
+enum class DuplicateKind {
+    UNIQUE,                         // First input with its content
+    IDENTICAL_BYTES,                // Same bytes as its representative
+    IDENTICAL_TRACKS                // Same channel events as its representative, other bytes differ
+};
+
+// One input of a batch, pointing at the first input with the same content
+struct BatchInput {
+    std::string path;
+    InputFingerprint fingerprint;
+    DuplicateKind kind;
+    size_t representative;          // Index of the input whose results it shares; its own when unique
+    bool readable;
+    
+    BatchInput() : kind(DuplicateKind::UNIQUE), representative(0), readable(false) {}
+};
+
+class InputDeduplicator {
+public:
+    static bool fingerprint(const std::string& path, InputFingerprint& fingerprint);
+    static void fingerprintBuffer(const std::vector<uint8_t>& buffer, InputFingerprint& fingerprint);
+    
+    // Fingerprints the inputs on a pool of threads (hardware concurrency
+    // when 0) and groups them: each duplicate points at the first input
+    // with the same bytes, or failing that the same channel events
+    static std::vector<BatchInput> plan(const std::vector<std::string>& paths, unsigned threadCount = 0);
+    
+    static size_t countDuplicates(const std::vector<BatchInput>& inputs);
+};
+
+} // namespace midi_transformer
\ No newline at end of file
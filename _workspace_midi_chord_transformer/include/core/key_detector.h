@@ -1,6 +1,7 @@
 #pragma once
 
 #include "midi_structures.h"
+#include "scale_table.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -9,6 +10,8 @@
 
 namespace midi_transformer {
 
+class RuleDatabase;
+
 // For key detection and scale-aware transformations
 struct KeySignature {
     std::string rootNote;           // Root note of the key
@@ -17,32 +20,83 @@ struct KeySignature {
     std::map<int, std::string> diatonicChords; // Diatonic chords for this key
 };
 
-// For scale-aware chord substitutions
+// One entry of a key timeline: the key in effect from startTime onwards
+struct KeyRegion {
+    uint32_t startTime;             // Tick where the key takes effect
+    std::string rootNote;           // Root note of the key
+    bool isMajor;                   // Major or minor
+    
+    KeyRegion() : startTime(0), isMajor(true) {}
+    
+    KeyRegion(uint32_t start, const std::string& root, bool major)
+        : startTime(start), rootNote(root), isMajor(major) {}
+};
+
+// Best key for one pitch-class histogram, from batch detection
+struct KeyEstimate {
+    uint8_t tonic;                  // Pitch class of the tonic
+    bool isMajor;
+    float confidence;               // Correlation with the key's profile (-1 to 1); 0 for a flat histogram
+    
+    KeyEstimate() : tonic(0), isMajor(true), confidence(0.0f) {}
+};
+
+// A scale a key's chords may be drawn from, backed by the static scale tables
 struct ScaleConstraint {
-    std::string scaleType;          // e.g., "major", "minor", "dorian"
-    uint8_t rootNote;               // Root note of the scale
-    std::vector<uint8_t> allowedNotes; // Notes that are in the scale
-    std::vector<std::string> allowedChords; // Chords that fit the scale
+    ScaleMode mode;
+    uint8_t rootNote;               // Root pitch class of the scale
+    const ScaleEntry* scale;        // Allowed notes and chord qualities
+    
+    ScaleConstraint() : mode(ScaleMode::MAJOR), rootNote(0), scale(nullptr) {}
+    
+    ScaleConstraint(ScaleMode scaleMode, uint8_t root)
+        : mode(scaleMode), rootNote(root), scale(&scaleEntry(root, scaleMode)) {}
 };
 
 class KeyDetector {
 private:
-    std::unordered_map<std::string, std::shared_ptr<KeySignature>> keySignatures;
+    std::shared_ptr<const RuleDatabase> database;
+    
+    // Filled on first use, from the database or the built-in keys
+    mutable std::unordered_map<std::string, std::shared_ptr<KeySignature>> keySignatures;
+    mutable bool keysLoaded;
     
-    void initializeKeySignatures();
+    void initializeKeySignatures() const;
+    void ensureKeySignatures() const;
     int countNotesInKey(const std::vector<uint8_t>& notes, const std::shared_ptr<KeySignature>& key);
     
 public:
+    // Uses RuleDatabase::shared() when one is set
     KeyDetector();
+    explicit KeyDetector(std::shared_ptr<const RuleDatabase> database);
     
     std::shared_ptr<KeySignature> detectKey(const std::vector<std::shared_ptr<Chord>>& chords);
     
-    std::vector<std::shared_ptr<ScaleConstraint>> getScaleConstraints(
+    // The key's own scale first, then the scales it commonly borrows from
+    // (the parallel minor of a major key; harmonic and melodic minor of a
+    // minor key)
+    std::vector<ScaleConstraint> getScaleConstraints(
         const std::shared_ptr<KeySignature>& key);
     
+    // Table entry whose notes match the key's scale degrees, or null
+    static const ScaleEntry* getScaleEntry(const KeySignature& key, ScaleMode* mode = nullptr);
+    
+    // Notes of a key timeline region's scale
+    static PitchClassMask getScaleMask(const KeyRegion& region);
+    
     std::shared_ptr<KeySignature> getKeySignature(const std::string& keyName);
     
     std::vector<std::string> getAllKeyNames() const;
+    
+    // Adds the pitch classes of every chord note to a 12-bin histogram
+    static void addToPitchClassHistogram(const std::vector<std::shared_ptr<Chord>>& chords, float* histogram);
+    
+    // Scores all 24 major and minor keys for each row of a row-major matrix
+    // of 12-bin pitch-class histograms, by correlation with the
+    // Krumhansl-Kessler key profiles. Rows are independent, so callers can
+    // split a corpus across threads.
+    static void detectKeys(const float* histograms, size_t rowCount, KeyEstimate* estimates);
+    static std::vector<KeyEstimate> detectKeys(const std::vector<float>& histograms);
 };
 
 } // namespace midi_transformer
\ No newline at end of file
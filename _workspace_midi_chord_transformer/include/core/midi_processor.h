@@ -1,6 +1,10 @@
 #pragma once
 
 #include "midi_structures.h"
+#include "onset_calibrator.h"
+#include "key_detector.h"
+#include "chord_progression_analyzer.h"
+#include "analysis_graph.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -15,46 +19,113 @@ class VoiceLeadingEngine;
 class KeyDetector;
 class ChordSynthesizer;
 class ActionManager;
+class HarmonicSegmenter;
+class OnsetDendrogram;
+class SessionView;
 
 // Chord Detection Cache for performance optimization
 struct ChordDetectionCache {
     std::string midiFileHash;
     std::vector<std::shared_ptr<Chord>> detectedChords;
+    uint32_t timeTolerance;                     // Tolerance the chords were grouped with
+    ToleranceCalibration toleranceCalibration;  // When the tolerance was calibrated
     std::chrono::system_clock::time_point timestamp;
+    
+    ChordDetectionCache() : timeTolerance(0) {}
 };
 
 class MidiProcessor {
 private:
     // Core MIDI data
     std::unique_ptr<MidiFile> midiFile;
+    std::vector<uint8_t> fileBuffer;            // Bytes of a file opened from disk
+    std::unique_ptr<SessionView> sessionView;   // Mapping of a loaded session
+    const uint8_t* fileData;                    // The original file, in either of the above
+    size_t fileSize;
+    std::vector<TrackChunkInfo> trackDirectory;
+    std::vector<size_t> activeTracks;
+    std::string fileHash;
+    uint64_t musicHash;             // InputFingerprint::musicHash, keys the detection cache
+    bool musicHashValid;            // Computed on first use, as it scans every track
     std::vector<Note> notes;
+    std::vector<SustainSpan> sustainSpans;
     std::vector<std::shared_ptr<Chord>> chords;
+    std::vector<KeyRegion> keyTimeline;
+    std::vector<std::shared_ptr<ChordProgression>> progressions;
     uint32_t timeTolerance;
+    bool autoTimeTolerance;
+    ToleranceCalibration toleranceCalibration;
+    ChordDetectionMode detectionMode;
+    ParseOptions parseOptions;
+    ParseOptions loadedOptions;
+    ParseStatistics parseStatistics;
     std::string currentFilename;
     
     // Enhanced components using smart pointers
     std::unique_ptr<ChordProgressionAnalyzer> progressionAnalyzer;
+    ProgressionMatchState progressionMatchState;  // Lets chord edits patch the progressions
     std::unique_ptr<VoiceLeadingEngine> voiceLeadingEngine;
     std::unique_ptr<KeyDetector> keyDetector;
     std::unique_ptr<ChordSynthesizer> synthesizer;
+    std::unique_ptr<HarmonicSegmenter> harmonicSegmenter;
+    std::unique_ptr<OnsetDendrogram> onsetDendrogram;
     std::shared_ptr<ActionManager> actionManager;
     
+    // Which analysis results are current; stages recompute on demand once
+    // analysis of the file has been requested
+    AnalysisGraph analysisGraph;
+    bool analysisRequested;
+    std::shared_ptr<KeySignature> detectedKey;
+    uint64_t noteEditCount;         // Keeps chords of edited notes out of the detection cache
+    
     // Cache for performance optimization
     std::unordered_map<std::string, std::shared_ptr<ChordDetectionCache>> detectionCache;
+    std::unordered_map<std::string, std::string> chordNameCache;
     
     // Utility functions for MIDI file I/O
-    uint32_t readVariableLength(const std::vector<uint8_t>& data, size_t& position);
+    uint32_t readVariableLength(const uint8_t* data, size_t size, size_t& position);
     void writeVariableLength(std::vector<uint8_t>& data, uint32_t value);
-    uint16_t read16BE(const std::vector<uint8_t>& data, size_t position);
+    uint16_t read16BE(const uint8_t* data, size_t size, size_t position);
     void write16BE(std::vector<uint8_t>& data, uint16_t value);
-    uint32_t read32BE(const std::vector<uint8_t>& data, size_t position);
+    uint32_t read32BE(const uint8_t* data, size_t size, size_t position);
     void write32BE(std::vector<uint8_t>& data, uint32_t value);
+    static bool isAnalysisMetaEvent(uint8_t metaType);
+    
+    // Lazy track decoding
+    bool buildTrackDirectory();
+    std::string peekTrackName(const TrackChunkInfo& chunk);
+    bool decodeTrack(size_t index);
+    
+    // Analysis stages
+    void defineAnalysisStages();
+    bool decodeActiveTracks();
+    uint64_t getMusicHash();
+    std::string detectionCacheKey();
+    bool restoreDetection();
+    void storeDetection(const std::string& cacheKey);
+    void chordsReplaced();
+    void detectKeyTimeline();
+    
+    // Local re-detection after note edits
+    size_t findNote(const Note& note) const;
+    void insertNoteSorted(const Note& note);
+    void replaceNoteSorted(size_t index, const Note& note);
+    std::pair<size_t, size_t> onsetGroupSpan(uint32_t time) const;
+    std::pair<size_t, size_t> chordRange(uint32_t firstTime, uint32_t lastTime) const;
+    void regroupWindow(uint32_t firstTime, uint32_t lastTime, ChordDiff& diff);
+    void replaceChords(size_t firstChord, size_t endChord,
+                       std::vector<std::shared_ptr<Chord>> newChords, ChordDiff& diff);
+    void applyHunk(const ChordHunk& hunk, bool revert);
+    bool editNotes(const Note* removeNote, const Note* addNote, const std::string& description, ChordDiff& diff);
+    void notesEdited(const ChordDiff& diff);
     
     // Chord detection and analysis
     void extractNotes();
     void detectChords();
+    void detectChordsFromSegments();
     std::vector<int> normalizeChord(const std::vector<uint8_t>& notes);
     std::string identifyChord(const std::vector<uint8_t>& notes);
+    std::string chordNameFor(const std::vector<uint8_t>& chordNotes);
     std::string formatNotes(const std::vector<uint8_t>& notes);
     std::pair<std::string, std::string> parseChordName(const std::string& chordName);
     
@@ -64,8 +135,16 @@ private:
         const std::string& targetChordName,
         const TransformationOptions& options);
     
+    // Marks the key stale and patches analyzed progressions after edits to
+    // the chords at the indices
+    void chordsEdited(const std::vector<int>& changedIndices);
+    
+    // Scale of the key timeline region containing the tick, 0 without a key
+    uint16_t keyScaleAt(uint32_t time) const;
+    
     // File hash calculation for caching
-    std::string calculateFileHash(const std::string& filename);
+    std::string calculateFileHash(const std::vector<uint8_t>& data);
+    uint64_t calculateMusicHash(const std::vector<uint8_t>& data);
     
 public:
     MidiProcessor();
@@ -77,14 +156,23 @@ public:
     MidiProcessor& operator=(MidiProcessor&&) = default;
     
     // Destructor
-    ~MidiProcessor() = default;
+    ~MidiProcessor();
     
     // MIDI file operations
     bool loadMidiFile(const std::string& filename);
     bool writeMidiFile(const std::string& filename);
     
-    // Chord operations
-    std::vector<std::shared_ptr<Chord>> getChords() const;
+    // Two-step loading: open reads only the track directory, analysis decodes
+    // the active tracks on first use and keeps them decoded
+    bool openMidiFile(const std::string& filename);
+    bool analyzeActiveTracks();
+    std::vector<TrackChunkInfo> getTrackDirectory() const;
+    void setActiveTracks(const std::vector<size_t>& trackIndices);
+    std::vector<size_t> getActiveTracks() const;
+    const MidiTrack* getTrack(size_t index);
+    
+    // Chord operations; brings the chords up to date first
+    std::vector<std::shared_ptr<Chord>> getChords();
     std::shared_ptr<Chord> getChord(size_t index) const;
     bool updateChord(size_t index, const Chord& newChordData);
     
@@ -96,17 +184,62 @@ public:
     
     void switchTonality(size_t chordIndex);
     
+    // Note edits re-group and re-name only the chords whose tolerance window
+    // overlaps the edit, fill in the chord diff and are recorded for undo.
+    // Notes are matched by pitch, start time and channel.
+    const std::vector<Note>& getNotes() const;
+    bool insertNote(const Note& note, ChordDiff& diff);
+    bool removeNote(const Note& note, ChordDiff& diff);
+    bool moveNote(const Note& note, uint32_t newStartTime, uint8_t newPitch, ChordDiff& diff);
+    
+    // Redoes a recorded note edit, or undoes it when reverting
+    void applyNoteEdit(const NoteEdit& edit, bool revert);
+    
+    // Revoices the chords (all of them when none are given) keeping their
+    // names, with every note in the key detected at the chord
+    void constrainChordsToKey(const std::vector<int>& selectedIndices);
+    
     // Utility functions
     void setTimeTolerance(uint32_t tolerance);
     uint32_t getTimeTolerance() const;
+    void setAutoTimeTolerance(bool enabled);
+    bool isAutoTimeTolerance() const;
+    ToleranceCalibration calibrateTimeTolerance();
+    ToleranceCalibration getToleranceCalibration() const;
+    void setDetectionMode(ChordDetectionMode mode);
+    ChordDetectionMode getDetectionMode() const;
+    void setParseOptions(const ParseOptions& options);
+    ParseOptions getParseOptions() const;
+    ParseStatistics getParseStatistics() const;
+    bool canWriteMidiFile() const;
     std::string getCurrentFilename() const;
+    std::string getFileHash() const;    // Of the loaded file's bytes, as hex
     void displayChords() const;
     void displayTransformedChords() const;
     bool saveChordAnalysis(const std::string& filename) const;
     
-    // Advanced features
+    // Advanced features; these print the results, recomputing only what is stale
     void analyzeProgression();
     void detectKey();
+    
+    // Results of the analysis stages, recomputed first if stale
+    std::vector<KeyRegion> getKeyTimeline();
+    std::vector<std::shared_ptr<ChordProgression>> getProgressions();
+    
+    // Brings a stage and its inputs up to date once a file is being analyzed
+    bool requireAnalysis(AnalysisStage stage);
+    bool isAnalysisCurrent(AnalysisStage stage) const;
+    size_t getAnalysisComputeCount(AnalysisStage stage) const;
+    
+    // Session files hold the parsed file and all analysis results; saving
+    // analyzes the active tracks first when needed, and loading one restores
+    // the processor without parsing or detection
+    bool saveSession(const std::string& filename);
+    bool loadSession(const std::string& filename);
+    
+    // Adds the current chords to the detection cache, so the next file with
+    // the same tracks and settings reuses them, e.g. after loading a session
+    void rememberDetection();
     void previewChord(size_t index);
     bool undo();
     bool redo();
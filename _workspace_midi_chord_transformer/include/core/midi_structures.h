@@ -16,6 +16,8 @@ enum class MidiEventType {
     PROGRAM_CHANGE = 0xC0,
     CHANNEL_AFTERTOUCH = 0xD0,
     PITCH_BEND = 0xE0,
+    SYSTEM_EXCLUSIVE = 0xF0,
+    SYSTEM_EXCLUSIVE_ESCAPE = 0xF7,
     META_EVENT = 0xFF
 };
 
@@ -67,6 +69,16 @@ struct MidiFile {
     MidiFile() : format(1), numTracks(0), division(480) {}
 };
 
+// Location of a track chunk in the loaded file, known before its events are decoded
+struct TrackChunkInfo {
+    size_t offset;                  // First event byte, just after the chunk header
+    uint32_t length;                // Chunk length in bytes
+    std::string name;               // Name from the leading meta events, empty if none
+    bool decoded;                   // Events have been decoded into the MidiFile
+    
+    TrackChunkInfo() : offset(0), length(0), decoded(false) {}
+};
+
 // Musical Note Structure
 struct Note {
     uint8_t pitch;
@@ -81,6 +93,58 @@ struct Note {
         : pitch(p), startTime(st), duration(d), velocity(v), channel(c) {}
 };
 
+// Set of MIDI pitches as a 128-bit mask
+struct PitchSet {
+    uint64_t bits[2];
+    
+    PitchSet() : bits{0, 0} {}
+    
+    bool contains(uint8_t pitch) const { return (bits[(pitch >> 6) & 1] >> (pitch & 63)) & 1; }
+    void add(uint8_t pitch) { bits[(pitch >> 6) & 1] |= uint64_t(1) << (pitch & 63); }
+    void remove(uint8_t pitch) { bits[(pitch >> 6) & 1] &= ~(uint64_t(1) << (pitch & 63)); }
+    
+    PitchSet& operator|=(const PitchSet& other) {
+        bits[0] |= other.bits[0];
+        bits[1] |= other.bits[1];
+        return *this;
+    }
+    bool operator==(const PitchSet& other) const {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1];
+    }
+    bool operator!=(const PitchSet& other) const { return !(*this == other); }
+    
+    std::vector<uint8_t> toNotes() const {
+        std::vector<uint8_t> notes;
+        for (int pitch = 0; pitch < 128; pitch++) {
+            if (contains(static_cast<uint8_t>(pitch))) {
+                notes.push_back(static_cast<uint8_t>(pitch));
+            }
+        }
+        return notes;
+    }
+};
+
+// Sustain pedal (CC64) span on a single channel
+struct SustainSpan {
+    uint8_t channel;
+    uint32_t startTime;
+    uint32_t endTime;
+    
+    SustainSpan() : channel(0), startTime(0), endTime(0) {}
+    
+    SustainSpan(uint8_t c, uint32_t st, uint32_t et)
+        : channel(c), startTime(st), endTime(et) {}
+};
+
+// Time span over which the set of sounding pitches is constant
+struct HarmonicSegment {
+    uint32_t startTime;
+    uint32_t duration;
+    std::vector<uint8_t> notes;     // Sounding pitches, sorted ascending
+    
+    HarmonicSegment() : startTime(0), duration(0) {}
+};
+
 // Musical Chord Structure
 struct Chord {
     std::vector<uint8_t> notes;
@@ -94,12 +158,75 @@ struct Chord {
     Chord() : startTime(0), duration(0), isTransformed(false) {}
 };
 
+// One region of the chord list a note edit replaced
+struct ChordHunk {
+    size_t firstChord;              // Index of the first replaced chord
+    std::vector<Chord> removed;     // Chords before the edit
+    std::vector<Chord> added;       // Chords after the edit
+    
+    ChordHunk() : firstChord(0) {}
+};
+
+// Changes a note edit made to the chord list. Each hunk indexes the list as
+// left by the hunks before it, so hunks apply in order and revert in reverse.
+struct ChordDiff {
+    std::vector<ChordHunk> hunks;
+    
+    bool empty() const { return hunks.empty(); }
+};
+
+// A note edit and the chords it changed, enough to undo or redo it
+struct NoteEdit {
+    std::vector<Note> removedNotes;
+    std::vector<Note> addedNotes;
+    ChordDiff chordDiff;
+};
+
+// Chord Detection Modes
+enum class ChordDetectionMode {
+    ONSET_GROUPING,         // Group notes whose onsets fall within the time tolerance
+    HARMONIC_SEGMENTATION   // Sweep note and pedal boundaries, including held notes
+};
+
+// How much of a MIDI file the parser decodes
+enum class ParseProfile {
+    FULL,                   // Decode every event and analyze chords
+    ROUND_TRIP,             // Decode every event for writing back; skip analysis
+    ANALYSIS_ONLY           // Keep only what chord analysis needs; the file cannot be written back
+};
+
+// GM percussion (channel 10) as an excluded-channel bit
+constexpr uint16_t DRUM_CHANNEL_MASK = 1u << 9;
+
+// Parser configuration
+struct ParseOptions {
+    ParseProfile profile;
+    uint16_t excludedChannels;      // Bit n leaves channel n out of analysis
+    
+    ParseOptions() : profile(ParseProfile::FULL), excludedChannels(0) {}
+};
+
+// Event counts from the most recent parse
+struct ParseStatistics {
+    size_t totalEvents;             // Events found in the track chunks
+    size_t keptEvents;              // Events stored in the MidiFile
+    size_t skippedEvents;           // Dropped because the profile does not need them
+    size_t excludedChannelEvents;   // Dropped because their channel is excluded
+    
+    ParseStatistics()
+        : totalEvents(0),
+          keptEvents(0),
+          skippedEvents(0),
+          excludedChannelEvents(0) {}
+};
+
 // Transformation Types
 enum class TransformationType {
     STANDARD,
     INVERSION,
     PERCENTAGE,
-    SWITCH_TONALITY
+    SWITCH_TONALITY,
+    KEY_CONSTRAINED         // Voice the chord using only notes of the key
 };
 
 // Transformation Options
@@ -110,6 +237,7 @@ struct TransformationOptions {
     bool preserveRoot;
     bool preserveBass;
     bool useVoiceLeading;
+    uint16_t keyScale;      // Pitch classes of the key (bit p = pitch class p), 0 for the detected key
     
     TransformationOptions() 
         : type(TransformationType::STANDARD), 
@@ -117,7 +245,8 @@ struct TransformationOptions {
           percentage(100.0), 
           preserveRoot(true), 
           preserveBass(true), 
-          useVoiceLeading(true) {}
+          useVoiceLeading(true),
+          keyScale(0) {}
 };
 
 } // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "midi_structures.h"
+#include <vector>
+#include <cstdint>
+
+namespace midi_transformer {
+
+// Result of calibrating the chord grouping tolerance for one file
+struct ToleranceCalibration {
+    uint32_t grid;                  // Inferred quantization step in ticks (0 if unquantized)
+    uint32_t humanizationSpread;    // 95th percentile onset deviation, in ticks
+    uint32_t tolerance;             // Recommended chord grouping tolerance, in ticks
+    double gridConfidence;          // Fraction of inter-chord intervals on the grid
+    size_t intervalCount;           // Inter-onset intervals that were examined
+    
+    ToleranceCalibration()
+        : grid(0),
+          humanizationSpread(0),
+          tolerance(120),
+          gridConfidence(0.0),
+          intervalCount(0) {}
+};
+
+// Infers the quantization grid and humanization spread of a performance from
+// its inter-onset-interval histogram and derives a chord grouping tolerance.
+// The notes are scanned once; everything after that works on the histogram,
+// whose size depends only on the file's division.
+class OnsetCalibrator {
+private:
+    double minGridConfidence;       // Required share of intervals explained by a grid
+    
+    // Sum of histogram bins in [first, last], clamped to the histogram
+    static uint64_t rangeSum(const std::vector<uint64_t>& prefix, int64_t first, int64_t last);
+    
+public:
+    OnsetCalibrator(double minConfidence = 0.85);
+    
+    ToleranceCalibration calibrate(const std::vector<Note>& sortedNotes, uint16_t division) const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "midi_structures.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace midi_transformer {
+
+// Contiguous run of distinct onsets that form one chord group
+struct OnsetGroup {
+    uint32_t startTime;             // First onset in the group
+    uint32_t endTime;               // Last onset in the group
+    size_t firstOnset;              // Index of the first distinct onset
+    size_t lastOnset;               // Index of the last distinct onset (inclusive)
+};
+
+// Range queries over per-onset values in O(1): a sparse table over fixed-size
+// blocks plus in-block prefix and suffix combines
+template <typename T, typename Combine>
+class BlockRangeTable {
+private:
+    static constexpr size_t kBlockSize = 16;
+    
+    std::vector<T> values;
+    std::vector<T> blockPrefix;     // Combine from the block start to i
+    std::vector<T> blockSuffix;     // Combine from i to the block end
+    std::vector<std::vector<T>> levels; // levels[k][b] combines blocks b..b+2^k-1
+    Combine combine;
+    
+public:
+    void build(std::vector<T> input) {
+        values = std::move(input);
+        size_t count = values.size();
+        blockPrefix = values;
+        blockSuffix = values;
+        for (size_t i = 1; i < count; i++) {
+            if (i % kBlockSize != 0) {
+                blockPrefix[i] = combine(blockPrefix[i - 1], values[i]);
+            }
+        }
+        for (size_t i = count; i-- > 1;) {
+            if (i % kBlockSize != 0) {
+                blockSuffix[i - 1] = combine(blockSuffix[i - 1], blockSuffix[i]);
+            }
+        }
+        
+        size_t blockCount = (count + kBlockSize - 1) / kBlockSize;
+        levels.clear();
+        if (blockCount == 0) {
+            return;
+        }
+        std::vector<T> base(blockCount);
+        for (size_t b = 0; b < blockCount; b++) {
+            base[b] = blockSuffix[b * kBlockSize];
+        }
+        levels.push_back(std::move(base));
+        for (size_t width = 2; width <= blockCount; width *= 2) {
+            const auto& previous = levels.back();
+            std::vector<T> level(blockCount - width + 1);
+            for (size_t b = 0; b + width <= blockCount; b++) {
+                level[b] = combine(previous[b], previous[b + width / 2]);
+            }
+            levels.push_back(std::move(level));
+        }
+    }
+    
+    // Combined value over [first, last]
+    T query(size_t first, size_t last) const {
+        size_t firstBlock = first / kBlockSize;
+        size_t lastBlock = last / kBlockSize;
+        if (firstBlock == lastBlock) {
+            T result = values[first];
+            for (size_t i = first + 1; i <= last; i++) {
+                result = combine(result, values[i]);
+            }
+            return result;
+        }
+        
+        T result = combine(blockSuffix[first], blockPrefix[last]);
+        if (firstBlock + 1 < lastBlock) {
+            size_t from = firstBlock + 1;
+            size_t span = lastBlock - from;
+            size_t level = 0;
+            while ((size_t(2) << level) <= span) {
+                level++;
+            }
+            result = combine(result, levels[level][from]);
+            result = combine(result, levels[level][lastBlock - (size_t(1) << level)]);
+        }
+        return result;
+    }
+    
+    void clear() {
+        values.clear();
+        blockPrefix.clear();
+        blockSuffix.clear();
+        levels.clear();
+    }
+};
+
+// Single-linkage clustering of note onsets, stored as a dendrogram of gap sizes.
+// Building is O(n log n) for the sort already done by note extraction and O(n)
+// here; the chord grouping for any tolerance is then read off in O(groups)
+// without touching the notes again.
+class OnsetDendrogram {
+private:
+    struct UnionPitches {
+        PitchSet operator()(PitchSet a, const PitchSet& b) const { return a |= b; }
+    };
+    struct MaxDuration {
+        uint32_t operator()(uint32_t a, uint32_t b) const { return std::max(a, b); }
+    };
+    
+    bool built;
+    std::vector<uint32_t> onsetTimes;   // Distinct onsets, ascending
+    std::vector<uint32_t> gaps;         // gaps[i] = onsetTimes[i + 1] - onsetTimes[i]
+    
+    // Cartesian tree over the gaps (largest gap at the root): the merge order
+    // of single-linkage clustering, i.e. the dendrogram
+    std::vector<int32_t> leftChild;
+    std::vector<int32_t> rightChild;
+    int32_t root;
+    
+    BlockRangeTable<PitchSet, UnionPitches> pitchTable;
+    BlockRangeTable<uint32_t, MaxDuration> durationTable;
+    
+public:
+    OnsetDendrogram();
+    
+    // Notes must be sorted by start time
+    void build(const std::vector<Note>& sortedNotes);
+    void clear();
+    bool isBuilt() const;
+    size_t onsetCount() const;
+    
+    // Groups whose internal onset gaps are all within the tolerance
+    std::vector<OnsetGroup> groupsForTolerance(uint32_t tolerance) const;
+    
+    // Distinct pitches sounding at any onset of the group, ascending
+    std::vector<uint8_t> groupPitches(const OnsetGroup& group) const;
+    
+    // Longest note duration starting within the group
+    uint32_t groupMaxDuration(const OnsetGroup& group) const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Read-side critical section for RcuSnapshot. A snapshot read while a guard
+// is alive stays valid until the outermost guard on the thread is destroyed.
+// Entering and leaving are a couple of atomic stores and never block.
+class RcuReadGuard {
+public:
+    RcuReadGuard();
+    ~RcuReadGuard();
+    
+    RcuReadGuard(const RcuReadGuard&) = delete;
+    RcuReadGuard& operator=(const RcuReadGuard&) = delete;
+};
+
+// Process-wide epochs shared by all snapshots. Readers record the epoch they
+// entered at; a snapshot retired at epoch E can be freed once every reader
+// has left or entered after E.
+class RcuDomain {
+public:
+    // Advances the epoch and returns the one it replaced
+    static uint64_t retireEpoch();
+    
+    static bool isQuiescent(uint64_t retiredEpoch);
+};
+
+// Immutable value published behind an atomic pointer. Readers load it
+// without locks inside an RcuReadGuard; writers copy, modify and publish a
+// new snapshot, and the old one is freed once no reader can still see it.
+template <typename T>
+class RcuSnapshot {
+private:
+    struct Retired {
+        const T* snapshot;
+        uint64_t epoch;
+    };
+    
+    std::atomic<const T*> current;
+    std::mutex writerMutex;         // Serializes writers; readers never take it
+    std::vector<Retired> retired;
+    
+    void retire(const T* snapshot) {
+        if (snapshot) {
+            retired.push_back({snapshot, RcuDomain::retireEpoch()});
+        }
+        reclaimRetired();
+    }
+    
+    size_t reclaimRetired() {
+        size_t kept = 0;
+        for (const auto& entry : retired) {
+            if (RcuDomain::isQuiescent(entry.epoch)) {
+                delete entry.snapshot;
+            } else {
+                retired[kept++] = entry;
+            }
+        }
+        size_t reclaimed = retired.size() - kept;
+        retired.resize(kept);
+        return reclaimed;
+    }
+    
+public:
+    RcuSnapshot() : current(nullptr) {}
+    
+    // No reader may still be inside a guard using this snapshot
+    ~RcuSnapshot() {
+        delete current.load();
+        for (const auto& entry : retired) {
+            delete entry.snapshot;
+        }
+    }
+    
+    RcuSnapshot(const RcuSnapshot&) = delete;
+    RcuSnapshot& operator=(const RcuSnapshot&) = delete;
+    
+    // Current snapshot, or null before the first one; only valid while an
+    // RcuReadGuard is held
+    const T* read() const {
+        return current.load();
+    }
+    
+    // Installs the first snapshot unless another thread got there first,
+    // and returns whichever is current
+    const T* initialize(std::unique_ptr<T> snapshot) {
+        const T* expected = nullptr;
+        if (current.compare_exchange_strong(expected, snapshot.get())) {
+            return snapshot.release();
+        }
+        return expected;
+    }
+    
+    // Replaces the snapshot; the old one is reclaimed once readers move on
+    void publish(std::unique_ptr<T> snapshot) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        retire(current.exchange(snapshot.release()));
+    }
+    
+    // Publishes a modified copy of the current snapshot. Updates are
+    // serialized, so concurrent updates are never lost.
+    template <typename Modify>
+    void update(Modify modify) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        const T* old = current.load();
+        std::unique_ptr<T> next;
+        do {
+            next = old ? std::make_unique<T>(*old) : std::make_unique<T>();
+            modify(*next);
+        } while (!current.compare_exchange_weak(old, next.get()));
+        next.release();
+        retire(old);
+    }
+    
+    // Frees retired snapshots no reader can still see
+    size_t reclaim() {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        return reclaimRetired();
+    }
+    
+    size_t getRetiredCount() {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        return retired.size();
+    }
+};
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "chord_substitution.h"
+#include "chord_progression_analyzer.h"
+#include "key_detector.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Compiled rule database: progression patterns, substitution rules and key
+// signatures read from a text rule file and compiled into one binary image.
+// The image uses the same conventions as session files (fixed-size, 8-byte
+// aligned records in host byte order, pools referenced by offset), so any
+// number of processes can map it read-only and share its pages.
+//
+//   RuleHeader | RuleSectionEntry[sectionCount] | sections...
+//
+// Rule file lines, fields separated by '|'; lines starting with '#' are comments:
+//
+//   progression | ii-V-I | m7 7 maj7 | C F Bb Eb G D A
+//   substitution | G7 | Db7 | tritone sub | 0.3 | 8
+//   mode | major | 0 2 4 5 7 9 11 | _ m m _ _ m dim
+//   keys | major | C G D A E B F# C# F Bb Eb Ab Db Gb Cb
+//
+// "_" stands for the empty quality of a major triad. A mode gives the scale
+// intervals and the diatonic chord quality on each degree; keys lists the
+// roots to build in a mode. Minor keys are named with an "m" suffix, other
+// modes with the mode name after a space.
+
+const uint32_t RULE_DATABASE_VERSION = 1;
+
+enum class RuleSection : uint32_t {
+    PROGRESSIONS = 1,               // RuleProgression records
+    SUBSTITUTION_RULES = 2,         // SubstitutionRule records, grouped by source quality
+    QUALITY_RANGES = 3,             // RuleRange per chord quality id
+    RELATIONSHIPS = 4,              // RuleString per relationship id
+    LITERAL_SUBSTITUTIONS = 5,      // RuleLiteralSubstitution records
+    KEYS = 6,                       // RuleKey records
+    STRING_REFS = 7,                // RuleString lists referenced by progressions
+    STRING_POOL = 8                 // Characters referenced by RuleString
+};
+
+struct RuleHeader {
+    char magic[8];                  // "MCTRULE" plus a terminating zero
+    uint32_t version;               // RULE_DATABASE_VERSION
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint64_t checksum;              // utils::hashBytes over the bytes after the header
+    uint64_t sourceHash;            // utils::hashBytes of the rule file it was compiled from
+};
+
+struct RuleSectionEntry {
+    uint32_t type;                  // RuleSection
+    uint32_t recordSize;            // Size of one record, for layout checks
+    uint64_t offset;                // From the start of the image
+    uint64_t count;                 // Number of records
+};
+
+// Range of the string pool
+struct RuleString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct RuleRange {
+    uint32_t begin;
+    uint32_t end;
+};
+
+struct RuleProgression {
+    RuleString name;
+    uint32_t qualitiesOffset;       // Into the string refs
+    uint32_t qualityCount;
+    uint32_t keysOffset;            // Into the string refs
+    uint32_t keyCount;
+};
+
+struct RuleLiteralSubstitution {
+    RuleString originalChord;
+    RuleString substitutionChord;
+    RuleString relationship;
+    float tensionChange;
+    int32_t functionalSimilarity;
+};
+
+struct RuleKey {
+    RuleString name;                // Lookup name, e.g. "Am"
+    RuleString rootNote;
+    uint32_t isMajor;
+    uint8_t scaleDegrees[8];        // Pitch classes of the seven degrees; the last byte is unused
+    RuleString diatonicQualities[7];
+    uint32_t reserved;
+};
+
+// Read-only view of a compiled rule image, mapped from a file where the
+// platform allows it or held in memory otherwise
+class RuleDatabase {
+private:
+    const uint8_t* data;
+    size_t size;
+    void* mapping;                  // Platform mapping, if mapped
+    std::vector<uint8_t> buffer;    // Image when not mapped
+    const RuleSectionEntry* sections;
+    uint32_t sectionCount;
+    const RuleString* stringRefs;
+    const char* stringPool;
+    
+    const RuleSectionEntry* findSection(RuleSection type, size_t recordSize) const;
+    bool validate(const std::string& name);
+    
+    template <typename T>
+    const T* records(RuleSection type, size_t& count) const {
+        const RuleSectionEntry* section = findSection(type, sizeof(T));
+        count = section ? static_cast<size_t>(section->count) : 0;
+        return section ? reinterpret_cast<const T*>(data + section->offset) : nullptr;
+    }
+    
+public:
+    RuleDatabase();
+    ~RuleDatabase();
+    
+    RuleDatabase(const RuleDatabase&) = delete;
+    RuleDatabase& operator=(const RuleDatabase&) = delete;
+    
+    // Parses a rule file into a binary image
+    static bool compile(const std::string& ruleFilename, std::vector<uint8_t>& image);
+    static bool compileFile(const std::string& ruleFilename, const std::string& imageFilename);
+    
+    // Maps a compiled image read-only
+    bool open(const std::string& imageFilename);
+    
+    // Adopts an image compiled in memory
+    bool adopt(std::vector<uint8_t> image);
+    
+    // Maps the compiled image next to the rule file, recompiling it first
+    // when it is missing or was compiled from different rule text. Falls
+    // back to an in-memory image when the compiled file cannot be written.
+    static std::shared_ptr<const RuleDatabase> openOrCompile(
+        const std::string& ruleFilename, const std::string& imageFilename);
+    
+    // Process-wide database that engines pick up at construction; null
+    // means the built-in tables are used
+    static std::shared_ptr<const RuleDatabase> shared();
+    static void setShared(std::shared_ptr<const RuleDatabase> database);
+    
+    bool isOpen() const;
+    bool isMapped() const;
+    uint64_t getSourceHash() const;
+    
+    // Substitution rules, for zero-copy lookups
+    const SubstitutionRule* substitutionRules(size_t& count) const;
+    RuleRange qualityRange(ChordQuality quality) const;
+    size_t relationshipCount() const;
+    std::string relationship(uint8_t relationshipId) const;
+    const RuleLiteralSubstitution* literalSubstitutions(size_t& count) const;
+    
+    // Materialized copies for the smaller tables
+    std::vector<std::shared_ptr<ProgressionPattern>> progressionPatterns() const;
+    std::vector<std::shared_ptr<KeySignature>> keySignatures(std::vector<std::string>& names) const;
+    
+    // References were bounds-checked when the image was opened
+    std::string string(const RuleString& reference) const;
+    bool equals(const RuleString& reference, const std::string& value) const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
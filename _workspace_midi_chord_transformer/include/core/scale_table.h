@@ -0,0 +1,64 @@
+#pragma once
+
+#include "chord_quality.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Set of pitch classes: bit p is set when pitch class p (0 = C) is present
+typedef uint16_t PitchClassMask;
+
+// Set of chord qualities: bit q is set for ChordQuality id q
+typedef uint32_t ChordQualitySet;
+
+enum class ScaleMode : uint8_t {
+    MAJOR,
+    NATURAL_MINOR,
+    HARMONIC_MINOR,
+    MELODIC_MINOR,                  // Ascending form
+    DORIAN,
+    PHRYGIAN,
+    LYDIAN,
+    MIXOLYDIAN,
+    LOCRIAN,
+    COUNT
+};
+
+const size_t SCALE_MODE_COUNT = static_cast<size_t>(ScaleMode::COUNT);
+
+// One key of the scale tables. A chord quality is allowed on a root when
+// every note of the chord lies in the scale, so the diatonic triads,
+// sevenths, suspensions and added tones all follow from the scale itself.
+struct ScaleEntry {
+    PitchClassMask notes;
+    ChordQualitySet chordQualities[12]; // Per chord root pitch class; empty off the scale
+};
+
+// Table entry for the key on root pitch class 0-11; built once, never freed
+const ScaleEntry& scaleEntry(uint8_t root, ScaleMode mode);
+
+// Notes of a chord quality on the root
+PitchClassMask chordMask(int root, ChordQuality quality);
+
+PitchClassMask pitchClassMask(const std::vector<uint8_t>& notes);
+
+inline bool scaleContains(PitchClassMask scale, PitchClassMask notes) {
+    return (notes & ~scale) == 0;
+}
+
+inline bool scaleAllowsChord(const ScaleEntry& scale, int root, ChordQuality quality) {
+    return (scale.chordQualities[((root % 12) + 12) % 12] >> static_cast<size_t>(quality)) & 1;
+}
+
+// Nearest pitch class in the scale, the lower one on ties; pitch classes
+// already in the scale, and any pitch class of an empty scale, are kept
+uint8_t snapToScale(PitchClassMask scale, uint8_t pitchClass);
+
+// Mode names as written in rule files and key names, e.g. "dorian"
+const char* scaleModeName(ScaleMode mode);
+bool scaleModeFromName(const std::string& name, ScaleMode& mode);
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "midi_structures.h"
+#include "key_detector.h"
+#include "chord_progression_analyzer.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Session file layout. Records are fixed-size, 8-byte aligned and stored in
+// host byte order; variable-length data lives in pools and is referenced by
+// offset and count, so a mapped file is used in place without a decoding pass.
+//
+//   SessionHeader | SessionSectionEntry[sectionCount] | sections...
+//
+// The checksum covers everything after the header.
+
+const uint32_t SESSION_FORMAT_VERSION = 3;
+
+enum class SessionSection : uint32_t {
+    INFO = 1,                       // One SessionInfo record
+    SMF_IMAGE = 2,                  // The original MIDI file, bytes
+    NOTES = 3,                      // SessionNote records, sorted by start time
+    SUSTAIN_SPANS = 4,              // SessionSustainSpan records
+    CHORDS = 5,                     // SessionChord records
+    KEY_REGIONS = 6,                // SessionKeyRegion records
+    PROGRESSIONS = 7,               // SessionProgression records
+    PITCH_POOL = 8,                 // uint8_t pitches referenced by chords
+    INDEX_POOL = 9,                 // int32_t indices referenced by progressions and tracks
+    STRING_POOL = 10                // Characters referenced by SessionString
+};
+
+struct SessionHeader {
+    char magic[8];                  // "MCTSESS" plus a terminating zero
+    uint32_t version;               // SESSION_FORMAT_VERSION
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint64_t checksum;              // utils::hashBytes over the bytes after the header
+};
+
+struct SessionSectionEntry {
+    uint32_t type;                  // SessionSection
+    uint32_t recordSize;            // Size of one record, for layout checks
+    uint64_t offset;                // From the start of the file
+    uint64_t count;                 // Number of records
+};
+
+// Range of the string pool
+struct SessionString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SessionInfo {
+    SessionString sourceFilename;
+    SessionString sourceHash;
+    uint32_t timeTolerance;
+    uint32_t autoTimeTolerance;
+    uint32_t detectionMode;         // ChordDetectionMode
+    uint32_t parseProfile;          // ParseProfile the file was loaded with
+    uint32_t excludedChannels;
+    uint32_t activeTracksOffset;    // Into the index pool; no entries means all tracks
+    uint32_t activeTrackCount;
+    uint32_t calibrationGrid;
+    uint32_t calibrationSpread;
+    uint32_t calibrationTolerance;
+    uint64_t calibrationIntervals;
+    double calibrationConfidence;
+    uint64_t musicHash;             // InputFingerprint::musicHash of the SMF image
+    uint64_t noteEditCount;         // Notes edited since loading; their chords are not cached
+};
+
+struct SessionNote {
+    uint32_t startTime;
+    uint32_t duration;
+    uint8_t pitch;
+    uint8_t velocity;
+    uint8_t channel;
+    uint8_t reserved;
+};
+
+struct SessionSustainSpan {
+    uint32_t startTime;
+    uint32_t endTime;
+    uint32_t channel;
+};
+
+struct SessionChord {
+    uint32_t startTime;
+    uint32_t duration;
+    uint32_t notesOffset;           // Into the pitch pool
+    uint32_t originalNotesOffset;   // Into the pitch pool
+    uint16_t noteCount;
+    uint16_t originalNoteCount;
+    uint32_t isTransformed;
+    SessionString name;
+    SessionString originalName;
+};
+
+struct SessionKeyRegion {
+    uint32_t startTime;
+    uint32_t isMajor;
+    SessionString rootNote;
+};
+
+struct SessionProgression {
+    uint32_t indicesOffset;         // Into the index pool
+    uint32_t indexCount;
+    SessionString name;
+    double confidence;
+};
+
+// Everything a session holds, in the processor's own types
+struct SessionContents {
+    std::string sourceFilename;
+    std::string sourceHash;
+    uint32_t timeTolerance;
+    bool autoTimeTolerance;
+    ChordDetectionMode detectionMode;
+    ParseOptions parseOptions;
+    std::vector<size_t> activeTracks;
+    uint32_t calibrationGrid;
+    uint32_t calibrationSpread;
+    uint32_t calibrationTolerance;
+    uint64_t calibrationIntervals;
+    double calibrationConfidence;
+    uint64_t musicHash;
+    uint64_t noteEditCount;
+    
+    const uint8_t* smfImage;
+    size_t smfImageSize;
+    const std::vector<Note>* notes;
+    const std::vector<SustainSpan>* sustainSpans;
+    const std::vector<std::shared_ptr<Chord>>* chords;
+    const std::vector<KeyRegion>* keyTimeline;
+    const std::vector<std::shared_ptr<ChordProgression>>* progressions;
+    
+    SessionContents()
+        : timeTolerance(0),
+          autoTimeTolerance(false),
+          detectionMode(ChordDetectionMode::ONSET_GROUPING),
+          calibrationGrid(0),
+          calibrationSpread(0),
+          calibrationTolerance(0),
+          calibrationIntervals(0),
+          calibrationConfidence(0.0),
+          musicHash(0),
+          noteEditCount(0),
+          smfImage(nullptr),
+          smfImageSize(0),
+          notes(nullptr),
+          sustainSpans(nullptr),
+          chords(nullptr),
+          keyTimeline(nullptr),
+          progressions(nullptr) {}
+};
+
+// Serializes session contents into the layout above
+class SessionWriter {
+public:
+    static bool write(const std::string& filename, const SessionContents& contents);
+};
+
+// Read-only view of a session file. The file is memory-mapped where the
+// platform allows it and read into memory otherwise; record accessors point
+// straight into the file image.
+class SessionView {
+private:
+    const uint8_t* data;
+    size_t size;
+    void* mapping;                  // Platform mapping, if mapped
+    std::vector<uint8_t> fallbackBuffer;
+    const SessionSectionEntry* sections;
+    uint32_t sectionCount;
+    const uint8_t* pitchPool;
+    const int32_t* indexPool;
+    const char* stringPool;
+    
+    const SessionSectionEntry* findSection(SessionSection type, size_t recordSize) const;
+    bool validate(const std::string& filename);
+    
+public:
+    SessionView();
+    ~SessionView();
+    
+    SessionView(const SessionView&) = delete;
+    SessionView& operator=(const SessionView&) = delete;
+    
+    bool open(const std::string& filename);
+    void close();
+    bool isOpen() const;
+    
+    const SessionInfo* info() const;
+    const uint8_t* smfImage(size_t& length) const;
+    const SessionNote* notes(size_t& count) const;
+    const SessionSustainSpan* sustainSpans(size_t& count) const;
+    const SessionChord* chords(size_t& count) const;
+    const SessionKeyRegion* keyRegions(size_t& count) const;
+    const SessionProgression* progressions(size_t& count) const;
+    
+    // Pool lookups; references were bounds-checked when the file was opened
+    const uint8_t* pitches(uint32_t offset) const;
+    const int32_t* indices(uint32_t offset) const;
+    std::string string(const SessionString& reference) const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
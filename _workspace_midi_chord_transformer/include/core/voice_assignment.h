@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Minimum-cost assignment of the voices of one chord to the pitches of the next.
+//
+// Each original voice moves to exactly one target. With fewer originals than
+// targets the extra targets enter as new voices at no cost; with more
+// originals than targets every target is reached and the surplus voices merge
+// into a shared pitch. A move costs its distance in semitones plus a penalty
+// per semitone beyond maxVoiceMovement. That cost is convex in the distance,
+// so some optimal assignment never crosses voices and a monotone DP over the
+// sorted pitches is exact in O(n * m). Up to MAX_STACK_VOICES voices per side
+// the solver works entirely on stack arrays.
+class VoiceAssigner {
+private:
+    int maxVoiceMovement;
+    int overLimitPenalty;           // Extra cost per semitone beyond the limit
+    
+    // Pitches sorted ascending; the order arrays map back to input indices
+    int solveSorted(const int* originals, const size_t* originalOrder, size_t originalCount,
+                    const int* targets, const size_t* targetOrder, size_t targetCount,
+                    int* table, int* targetForOriginal) const;
+    
+public:
+    static const size_t MAX_STACK_VOICES = 16;
+    
+    VoiceAssigner(int maxMovement = 7, int penalty = 10);
+    
+    // Cost of moving a single voice by the given distance in semitones
+    int moveCost(int distance) const {
+        if (distance < 0) {
+            distance = -distance;
+        }
+        int excess = distance - maxVoiceMovement;
+        return distance + (excess > 0 ? excess * overLimitPenalty : 0);
+    }
+    
+    // Total cost of the best assignment. If targetForOriginal is given, entry i
+    // receives the index of the target that original i moves to.
+    int assign(const uint8_t* originals, size_t originalCount,
+               const uint8_t* targets, size_t targetCount,
+               int* targetForOriginal = nullptr) const;
+    
+    int assign(const std::vector<uint8_t>& originals,
+               const std::vector<uint8_t>& targets,
+               std::vector<int>* targetForOriginal = nullptr) const;
+    
+    // Cost only, for scoring many target chords against one original chord
+    // whose pitches were already sorted ascending
+    int cost(const int* sortedOriginals, size_t originalCount,
+             const uint8_t* targets, size_t targetCount) const;
+};
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "midi_structures.h"
+#include "voicing_dictionary.h"
+#include "scale_table.h"
 #include <vector>
 #include <memory>
 #include <string>
+#include <chrono>
 
 namespace midi_transformer {
 
@@ -14,12 +17,36 @@ struct VoiceLeadingOptions {
     bool maintainVoiceCount;        // Keep the same number of voices
     int maxVoiceMovement;           // Maximum semitones a voice can move
     std::vector<int> voicePriority; // Which voices to prioritize in movement
+    size_t searchNodeBudget;        // Voicings scored per search, 0 for no limit
+    int searchTimeBudgetMicros;     // Wall-clock limit per search, 0 for no limit
+    size_t exhaustiveSearchLimit;   // Larger voicing spaces fall back to beam search
+    size_t beamWidth;               // Partial voicings kept per voice in beam search
     
     VoiceLeadingOptions() 
         : minimizeMovement(true), 
           avoidParallels(true), 
           maintainVoiceCount(true), 
-          maxVoiceMovement(7) {}
+          maxVoiceMovement(7),
+          searchNodeBudget(0),
+          searchTimeBudgetMicros(0),
+          exhaustiveSearchLimit(32768),
+          beamWidth(64) {}
+};
+
+// Outcome of one voicing search. The search always returns the best voicing
+// found so far; lowerBound tells how far from optimal it can be.
+struct VoicingSearchResult {
+    std::vector<uint8_t> voicing;
+    int cost;                       // Movement cost of the voicing
+    int lowerBound;                 // No voicing in the register window costs less
+    bool provablyOptimal;           // Exhaustive search finished, or cost meets the bound
+    bool exhaustive;                // False when beam search was used
+    bool budgetExhausted;           // Stopped early on the node or time budget
+    size_t nodesVisited;            // Full and partial voicings scored
+    
+    VoicingSearchResult()
+        : cost(0), lowerBound(0), provablyOptimal(false),
+          exhaustive(false), budgetExhausted(false), nodesVisited(0) {}
 };
 
 // For tracking voice movement during transformations
@@ -33,20 +60,65 @@ struct VoiceMovement {
 class VoiceLeadingEngine {
 private:
     std::shared_ptr<VoiceLeadingOptions> options;
+    VoicingSearchResult lastSearchResult;
+    std::vector<uint8_t> keyPitchClasses;   // Scratch for key-constrained targets
     
     // Helper methods for voice leading
     std::vector<uint8_t> findOptimalVoicing(
         const std::vector<uint8_t>& targetPitches,
         const std::vector<uint8_t>& originalNotes);
     
-    bool hasParallelFifthsOrOctaves(
+    void exhaustiveVoicingSearch(
+        const std::vector<uint8_t>& pitchClasses,
         const std::vector<uint8_t>& originalNotes,
-        const std::vector<uint8_t>& newNotes);
+        int minOctave, int maxOctave,
+        std::chrono::steady_clock::time_point start,
+        VoicingSearchResult& result);
+    
+    void beamVoicingSearch(
+        const std::vector<uint8_t>& pitchClasses,
+        const std::vector<uint8_t>& originalNotes,
+        int minOctave, int maxOctave,
+        std::chrono::steady_clock::time_point start,
+        VoicingSearchResult& result);
+    
+    // Lowest-cost voicing among row-major candidates, skipping those flagged
+    // in hasParallels. Dispatches once per call into a loop specialized on
+    // the boolean options. Returns count if every candidate was skipped.
+    size_t scanCandidates(
+        const std::vector<uint8_t>& originalNotes,
+        const uint8_t* voicings, size_t count, size_t voiceCount,
+        const std::vector<uint8_t>& hasParallels,
+        std::chrono::steady_clock::time_point start,
+        VoicingSearchResult& result,
+        int& bestCost) const;
+    
+    bool searchBudgetSpent(
+        const VoicingSearchResult& result,
+        std::chrono::steady_clock::time_point start) const;
+    
+    // Every original voice has to reach some target pitch, so summing each
+    // one's cheapest move bounds the cost of any voicing in the window
+    int movementLowerBound(
+        const std::vector<uint8_t>& originalNotes,
+        const std::vector<uint8_t>& pitchClasses,
+        int minOctave, int maxOctave) const;
+    
+    // Flags each candidate that moves a perfect fifth or octave of the
+    // original chord in parallel
+    void markParallelFifthsOrOctaves(
+        const std::vector<uint8_t>& originalNotes,
+        const VoicingCandidates& candidates,
+        std::vector<uint8_t>& hasParallels) const;
     
     int calculateMovementCost(
         const std::vector<uint8_t>& originalNotes,
         const std::vector<uint8_t>& newNotes);
     
+    int calculateMovementCost(
+        const std::vector<uint8_t>& originalNotes,
+        const uint8_t* newNotes, size_t newCount);
+    
 public:
     VoiceLeadingEngine(const VoiceLeadingOptions& opts);
     
@@ -58,6 +130,15 @@ public:
         const std::string& targetChordName,
         const TransformationOptions& transformOptions);
     
+    // Anytime voicing search: exhaustive for small voicing spaces, beam
+    // search beyond exhaustiveSearchLimit, both within the search budgets
+    VoicingSearchResult searchVoicing(
+        const std::vector<uint8_t>& targetPitches,
+        const std::vector<uint8_t>& originalNotes);
+    
+    // Result of the search behind the most recent transformation
+    const VoicingSearchResult& getLastSearchResult() const;
+    
     std::vector<std::shared_ptr<VoiceMovement>> analyzeVoiceMovement(
         const std::vector<uint8_t>& originalNotes,
         const std::vector<uint8_t>& newNotes);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace midi_transformer {
+
+// Candidate voicings in structure-of-arrays layout: voice k of candidate c
+// lives at pitches[k * stride + c], so per-voice checks stream over candidates.
+// The stride is count rounded up to a whole number of batches.
+struct VoicingCandidates {
+    static const size_t BATCH = 16;
+    
+    size_t voiceCount;
+    size_t count;
+    size_t stride;
+    std::vector<uint8_t> pitches;
+    
+    VoicingCandidates() : voiceCount(0), count(0), stride(0) {}
+};
+
+// Every octave placement of one pitch-class sequence inside one register
+// window. Candidates are sorted lexicographically by voice pitches, the
+// order the voicing search has always visited them in.
+struct VoicingTable {
+    VoicingCandidates candidates;   // Column layout for batched screening
+    std::vector<uint8_t> voicings;  // Row layout: candidate c at voicings[c * voiceCount]
+    std::vector<uint8_t> spans;     // Highest minus lowest pitch per candidate
+    std::vector<uint16_t> intervalSignatures; // Bit i set if some voice pair is i semitones apart mod 12
+    
+    const uint8_t* voicing(size_t candidate) const {
+        return voicings.data() + candidate * candidates.voiceCount;
+    }
+};
+
+// Process-wide, lazily built cache of voicing tables keyed by pitch-class
+// sequence and octave window. Tables are immutable once published, so
+// callers scan them without holding the lock.
+class VoicingDictionary {
+private:
+    // Longest pitch-class sequence that fits the packed key
+    static const size_t MAX_KEYED_VOICES = 12;
+    
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const VoicingTable>> tables;
+    
+    static std::shared_ptr<const VoicingTable> buildTable(
+        const std::vector<uint8_t>& pitchClasses, int minOctave, int maxOctave);
+    
+public:
+    static VoicingDictionary& shared();
+    
+    // Table for the given pitch classes (voice order preserved) with every
+    // voice placed in octaves [minOctave, maxOctave] and within MIDI range
+    std::shared_ptr<const VoicingTable> lookup(
+        const std::vector<uint8_t>& pitchClasses, int minOctave, int maxOctave);
+    
+    size_t size();
+    void clear();
+};
+
+} // namespace midi_transformer
\ No newline at end of file
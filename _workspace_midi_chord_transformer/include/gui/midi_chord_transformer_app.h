@@ -21,6 +21,7 @@ private:
     std::vector<std::string> targetChordNames;
     std::vector<std::shared_ptr<TransformationOptions>> transformOptions;
     std::vector<bool> selectedFiles;
+    std::vector<bool> selectedTracks;
     int currentFileIndex;
     
     // Console output
@@ -29,6 +30,7 @@ private:
     // GUI rendering methods
     void renderMainWindow();
     void renderControlPanel();
+    void renderTrackList();
     void renderOutputPanel();
     void renderConsoleOutput();
     void renderChordList();
@@ -39,7 +41,10 @@ private:
     
     // Action handlers
     void handleLoadFile();
+    void handleAnalyzeTracks();
     void handleSaveFile();
+    void handleSaveSession();
+    void handleLoadSession();
     void handleBatchProcess();
     void handleTransformChords();
     void handleUndoRedo();
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 
 namespace midi_transformer {
 namespace utils {
@@ -13,6 +14,9 @@ std::string getBaseFilename(const std::string& path);
 std::vector<std::string> findMidiFiles(const std::string& directory);
 std::string getFileExtension(const std::string& filename);
 bool createDirectory(const std::string& path);
+// Writes a uniquely named temporary file next to filename and renames it over
+// filename, so readers see the old or the new contents, never a partial file
+bool writeFileAtomically(const std::string& filename, const void* data, size_t size);
 
 // MIDI-specific utilities
 std::string midiNoteToName(uint8_t noteNumber);
@@ -32,6 +36,7 @@ std::vector<uint8_t> getChordNotesFromName(const std::string& chordName, uint8_t
 // Hash calculation for caching
 std::string calculateFileHash(const std::string& filename);
 std::string calculateDataHash(const std::vector<uint8_t>& data);
+uint64_t hashBytes(const uint8_t* data, size_t size);
 
 } // namespace utils
 } // namespace midi_transformer
\ No newline at end of file
@@ -36,13 +36,27 @@ void ActionManager::recordTransformation(
     action->description = description;
     action->timestamp = std::chrono::system_clock::now();
     
+    pushAction(*action);
+}
+
+void ActionManager::recordNoteEdit(const NoteEdit& edit, const std::string& description) {
+    TransformationAction action;
+    action.type = TransformationAction::ActionType::NOTE_EDIT;
+    action.noteEdit = edit;
+    action.description = description;
+    action.timestamp = std::chrono::system_clock::now();
+    
+    pushAction(action);
+}
+
+void ActionManager::pushAction(const TransformationAction& action) {
     // If we're not at the end of history, truncate
     if (history->currentPosition < history->actions.size()) {
         history->actions.resize(history->currentPosition);
     }
     
     // Add the action and update position
-    history->actions.push_back(*action);
+    history->actions.push_back(action);
     history->currentPosition++;
     
     // Enforce max history size
@@ -61,11 +75,15 @@ bool ActionManager::undo() {
     history->currentPosition--;
     const TransformationAction& action = history->actions[history->currentPosition];
     
+    if (action.type == TransformationAction::ActionType::NOTE_EDIT) {
+        processor.applyNoteEdit(action.noteEdit, true);
+    }
+    
     // Apply the undo
     for (size_t i = 0; i < action.affectedChordIndices.size(); i++) {
         int chordIndex = action.affectedChordIndices[i];
         
-        if (chordIndex >= 0 && chordIndex < static_cast<int>(action.previousState.size())) {
+        if (chordIndex >= 0 && i < action.previousState.size()) {
             // Update the chord with its previous state
             processor.updateChord(chordIndex, action.previousState[i]);
         }
@@ -84,11 +102,15 @@ bool ActionManager::redo() {
     const TransformationAction& action = history->actions[history->currentPosition];
     history->currentPosition++;
     
+    if (action.type == TransformationAction::ActionType::NOTE_EDIT) {
+        processor.applyNoteEdit(action.noteEdit, false);
+    }
+    
     // Apply the redo
     for (size_t i = 0; i < action.affectedChordIndices.size(); i++) {
         int chordIndex = action.affectedChordIndices[i];
         
-        if (chordIndex >= 0 && chordIndex < static_cast<int>(action.newState.size())) {
+        if (chordIndex >= 0 && i < action.newState.size()) {
             // Update the chord with its new state
             processor.updateChord(chordIndex, action.newState[i]);
         }
@@ -120,6 +142,20 @@ std::string ActionManager::getRedoDescription() const {
     return "Nothing to redo";
 }
 
+std::vector<int> ActionManager::getUndoIndices() const {
+    if (canUndo()) {
+        return history->actions[history->currentPosition - 1].affectedChordIndices;
+    }
+    return {};
+}
+
+std::vector<int> ActionManager::getRedoIndices() const {
+    if (canRedo()) {
+        return history->actions[history->currentPosition].affectedChordIndices;
+    }
+    return {};
+}
+
 void ActionManager::clearHistory() {
     history->actions.clear();
     history->currentPosition = 0;
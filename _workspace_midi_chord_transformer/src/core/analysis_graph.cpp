@@ -0,0 +1,112 @@
+#include "../../include/core/analysis_graph.h"
+
+#include <iostream>
+
+namespace midi_transformer {
+
+AnalysisGraph::Stage& AnalysisGraph::stageAt(AnalysisStage stage) {
+    return stages[static_cast<size_t>(stage)];
+}
+
+const AnalysisGraph::Stage& AnalysisGraph::stageAt(AnalysisStage stage) const {
+    return stages[static_cast<size_t>(stage)];
+}
+
+void AnalysisGraph::define(
+    AnalysisStage stage,
+    const std::vector<AnalysisStage>& inputs,
+    std::function<bool()> compute,
+    std::function<bool()> restore) {
+    
+    Stage& node = stageAt(stage);
+    for (AnalysisStage input : inputs) {
+        if (input >= stage) {
+            std::cerr << "Error: Analysis stage " << static_cast<int>(stage) 
+                      << " cannot read stage " << static_cast<int>(input) << std::endl;
+            continue;
+        }
+        node.inputs.push_back(input);
+        stageAt(input).dependents.push_back(stage);
+    }
+    node.compute = std::move(compute);
+    node.restore = std::move(restore);
+    node.dirty = true;
+    node.failed = false;
+}
+
+void AnalysisGraph::markDependentsDirty(AnalysisStage stage) {
+    // Results supplied from outside can be clean below dirty ones, so always
+    // walk the whole downstream; there are only a handful of stages
+    for (AnalysisStage dependent : stageAt(stage).dependents) {
+        Stage& node = stageAt(dependent);
+        node.dirty = true;
+        node.failed = false;
+        markDependentsDirty(dependent);
+    }
+}
+
+void AnalysisGraph::invalidate(AnalysisStage stage) {
+    Stage& node = stageAt(stage);
+    node.dirty = true;
+    node.failed = false;
+    markDependentsDirty(stage);
+}
+
+void AnalysisGraph::invalidateAll() {
+    for (auto& node : stages) {
+        node.dirty = true;
+        node.failed = false;
+    }
+}
+
+void AnalysisGraph::markComputed(AnalysisStage stage) {
+    Stage& node = stageAt(stage);
+    node.dirty = false;
+    node.failed = false;
+}
+
+bool AnalysisGraph::require(AnalysisStage stage) {
+    Stage& node = stageAt(stage);
+    if (!node.dirty) {
+        return true;
+    }
+    if (node.failed) {
+        return false;
+    }
+    
+    // Inputs come first even when the memo hits, so a restored result never
+    // sits on top of inputs that were left empty
+    for (AnalysisStage input : node.inputs) {
+        if (!require(input)) {
+            return false;
+        }
+    }
+    
+    if (node.restore && node.restore()) {
+        node.dirty = false;
+        markDependentsDirty(stage);
+        return true;
+    }
+    
+    node.computeCount++;
+    if (!node.compute || !node.compute()) {
+        node.failed = true;
+        return false;
+    }
+    
+    // Dependents read the new result, including any that were restored
+    // from a memo while this stage was dirty
+    node.dirty = false;
+    markDependentsDirty(stage);
+    return true;
+}
+
+bool AnalysisGraph::isDirty(AnalysisStage stage) const {
+    return stageAt(stage).dirty;
+}
+
+size_t AnalysisGraph::getComputeCount(AnalysisStage stage) const {
+    return stageAt(stage).computeCount;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
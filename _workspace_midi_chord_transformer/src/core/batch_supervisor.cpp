@@ -0,0 +1,503 @@
+#include "../../include/core/batch_supervisor.h"
+#include "../../include/core/midi_processor.h"
+#include "../../include/core/input_deduplicator.h"
+#include "../../include/utils/midi_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace midi_transformer {
+
+namespace {
+
+// Job states in shared memory. A running job holds the slot of its worker,
+// so the supervisor knows which file a dead worker was on.
+const uint32_t JOB_PENDING = 0;
+const uint32_t JOB_DONE = 1;
+const uint32_t JOB_FAILED = 2;
+const uint32_t JOB_QUARANTINED = 3;
+const uint32_t JOB_RUNNING = 16;    // Plus the worker slot
+
+const auto SUPERVISOR_POLL_INTERVAL = std::chrono::milliseconds(10);
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<int64_t>::is_always_lock_free,
+              "The batch queue is shared between processes and needs lock-free atomics");
+
+int64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+struct SharedJob {
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> fromCache;
+    
+    SharedJob() : state(JOB_PENDING), fromCache(0) {}
+};
+
+struct WorkerSlot {
+    std::atomic<int64_t> currentJob;    // -1 between files
+    std::atomic<int64_t> startedAt;     // Steady clock nanoseconds when it took the file
+    
+    WorkerSlot() : currentJob(-1), startedAt(0) {}
+};
+
+// Header of an anonymous shared mapping, followed by the worker slots and
+// the jobs. Workers inherit the mapping at the same address when forked.
+struct BatchQueue {
+    std::atomic<uint64_t> nextShard;
+    size_t jobCount;
+    size_t workerCount;
+    WorkerSlot* slots;
+    SharedJob* jobs;
+    
+    BatchQueue() : nextShard(0), jobCount(0), workerCount(0), slots(nullptr), jobs(nullptr) {}
+};
+
+BatchSupervisor::BatchSupervisor(const BatchSupervisorOptions& options)
+    : options(options), workerRestarts(0) {
+    this->options.shardSize = std::max<size_t>(1, options.shardSize);
+    this->options.maxCrashes = std::max<uint32_t>(1, options.maxCrashes);
+}
+
+void BatchSupervisor::configure(MidiProcessor& processor) const {
+    processor.setParseOptions(options.parseOptions);
+    processor.setDetectionMode(options.detectionMode);
+    processor.setTimeTolerance(options.timeTolerance);
+    processor.setAutoTimeTolerance(options.autoTimeTolerance);
+}
+
+std::vector<BatchJob> BatchSupervisor::makeJobs(
+    const std::vector<std::string>& inputPaths,
+    const std::string& outputDirectory,
+    const std::string& suffix) {
+    
+    std::unordered_map<std::string, size_t> stemCounts;
+    for (const std::string& inputPath : inputPaths) {
+        stemCounts[utils::getBaseFilename(inputPath)]++;
+    }
+    
+    std::vector<BatchJob> jobs;
+    for (const std::string& inputPath : inputPaths) {
+        std::string name = utils::getBaseFilename(inputPath);
+        if (stemCounts[name] > 1) {
+            uint64_t pathHash = utils::hashBytes(reinterpret_cast<const uint8_t*>(inputPath.data()), inputPath.size());
+            char hashText[16];
+            std::snprintf(hashText, sizeof(hashText), "_%08llx",
+                          static_cast<unsigned long long>(pathHash & 0xFFFFFFFFULL));
+            name += hashText;
+        }
+        name += suffix + ".mid";
+        jobs.emplace_back(inputPath, (std::filesystem::path(outputDirectory) / name).string());
+    }
+    return jobs;
+}
+
+std::string BatchSupervisor::cachePath(uint64_t musicHash) const {
+    // Sessions hold the analysis, so the settings are part of the name
+    std::string settings = std::to_string(static_cast<int>(options.parseOptions.profile)) + "/" +
+                           std::to_string(options.parseOptions.excludedChannels) + "/" +
+                           std::to_string(static_cast<int>(options.detectionMode)) + "/" +
+                           (options.autoTimeTolerance ? std::string("auto") : std::to_string(options.timeTolerance));
+    uint64_t settingsHash = utils::hashBytes(reinterpret_cast<const uint8_t*>(settings.data()), settings.size());
+    
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%08llx.mcsession",
+                  static_cast<unsigned long long>(musicHash),
+                  static_cast<unsigned long long>(settingsHash & 0xFFFFFFFFULL));
+    return (std::filesystem::path(options.cacheDirectory) / name).string();
+}
+
+bool BatchSupervisor::processJob(MidiProcessor& processor, const BatchJob& job, bool& fromCache) const {
+    configure(processor);
+    fromCache = false;
+    
+    // Sessions are keyed by the channel events, so every input with the same
+    // tracks shares one, whichever worker analyzed it. Inputs the supervisor
+    // could not read have no fingerprint and are not cached.
+    const InputFingerprint& fingerprint = job.fingerprint;
+    std::string sessionFile;
+    bool sessionLoaded = false;
+    if (!options.cacheDirectory.empty() && fingerprint.size > 0) {
+        sessionFile = cachePath(fingerprint.valid ? fingerprint.musicHash : fingerprint.contentHash);
+        std::error_code error;
+        sessionLoaded = std::filesystem::exists(sessionFile, error) && processor.loadSession(sessionFile);
+    }
+    
+    if (sessionLoaded) {
+        char contentHash[24];
+        std::snprintf(contentHash, sizeof(contentHash), "%016llx",
+                      static_cast<unsigned long long>(fingerprint.contentHash));
+        if (processor.getFileHash() == contentHash) {
+            fromCache = true;
+        } else {
+            // The session holds the bytes of another file with the same
+            // tracks; this one is written from its own bytes, with the
+            // cached chords restored through the detection cache
+            processor.rememberDetection();
+            if (!processor.loadMidiFile(job.inputPath)) {
+                return false;
+            }
+            fromCache = true;
+        }
+    }
+    
+    if (!fromCache) {
+        if (!processor.loadMidiFile(job.inputPath)) {
+            return false;
+        }
+        
+        // Only sessions with current notes are cached, as a cached session is
+        // restored with every stage marked current. Sessions are replaced
+        // atomically, so a worker killed while saving never leaves a
+        // truncated one in the cache.
+        if (!sessionFile.empty() && processor.isAnalysisCurrent(AnalysisStage::NOTES) &&
+            processor.isAnalysisCurrent(AnalysisStage::CHORDS)) {
+            processor.saveSession(sessionFile);
+        }
+    }
+    
+    // Batches apply no chord transformations; the output is the file as
+    // written back by the processor after analysis
+    return processor.writeMidiFile(job.outputPath);
+}
+
+bool BatchSupervisor::run(std::vector<BatchJob>& jobs) {
+    workerRestarts = 0;
+    
+    if (!options.cacheDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(options.cacheDirectory, error);
+        if (error) {
+            std::cerr << "Warning: Could not create cache directory " << options.cacheDirectory << std::endl;
+        }
+    }
+
+    
+    // Only the first of byte-identical inputs is analyzed
+    std::vector<std::string> inputPaths;
+    for (const BatchJob& job : jobs) {
+        inputPaths.push_back(job.inputPath);
+    }
+    std::vector<BatchInput> inputs = InputDeduplicator::plan(inputPaths, options.workerCount);
+    std::vector<size_t> analyzed;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        BatchJob& job = jobs[i];
+        job.fingerprint = inputs[i].fingerprint;
+        job.duplicateKind = inputs[i].kind;
+        job.duplicateOf = inputs[i].representative;
+        job.status = BatchJobStatus::PENDING;
+        job.crashCount = 0;
+        job.fromCache = false;
+        
+        // Inputs that could not be fingerprinted still go to the workers,
+        // where a read that fails, stalls or crashes costs only a worker
+        if (job.duplicateKind != DuplicateKind::IDENTICAL_BYTES) {
+            analyzed.push_back(i);
+        }
+    }
+    
+    // Inputs with the same tracks follow the one they share a session with,
+    // so they tend to land in its shard and find the session saved
+    std::stable_sort(analyzed.begin(), analyzed.end(), [&jobs](size_t a, size_t b) {
+        return jobs[a].duplicateOf < jobs[b].duplicateOf;
+    });
+    std::vector<BatchJob> analyzedJobs;
+    for (size_t i : analyzed) {
+        analyzedJobs.push_back(jobs[i]);
+    }
+
+#ifndef _WIN32
+    bool complete = runInWorkers(analyzedJobs);
+#else
+    bool complete = runInProcess(analyzedJobs);
+#endif
+    
+    for (size_t j = 0; j < analyzed.size(); j++) {
+        jobs[analyzed[j]] = analyzedJobs[j];
+    }
+    copyDuplicateOutputs(jobs);
+    return complete;
+}
+
+void BatchSupervisor::copyDuplicateOutputs(std::vector<BatchJob>& jobs) const {
+    for (BatchJob& job : jobs) {
+        if (job.duplicateKind != DuplicateKind::IDENTICAL_BYTES) {
+            continue;
+        }
+        const BatchJob& original = jobs[job.duplicateOf];
+        if (original.status != BatchJobStatus::DONE) {
+            job.status = original.status;
+            job.crashCount = original.crashCount;
+            continue;
+        }
+        
+        // The same input listed twice maps to the same output
+        std::error_code error;
+        if (std::filesystem::equivalent(original.outputPath, job.outputPath, error)) {
+            job.status = BatchJobStatus::DONE;
+            continue;
+        }
+        std::filesystem::copy_file(original.outputPath, job.outputPath,
+                                   std::filesystem::copy_options::overwrite_existing, error);
+        if (error) {
+            std::cerr << "Error: Could not copy " << original.outputPath << " to " << job.outputPath << std::endl;
+            job.status = BatchJobStatus::FAILED;
+        } else {
+            job.status = BatchJobStatus::DONE;
+        }
+    }
+}
+
+bool BatchSupervisor::runInProcess(std::vector<BatchJob>& jobs) {
+    MidiProcessor processor;
+    for (BatchJob& job : jobs) {
+        bool fromCache = false;
+        job.status = processJob(processor, job, fromCache) ? BatchJobStatus::DONE : BatchJobStatus::FAILED;
+        job.fromCache = fromCache;
+    }
+    return true;
+}
+
+void BatchSupervisor::runWorker(BatchQueue& queue, const std::vector<BatchJob>& jobs, size_t slot) const {
+#ifndef _WIN32
+    MidiProcessor processor;
+    WorkerSlot& worker = queue.slots[slot];
+    
+    auto runJob = [&](size_t index) {
+        SharedJob& job = queue.jobs[index];
+        if (job.state.load() != JOB_PENDING) {
+            return;
+        }
+        worker.startedAt = steadyNanoseconds();
+        worker.currentJob = static_cast<int64_t>(index);
+        
+        uint32_t expected = JOB_PENDING;
+        if (job.state.compare_exchange_strong(expected, JOB_RUNNING + static_cast<uint32_t>(slot))) {
+            bool fromCache = false;
+            bool written = processJob(processor, jobs[index], fromCache);
+            job.fromCache = fromCache ? 1 : 0;
+            job.state = written ? JOB_DONE : JOB_FAILED;
+        }
+        worker.currentJob = -1;
+    };
+    
+    for (;;) {
+        size_t first = static_cast<size_t>(queue.nextShard++) * options.shardSize;
+        if (first >= queue.jobCount) {
+            break;
+        }
+        size_t end = std::min(queue.jobCount, first + options.shardSize);
+        for (size_t i = first; i < end; i++) {
+            runJob(i);
+        }
+    }
+    
+    // Files left in shards of dead workers, or put back after a crash
+    for (size_t i = 0; i < queue.jobCount; i++) {
+        runJob(i);
+    }
+#else
+    (void)queue;
+    (void)jobs;
+    (void)slot;
+#endif
+}
+
+bool BatchSupervisor::runInWorkers(std::vector<BatchJob>& jobs) {
+#ifndef _WIN32
+    if (jobs.empty()) {
+        return true;
+    }
+    
+    size_t workerCount = options.workerCount > 0 ? options.workerCount : std::thread::hardware_concurrency();
+    size_t shardCount = (jobs.size() + options.shardSize - 1) / options.shardSize;
+    workerCount = std::max<size_t>(1, std::min(workerCount, shardCount));
+    
+    size_t mappingSize = sizeof(BatchQueue) + workerCount * sizeof(WorkerSlot) + jobs.size() * sizeof(SharedJob);
+    void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Warning: Could not map the batch queue; processing in this process" << std::endl;
+        return runInProcess(jobs);
+    }
+    
+    uint8_t* position = static_cast<uint8_t*>(mapping);
+    BatchQueue* queue = new (position) BatchQueue();
+    position += sizeof(BatchQueue);
+    queue->jobCount = jobs.size();
+    queue->workerCount = workerCount;
+    queue->slots = reinterpret_cast<WorkerSlot*>(position);
+    for (size_t slot = 0; slot < workerCount; slot++) {
+        new (position) WorkerSlot();
+        position += sizeof(WorkerSlot);
+    }
+    queue->jobs = reinterpret_cast<SharedJob*>(position);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        new (position) SharedJob();
+        position += sizeof(SharedJob);
+    }
+    
+    std::vector<pid_t> workers(workerCount, -1);
+    std::vector<bool> timedOut(workerCount, false);
+    auto startWorker = [&](size_t slot) {
+        queue->slots[slot].currentJob = -1;
+        
+        // Buffered output would otherwise be written again by the child
+        std::cout.flush();
+        std::cerr.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            runWorker(*queue, jobs, slot);
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(0);
+        }
+        if (pid < 0) {
+            std::cerr << "Error: Could not start a batch worker" << std::endl;
+            return false;
+        }
+        workers[slot] = pid;
+        timedOut[slot] = false;
+        return true;
+    };
+    
+    size_t liveCount = 0;
+    for (size_t slot = 0; slot < workerCount; slot++) {
+        if (startWorker(slot)) {
+            liveCount++;
+        }
+    }
+    if (liveCount == 0) {
+        munmap(mapping, mappingSize);
+        std::cerr << "Warning: Processing the batch in this process" << std::endl;
+        return runInProcess(jobs);
+    }
+    
+    int64_t timeout = static_cast<int64_t>(options.fileTimeoutSeconds) * 1000000000LL;
+    while (liveCount > 0) {
+        bool reaped = false;
+        for (size_t slot = 0; slot < workerCount; slot++) {
+            if (workers[slot] < 0) {
+                continue;
+            }
+            
+            int status = 0;
+            pid_t result = waitpid(workers[slot], &status, WNOHANG);
+            if (result == 0) {
+                // Still running; kill it when it has been on one file too long
+                WorkerSlot& worker = queue->slots[slot];
+                int64_t current = worker.currentJob.load();
+                if (timeout > 0 && !timedOut[slot] && current >= 0 &&
+                    queue->jobs[current].state.load() == JOB_RUNNING + static_cast<uint32_t>(slot) &&
+                    steadyNanoseconds() - worker.startedAt.load() > timeout) {
+                    kill(workers[slot], SIGKILL);
+                    timedOut[slot] = true;
+                }
+                continue;
+            }
+            
+            workers[slot] = -1;
+            liveCount--;
+            reaped = true;
+            
+            // The file the worker died on goes back in the queue, or into quarantine
+            for (size_t i = 0; i < jobs.size(); i++) {
+                if (queue->jobs[i].state.load() != JOB_RUNNING + static_cast<uint32_t>(slot)) {
+                    continue;
+                }
+                BatchJob& job = jobs[i];
+                job.crashCount++;
+                
+                std::cerr << "Warning: Batch worker ";
+                if (timedOut[slot]) {
+                    std::cerr << "timed out";
+                } else if (result > 0 && WIFSIGNALED(status)) {
+                    std::cerr << "was killed by signal " << WTERMSIG(status);
+                } else {
+                    std::cerr << "exited";
+                }
+                std::cerr << " on " << job.inputPath << std::endl;
+                
+                if (job.crashCount >= options.maxCrashes) {
+                    queue->jobs[i].state = JOB_QUARANTINED;
+                    std::error_code error;
+                    std::filesystem::remove(job.outputPath, error);
+                    std::cerr << "Warning: Quarantined " << job.inputPath << " after "
+                              << job.crashCount << " failed workers" << std::endl;
+                } else {
+                    queue->jobs[i].state = JOB_PENDING;
+                }
+            }
+        }
+        
+        if (!reaped) {
+            std::this_thread::sleep_for(SUPERVISOR_POLL_INTERVAL);
+            continue;
+        }
+        
+        // Restart workers while files are waiting; a worker that finds
+        // nothing left simply exits
+        size_t pendingCount = 0;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (queue->jobs[i].state.load() == JOB_PENDING) {
+                pendingCount++;
+            }
+        }
+        for (size_t slot = 0; slot < workerCount && pendingCount > 0; slot++) {
+            if (workers[slot] < 0 && startWorker(slot)) {
+                liveCount++;
+                workerRestarts++;
+                pendingCount--;
+            }
+        }
+    }
+    
+    bool complete = true;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        uint32_t state = queue->jobs[i].state.load();
+        jobs[i].fromCache = queue->jobs[i].fromCache.load() != 0;
+        if (state == JOB_DONE) {
+            jobs[i].status = BatchJobStatus::DONE;
+        } else if (state == JOB_QUARANTINED) {
+            jobs[i].status = BatchJobStatus::QUARANTINED;
+        } else {
+            // Pending here means no worker could be restarted for it
+            jobs[i].status = BatchJobStatus::FAILED;
+            complete = complete && state == JOB_FAILED;
+        }
+    }
+    
+    munmap(mapping, mappingSize);
+    return complete;
+#else
+    return runInProcess(jobs);
+#endif
+}
+
+size_t BatchSupervisor::getWorkerRestartCount() const {
+    return workerRestarts;
+}
+
+size_t BatchSupervisor::countStatus(const std::vector<BatchJob>& jobs, BatchJobStatus status) {
+    return static_cast<size_t>(std::count_if(jobs.begin(), jobs.end(),
+        [status](const BatchJob& job) { return job.status == status; }));
+}
+
+} // namespace midi_transformer
\ No newline at end of file
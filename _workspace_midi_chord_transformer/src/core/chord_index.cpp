@@ -0,0 +1,504 @@
+#include "../../include/core/chord_index.h"
+#include "../../include/core/midi_processor.h"
+#include "../../include/utils/midi_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace midi_transformer {
+
+static_assert(sizeof(ChordIndexHeader) == 72, "ChordIndexHeader layout changed");
+static_assert(sizeof(ChordIndexTerm) == 24, "ChordIndexTerm layout changed");
+static_assert(sizeof(ChordIndexFile) == 16, "ChordIndexFile layout changed");
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'M', 'C', 'T', 'G', 'R', 'A', 'M', '\0'};
+
+size_t alignTo8(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+bool rangeFits(uint64_t offset, uint64_t count, uint64_t limit) {
+    return offset <= limit && count <= limit - offset;
+}
+
+void appendVarint(std::vector<uint8_t>& bytes, uint64_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+bool readVarint(const uint8_t*& position, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; position < end && shift < 64; shift += 7) {
+        uint8_t byte = *position++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+GramChord gramChord(const std::string& chordName) {
+    GramChord chord;
+    chord.parsed = parseChordSymbol(chordName, chord.root, chord.quality);
+    return chord;
+}
+
+bool packGram(const std::vector<GramChord>& chords, size_t first, size_t length, uint64_t& gram) {
+    gram = 0;
+    for (size_t i = first; i < first + length; i++) {
+        if (!chords[i].parsed) {
+            return false;
+        }
+        uint64_t interval = static_cast<uint64_t>((chords[i].root - chords[first].root + 12) % 12);
+        gram = (gram << 9) | (interval << 5) | static_cast<uint64_t>(chords[i].quality);
+    }
+    return true;
+}
+
+// ChordIndexBuilder
+
+ChordIndexBuilder::ChordIndexBuilder(uint32_t gramLength)
+    : gramLength(std::max<uint32_t>(2, std::min(gramLength, CHORD_INDEX_MAX_GRAM_LENGTH))) {
+}
+
+uint32_t ChordIndexBuilder::reserveFiles(const std::vector<std::string>& filePaths) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t firstId = static_cast<uint32_t>(paths.size());
+    paths.insert(paths.end(), filePaths.begin(), filePaths.end());
+    chordCounts.resize(paths.size(), 0);
+    return firstId;
+}
+
+void ChordIndexBuilder::fillFile(uint32_t fileId, const std::vector<std::shared_ptr<Chord>>& chords) {
+    std::vector<GramChord> reduced;
+    reduced.reserve(chords.size());
+    for (const auto& chord : chords) {
+        reduced.push_back(gramChord(chord->name));
+    }
+    
+    // Grams are collected before taking the lock, so workers only contend on the merge
+    std::vector<std::pair<uint64_t, uint32_t>> grams;
+    for (size_t first = 0; first + gramLength <= reduced.size(); first++) {
+        uint64_t gram;
+        if (packGram(reduced, first, gramLength, gram)) {
+            grams.push_back({gram, static_cast<uint32_t>(first)});
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    chordCounts[fileId] = static_cast<uint32_t>(chords.size());
+    for (const auto& gram : grams) {
+        postings[gram.first].push_back(ChordIndexHit(fileId, gram.second));
+    }
+}
+
+uint32_t ChordIndexBuilder::addFile(const std::string& path, const std::vector<std::shared_ptr<Chord>>& chords) {
+    uint32_t fileId = reserveFiles({path});
+    fillFile(fileId, chords);
+    return fileId;
+}
+
+bool ChordIndexBuilder::ingest(const std::vector<std::string>& midiFiles, unsigned threadCount) {
+    if (midiFiles.empty()) {
+        return true;
+    }
+    
+    uint32_t firstId = reserveFiles(midiFiles);
+    std::atomic<size_t> nextFile(0);
+    std::atomic<size_t> loadedFiles(0);
+    
+    // Workers take files one at a time, since file sizes vary widely
+    auto detectFiles = [&]() {
+        for (size_t i = nextFile++; i < midiFiles.size(); i = nextFile++) {
+            MidiProcessor processor;
+            if (!processor.loadMidiFile(midiFiles[i])) {
+                std::cerr << "Warning: Could not index " << midiFiles[i] << std::endl;
+                continue;
+            }
+            fillFile(firstId + static_cast<uint32_t>(i), processor.getChords());
+            loadedFiles++;
+        }
+    };
+    
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threadCount, midiFiles.size())));
+    
+    if (threadCount == 1) {
+        detectFiles();
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threadCount; t++) {
+            workers.emplace_back(detectFiles);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    return loadedFiles > 0;
+}
+
+bool ChordIndexBuilder::write(const std::string& indexFilename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    std::vector<uint64_t> grams;
+    grams.reserve(postings.size());
+    for (const auto& entry : postings) {
+        grams.push_back(entry.first);
+    }
+    std::sort(grams.begin(), grams.end());
+    
+    std::vector<ChordIndexTerm> terms(grams.size());
+    std::vector<uint8_t> postingBytes;
+    for (size_t t = 0; t < grams.size(); t++) {
+        std::vector<ChordIndexHit>& hits = postings[grams[t]];
+        std::sort(hits.begin(), hits.end());
+        
+        ChordIndexTerm& term = terms[t];
+        term.gram = grams[t];
+        term.postingsOffset = postingBytes.size();
+        term.postingCount = static_cast<uint32_t>(hits.size());
+        
+        uint32_t previousFile = 0;
+        uint32_t previousOffset = 0;
+        for (const ChordIndexHit& hit : hits) {
+            if (hit.fileId != previousFile) {
+                previousOffset = 0;
+            }
+            appendVarint(postingBytes, hit.fileId - previousFile);
+            appendVarint(postingBytes, hit.offset - previousOffset);
+            previousFile = hit.fileId;
+            previousOffset = hit.offset;
+        }
+        term.postingsSize = static_cast<uint32_t>(postingBytes.size() - term.postingsOffset);
+    }
+    
+    std::vector<ChordIndexFile> files(paths.size());
+    std::vector<char> pathPool;
+    for (size_t f = 0; f < paths.size(); f++) {
+        files[f].pathOffset = pathPool.size();
+        files[f].pathLength = static_cast<uint32_t>(paths[f].size());
+        files[f].chordCount = chordCounts[f];
+        pathPool.insert(pathPool.end(), paths[f].begin(), paths[f].end());
+    }
+    
+    ChordIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = CHORD_INDEX_VERSION;
+    header.gramLength = gramLength;
+    header.termCount = terms.size();
+    header.fileCount = files.size();
+    
+    size_t termsOffset = sizeof(ChordIndexHeader);
+    size_t filesOffset = termsOffset + terms.size() * sizeof(ChordIndexTerm);
+    header.pathPoolOffset = filesOffset + files.size() * sizeof(ChordIndexFile);
+    header.pathPoolSize = pathPool.size();
+    header.postingsOffset = alignTo8(header.pathPoolOffset + pathPool.size());
+    header.postingsSize = postingBytes.size();
+    header.fileSize = alignTo8(header.postingsOffset + postingBytes.size());
+    
+    std::vector<uint8_t> image(header.fileSize, 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    if (!terms.empty()) {
+        std::memcpy(image.data() + termsOffset, terms.data(), terms.size() * sizeof(ChordIndexTerm));
+    }
+    if (!files.empty()) {
+        std::memcpy(image.data() + filesOffset, files.data(), files.size() * sizeof(ChordIndexFile));
+    }
+    if (!pathPool.empty()) {
+        std::memcpy(image.data() + header.pathPoolOffset, pathPool.data(), pathPool.size());
+    }
+    if (!postingBytes.empty()) {
+        std::memcpy(image.data() + header.postingsOffset, postingBytes.data(), postingBytes.size());
+    }
+    
+    // Replaced atomically, as searches in other processes may have the old
+    // index mapped
+    if (!utils::writeFileAtomically(indexFilename, image.data(), image.size())) {
+        std::cerr << "Error: Could not write chord index " << indexFilename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint32_t ChordIndexBuilder::getGramLength() const {
+    return gramLength;
+}
+
+size_t ChordIndexBuilder::getFileCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return paths.size();
+}
+
+// ChordIndex
+
+ChordIndex::ChordIndex()
+    : data(nullptr),
+      size(0),
+      mapping(nullptr),
+      header(nullptr),
+      terms(nullptr),
+      files(nullptr),
+      pathPool(nullptr),
+      postings(nullptr) {
+}
+
+ChordIndex::~ChordIndex() {
+#ifndef _WIN32
+    if (mapping) {
+        munmap(mapping, size);
+    }
+#endif
+}
+
+bool ChordIndex::open(const std::string& indexFilename) {
+    if (data) {
+        std::cerr << "Error: Chord index is already open" << std::endl;
+        return false;
+    }
+
+#ifndef _WIN32
+    int descriptor = ::open(indexFilename.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        std::cerr << "Error: Could not open chord index " << indexFilename << std::endl;
+        return false;
+    }
+    
+    struct stat status;
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+        void* mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+        if (mapped != MAP_FAILED) {
+            mapping = mapped;
+            data = static_cast<const uint8_t*>(mapped);
+            size = static_cast<size_t>(status.st_size);
+        }
+    }
+    ::close(descriptor);
+#endif
+    
+    // Read the whole index where mapping is unavailable
+    if (!mapping) {
+        std::ifstream file(indexFilename, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open chord index " << indexFilename << std::endl;
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+    }
+    
+    if (!validate(indexFilename)) {
+#ifndef _WIN32
+        if (mapping) {
+            munmap(mapping, size);
+        }
+#endif
+        mapping = nullptr;
+        buffer.clear();
+        data = nullptr;
+        size = 0;
+        return false;
+    }
+    return true;
+}
+
+bool ChordIndex::validate(const std::string& name) {
+    if (size < sizeof(ChordIndexHeader)) {
+        std::cerr << "Error: " << name << " is too small to be a chord index" << std::endl;
+        return false;
+    }
+    
+    const ChordIndexHeader* candidate = reinterpret_cast<const ChordIndexHeader*>(data);
+    if (std::memcmp(candidate->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        std::cerr << "Error: " << name << " is not a chord index" << std::endl;
+        return false;
+    }
+    
+    // Also rejects indexes written with the other byte order
+    if (candidate->version != CHORD_INDEX_VERSION) {
+        std::cerr << "Error: Unsupported chord index version " << candidate->version
+                  << " in " << name << std::endl;
+        return false;
+    }
+    
+    uint64_t filesOffset = sizeof(ChordIndexHeader) + candidate->termCount * sizeof(ChordIndexTerm);
+    if (candidate->fileSize != size || candidate->gramLength < 2 ||
+        candidate->gramLength > CHORD_INDEX_MAX_GRAM_LENGTH ||
+        candidate->termCount > size / sizeof(ChordIndexTerm) ||
+        candidate->fileCount > size / sizeof(ChordIndexFile) ||
+        candidate->pathPoolOffset != filesOffset + candidate->fileCount * sizeof(ChordIndexFile) ||
+        !rangeFits(candidate->pathPoolOffset, candidate->pathPoolSize, size) ||
+        candidate->postingsOffset % 8 != 0 ||
+        !rangeFits(candidate->postingsOffset, candidate->postingsSize, size)) {
+        std::cerr << "Error: Chord index " << name << " is truncated" << std::endl;
+        return false;
+    }
+    
+    const ChordIndexTerm* termTable = reinterpret_cast<const ChordIndexTerm*>(data + sizeof(ChordIndexHeader));
+    const ChordIndexFile* fileTable = reinterpret_cast<const ChordIndexFile*>(data + filesOffset);
+    
+    // Every reference must stay inside its pool, so queries need no checks
+    for (uint64_t t = 0; t < candidate->termCount; t++) {
+        if (!rangeFits(termTable[t].postingsOffset, termTable[t].postingsSize, candidate->postingsSize) ||
+            (t > 0 && termTable[t - 1].gram >= termTable[t].gram)) {
+            std::cerr << "Error: Chord index " << name << " has an invalid term table" << std::endl;
+            return false;
+        }
+    }
+    for (uint64_t f = 0; f < candidate->fileCount; f++) {
+        if (!rangeFits(fileTable[f].pathOffset, fileTable[f].pathLength, candidate->pathPoolSize)) {
+            std::cerr << "Error: Chord index " << name << " has an invalid file table" << std::endl;
+            return false;
+        }
+    }
+    
+    header = candidate;
+    terms = termTable;
+    files = fileTable;
+    pathPool = reinterpret_cast<const char*>(data + candidate->pathPoolOffset);
+    postings = data + candidate->postingsOffset;
+    return true;
+}
+
+bool ChordIndex::isOpen() const {
+    return data != nullptr;
+}
+
+bool ChordIndex::isMapped() const {
+    return mapping != nullptr;
+}
+
+uint32_t ChordIndex::getGramLength() const {
+    return header ? header->gramLength : 0;
+}
+
+size_t ChordIndex::getFileCount() const {
+    return header ? static_cast<size_t>(header->fileCount) : 0;
+}
+
+size_t ChordIndex::getTermCount() const {
+    return header ? static_cast<size_t>(header->termCount) : 0;
+}
+
+std::string ChordIndex::getFilePath(uint32_t fileId) const {
+    if (fileId >= getFileCount()) {
+        return "";
+    }
+    return std::string(pathPool + files[fileId].pathOffset, files[fileId].pathLength);
+}
+
+uint32_t ChordIndex::getChordCount(uint32_t fileId) const {
+    return fileId < getFileCount() ? files[fileId].chordCount : 0;
+}
+
+const ChordIndexTerm* ChordIndex::findTerm(uint64_t gram) const {
+    const ChordIndexTerm* end = terms + header->termCount;
+    const ChordIndexTerm* term = std::lower_bound(terms, end, gram,
+        [](const ChordIndexTerm& entry, uint64_t value) { return entry.gram < value; });
+    return term != end && term->gram == gram ? term : nullptr;
+}
+
+void ChordIndex::decodePostings(const ChordIndexTerm& term, uint32_t shift, std::vector<ChordIndexHit>& hits) const {
+    hits.clear();
+    hits.reserve(term.postingCount);
+    
+    const uint8_t* position = postings + term.postingsOffset;
+    const uint8_t* end = position + term.postingsSize;
+    uint64_t fileId = 0;
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < term.postingCount; i++) {
+        uint64_t fileDelta;
+        uint64_t offsetDelta;
+        if (!readVarint(position, end, fileDelta) || !readVarint(position, end, offsetDelta)) {
+            break;
+        }
+        if (fileDelta > 0) {
+            offset = 0;
+        }
+        fileId += fileDelta;
+        offset += offsetDelta;
+        if (offset >= shift) {
+            hits.push_back(ChordIndexHit(static_cast<uint32_t>(fileId), static_cast<uint32_t>(offset - shift)));
+        }
+    }
+}
+
+bool ChordIndex::search(const std::vector<std::string>& chordNames, std::vector<ChordIndexHit>& hits) const {
+    hits.clear();
+    if (!header) {
+        std::cerr << "Error: No chord index is open" << std::endl;
+        return false;
+    }
+    
+    uint32_t gramLength = header->gramLength;
+    if (chordNames.size() < gramLength) {
+        std::cerr << "Error: Chord index searches need at least " << gramLength << " chords" << std::endl;
+        return false;
+    }
+    
+    std::vector<GramChord> chords;
+    for (const auto& name : chordNames) {
+        chords.push_back(gramChord(name));
+        if (!chords.back().parsed) {
+            std::cerr << "Error: " << name << " is not a plain chord symbol" << std::endl;
+            return false;
+        }
+    }
+    
+    // Each gram of the query, with its distance from the first chord. The
+    // grams overlap, so together they also pin the roots to one transposition.
+    std::vector<std::pair<const ChordIndexTerm*, uint32_t>> queryTerms;
+    for (size_t first = 0; first + gramLength <= chords.size(); first++) {
+        uint64_t gram;
+        packGram(chords, first, gramLength, gram);
+        const ChordIndexTerm* term = findTerm(gram);
+        if (!term) {
+            return true;
+        }
+        queryTerms.push_back({term, static_cast<uint32_t>(first)});
+    }
+    
+    // Intersect from the rarest gram up, so candidates only shrink
+    std::sort(queryTerms.begin(), queryTerms.end(),
+              [](const std::pair<const ChordIndexTerm*, uint32_t>& a,
+                 const std::pair<const ChordIndexTerm*, uint32_t>& b) {
+                  return a.first->postingCount < b.first->postingCount;
+              });
+    
+    decodePostings(*queryTerms[0].first, queryTerms[0].second, hits);
+    std::vector<ChordIndexHit> termHits;
+    std::vector<ChordIndexHit> matched;
+    for (size_t q = 1; q < queryTerms.size() && !hits.empty(); q++) {
+        decodePostings(*queryTerms[q].first, queryTerms[q].second, termHits);
+        matched.clear();
+        std::set_intersection(hits.begin(), hits.end(), termHits.begin(), termHits.end(),
+                              std::back_inserter(matched));
+        hits.swap(matched);
+    }
+    return true;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
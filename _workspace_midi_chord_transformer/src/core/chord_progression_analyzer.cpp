@@ -1,4 +1,5 @@
 #include "../../include/core/chord_progression_analyzer.h"
+#include "../../include/core/rule_database.h"
 #include "../../include/utils/midi_utils.h"
 
 #include <algorithm>
@@ -7,11 +8,38 @@
 
 namespace midi_transformer {
 
-ChordProgressionAnalyzer::ChordProgressionAnalyzer() {
-    loadPatterns();
+ChordProgressionAnalyzer::ChordProgressionAnalyzer()
+    : ChordProgressionAnalyzer(RuleDatabase::shared()) {
 }
 
-void ChordProgressionAnalyzer::loadPatterns() {
+ChordProgressionAnalyzer::ChordProgressionAnalyzer(std::shared_ptr<const RuleDatabase> database)
+    : database(std::move(database)) {
+}
+
+std::unique_ptr<PatternSet> ChordProgressionAnalyzer::buildPatternSet(
+    const std::shared_ptr<const RuleDatabase>& database) {
+    
+    auto set = std::make_unique<PatternSet>();
+    if (database) {
+        auto patterns = database->progressionPatterns();
+        set->patterns.assign(patterns.begin(), patterns.end());
+    } else {
+        loadPatterns(*set);
+    }
+    set->customBegin = set->patterns.size();
+    return set;
+}
+
+const PatternSet& ChordProgressionAnalyzer::currentPatterns() const {
+    const PatternSet* set = patternSet.read();
+    if (!set) {
+        // First use; if another thread publishes first, its set is kept
+        set = patternSet.initialize(buildPatternSet(database));
+    }
+    return *set;
+}
+
+void ChordProgressionAnalyzer::loadPatterns(PatternSet& set) {
     // Load common chord progression patterns
     
     // ii-V-I (Jazz)
@@ -19,178 +47,346 @@ void ChordProgressionAnalyzer::loadPatterns() {
     iiVI->chordQualities = {"m7", "7", "maj7"};
     iiVI->name = "ii-V-I";
     iiVI->commonKeys = {"C", "F", "Bb", "Eb", "G", "D", "A"};
-    knownPatterns.push_back(iiVI);
+    set.patterns.push_back(iiVI);
     
     // I-IV-V (Pop/Rock)
     auto IIV = std::make_shared<ProgressionPattern>();
     IIV->chordQualities = {"", "", ""};
     IIV->name = "I-IV-V";
     IIV->commonKeys = {"C", "G", "D", "A", "E", "F"};
-    knownPatterns.push_back(IIV);
+    set.patterns.push_back(IIV);
     
     // I-V-vi-IV (Pop)
     auto IVviIV = std::make_shared<ProgressionPattern>();
     IVviIV->chordQualities = {"", "", "m", ""};
     IVviIV->name = "I-V-vi-IV";
     IVviIV->commonKeys = {"C", "G", "D", "A", "F"};
-    knownPatterns.push_back(IVviIV);
+    set.patterns.push_back(IVviIV);
     
     // I-vi-IV-V (50s Progression)
     auto IviIVV = std::make_shared<ProgressionPattern>();
     IviIVV->chordQualities = {"", "m", "", ""};
     IviIVV->name = "I-vi-IV-V (50s)";
     IviIVV->commonKeys = {"C", "G", "D", "A", "F"};
-    knownPatterns.push_back(IviIVV);
+    set.patterns.push_back(IviIVV);
     
     // vi-IV-I-V (Pop)
     auto viIIV = std::make_shared<ProgressionPattern>();
     viIIV->chordQualities = {"m", "", "", ""};
     viIIV->name = "vi-IV-I-V";
     viIIV->commonKeys = {"C", "G", "D", "A", "F"};
-    knownPatterns.push_back(viIIV);
+    set.patterns.push_back(viIIV);
     
     // I-V-vi-iii-IV-I-IV-V (Canon)
     auto canon = std::make_shared<ProgressionPattern>();
     canon->chordQualities = {"", "", "m", "m", "", "", "", ""};
     canon->name = "Canon Progression";
     canon->commonKeys = {"D", "G", "C"};
-    knownPatterns.push_back(canon);
+    set.patterns.push_back(canon);
     
     // i-bVII-bVI-V (Andalusian Cadence)
     auto andalusian = std::make_shared<ProgressionPattern>();
     andalusian->chordQualities = {"m", "", "", ""};
     andalusian->name = "Andalusian Cadence";
     andalusian->commonKeys = {"Am", "Em", "Dm"};
-    knownPatterns.push_back(andalusian);
+    set.patterns.push_back(andalusian);
     
     // I-bVII-IV (Mixolydian Vamp)
     auto mixolydian = std::make_shared<ProgressionPattern>();
     mixolydian->chordQualities = {"", "", ""};
     mixolydian->name = "Mixolydian Vamp";
     mixolydian->commonKeys = {"G", "D", "A", "E"};
-    knownPatterns.push_back(mixolydian);
+    set.patterns.push_back(mixolydian);
     
     // i-iv-v (Minor Blues)
     auto minorBlues = std::make_shared<ProgressionPattern>();
     minorBlues->chordQualities = {"m", "m", "m"};
     minorBlues->name = "Minor Blues";
     minorBlues->commonKeys = {"Am", "Em", "Dm", "Gm"};
-    knownPatterns.push_back(minorBlues);
+    set.patterns.push_back(minorBlues);
     
     // I-I7-IV-iv (Major-Minor Change)
     auto majorMinor = std::make_shared<ProgressionPattern>();
     majorMinor->chordQualities = {"", "7", "", "m"};
     majorMinor->name = "Major-Minor Change";
     majorMinor->commonKeys = {"C", "G", "D", "F"};
-    knownPatterns.push_back(majorMinor);
+    set.patterns.push_back(majorMinor);
 }
 
-std::vector<std::shared_ptr<ChordProgression>> ChordProgressionAnalyzer::detectProgressions(
-    const std::vector<std::shared_ptr<Chord>>& chords) {
+bool ChordProgressionAnalyzer::matchWindow(
+    const ProgressionPattern& pattern,
+    const std::vector<ChordParts>& parts,
+    size_t startIndex,
+    double& confidence) {
     
-    std::vector<std::shared_ptr<ChordProgression>> results;
+    double matchScore = 0.0;
     
-    if (chords.size() < 2) {
-        return results; // Need at least 2 chords for a progression
+    // Check if the qualities match
+    for (size_t i = 0; i < pattern.chordQualities.size(); i++) {
+        size_t chordIdx = startIndex + i;
+        
+        // Extract just the basic quality (ignoring extensions)
+        const std::string& chordQuality = parts[chordIdx].second;
+        const std::string& patternQuality = pattern.chordQualities[i];
+        
+        // Basic quality match (e.g., "m7" matches "m")
+        if (chordQuality.find(patternQuality) == 0 || 
+            (patternQuality.empty() && (chordQuality.empty() || chordQuality == "maj7" || chordQuality == "6" || chordQuality == "9"))) {
+            matchScore += 1.0;
+        } 
+        // Partial match (e.g., "m" is similar to "m7")
+        else if (!patternQuality.empty() && !chordQuality.empty() && 
+                 chordQuality[0] == patternQuality[0]) {
+            matchScore += 0.5;
+        } else {
+            return false;
+        }
+    }
+    
+    // Calculate confidence based on match score
+    confidence = matchScore / pattern.chordQualities.size();
+    
+    // Check if the root notes form a sensible key
+    // This is a simplified approach - a real implementation would be more sophisticated
+    const std::string& possibleKey = parts[startIndex].first;
+    
+    // Adjust confidence based on whether this key is common for this progression
+    bool keyMatch = false;
+    for (const auto& key : pattern.commonKeys) {
+        if (key == possibleKey || key == possibleKey + "m") {
+            keyMatch = true;
+            break;
+        }
     }
     
+    if (keyMatch) {
+        confidence *= 1.2; // Boost confidence for common keys
+    } else {
+        confidence *= 0.8; // Reduce confidence for uncommon keys
+    }
+    
+    // Only confident matches are results
+    return confidence >= 0.6;
+}
+
+std::shared_ptr<ChordProgression> ChordProgressionAnalyzer::makeProgression(
+    const ProgressionPattern& pattern,
+    const std::vector<ChordParts>& parts,
+    const ProgressionMatch& match) {
+    
+    auto progression = std::make_shared<ChordProgression>();
+    progression->progressionName = pattern.name + " in " + parts[match.startIndex].first;
+    progression->confidence = match.confidence;
+    
+    // Add chord indices
+    for (size_t i = 0; i < match.length; i++) {
+        progression->chordIndices.push_back(static_cast<int>(match.startIndex + i));
+    }
+    
+    return progression;
+}
+
+bool ChordProgressionAnalyzer::resultBefore(const ProgressionMatch& a, const ProgressionMatch& b) {
+    if (a.confidence != b.confidence) {
+        return a.confidence > b.confidence;
+    }
+    if (a.startIndex != b.startIndex) {
+        return a.startIndex < b.startIndex;
+    }
+    return a.patternIndex < b.patternIndex;
+}
+
+std::vector<std::shared_ptr<ChordProgression>> ChordProgressionAnalyzer::detectProgressions(
+    const std::vector<std::shared_ptr<Chord>>& chords) const {
+    
+    ProgressionMatchState state;
+    return detectProgressions(chords, state);
+}
+
+std::vector<std::shared_ptr<ChordProgression>> ChordProgressionAnalyzer::detectProgressions(
+    const std::vector<std::shared_ptr<Chord>>& chords,
+    ProgressionMatchState& state) const {
+    
+    std::vector<std::shared_ptr<ChordProgression>> results;
+    std::vector<ChordParts>& chordParts = state.chordParts;
+    std::vector<ProgressionMatch>& matches = state.matches;
+    
     // Extract chord qualities and roots
-    std::vector<std::pair<std::string, std::string>> chordParts;
+    chordParts.clear();
     for (const auto& chord : chords) {
         chordParts.push_back(utils::parseChordName(chord->name));
     }
     
+    RcuReadGuard guard;
+    const auto& patterns = currentPatterns().patterns;
+    state.matchedPatterns = patterns;
+    matches.clear();
+    state.valid = true;
+    
+    if (chords.size() < 2) {
+        return results; // Need at least 2 chords for a progression
+    }
+    
     // Try to detect each known pattern
-    for (const auto& pattern : knownPatterns) {
+    for (size_t p = 0; p < patterns.size(); p++) {
+        const size_t length = patterns[p]->chordQualities.size();
+        
         // Skip if the pattern is longer than the chord sequence
-        if (pattern->chordQualities.size() > chords.size()) {
+        if (length == 0 || length > chords.size()) {
             continue;
         }
         
-        // Slide a window of pattern->chordQualities.size() through the chord sequence
-        for (size_t startIdx = 0; startIdx <= chords.size() - pattern->chordQualities.size(); startIdx++) {
-            double matchScore = 0.0;
-            bool potentialMatch = true;
-            
-            // Check if the qualities match
-            for (size_t i = 0; i < pattern->chordQualities.size(); i++) {
-                size_t chordIdx = startIdx + i;
-                
-                // Extract just the basic quality (ignoring extensions)
-                std::string chordQuality = chordParts[chordIdx].second;
-                std::string patternQuality = pattern->chordQualities[i];
-                
-                // Basic quality match (e.g., "m7" matches "m")
-                if (chordQuality.find(patternQuality) == 0 || 
-                    (patternQuality.empty() && (chordQuality.empty() || chordQuality == "maj7" || chordQuality == "6" || chordQuality == "9"))) {
-                    matchScore += 1.0;
-                } 
-                // Partial match (e.g., "m" is similar to "m7")
-                else if (!patternQuality.empty() && !chordQuality.empty() && 
-                         chordQuality[0] == patternQuality[0]) {
-                    matchScore += 0.5;
-                } else {
-                    potentialMatch = false;
-                    break;
-                }
+        // Slide a window of the pattern's length through the chord sequence
+        for (size_t startIdx = 0; startIdx <= chords.size() - length; startIdx++) {
+            double confidence = 0.0;
+            if (matchWindow(*patterns[p], chordParts, startIdx, confidence)) {
+                matches.emplace_back(p, startIdx, length, confidence);
             }
+        }
+    }
+    
+    // Sort results by confidence (highest first)
+    std::sort(matches.begin(), matches.end(), resultBefore);
+    
+    results.reserve(matches.size());
+    for (const auto& match : matches) {
+        results.push_back(makeProgression(*patterns[match.patternIndex], chordParts, match));
+    }
+    
+    return results;
+}
+
+void ChordProgressionAnalyzer::updateProgressions(
+    const std::vector<std::shared_ptr<Chord>>& chords,
+    const std::vector<int>& changedIndices,
+    ProgressionMatchState& state,
+    std::vector<std::shared_ptr<ChordProgression>>& results) const {
+    
+    RcuReadGuard guard;
+    const auto& patterns = currentPatterns().patterns;
+    std::vector<ChordParts>& chordParts = state.chordParts;
+    std::vector<ProgressionMatch>& matches = state.matches;
+    
+    if (!state.valid || chords.size() != chordParts.size() ||
+        results.size() != matches.size() || patterns != state.matchedPatterns) {
+        results = detectProgressions(chords, state);
+        return;
+    }
+    
+    // Changed chords in order, each once
+    std::vector<size_t> changed;
+    changed.reserve(changedIndices.size());
+    for (int index : changedIndices) {
+        if (index >= 0 && static_cast<size_t>(index) < chords.size()) {
+            changed.push_back(static_cast<size_t>(index));
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    
+    if (changed.empty()) {
+        return;
+    }
+    
+    for (size_t index : changed) {
+        chordParts[index] = utils::parseChordName(chords[index]->name);
+    }
+    
+    // Drop every match whose window contains a changed chord
+    size_t kept = 0;
+    for (size_t i = 0; i < matches.size(); i++) {
+        const ProgressionMatch& match = matches[i];
+        auto it = std::lower_bound(changed.begin(), changed.end(), match.startIndex);
+        if (it != changed.end() && *it < match.startIndex + match.length) {
+            continue;
+        }
+        if (kept != i) {
+            matches[kept] = match;
+            results[kept] = std::move(results[i]);
+        }
+        kept++;
+    }
+    matches.resize(kept);
+    results.resize(kept);
+    
+    // Re-scan the windows over changed chords, each window once per pattern
+    std::vector<ProgressionMatch> added;
+    const size_t chordCount = chords.size();
+    for (size_t p = 0; p < patterns.size(); p++) {
+        const size_t length = patterns[p]->chordQualities.size();
+        if (length == 0 || length > chordCount || chordCount < 2) {
+            continue;
+        }
+        
+        size_t nextStart = 0;
+        for (size_t index : changed) {
+            size_t first = std::max(nextStart, index + 1 >= length ? index + 1 - length : 0);
+            size_t last = std::min(index, chordCount - length);
             
-            if (potentialMatch) {
-                // Calculate confidence based on match score
-                double confidence = matchScore / pattern->chordQualities.size();
-                
-                // Check if the root notes form a sensible key
-                // This is a simplified approach - a real implementation would be more sophisticated
-                std::string possibleKey = chordParts[startIdx].first;
-                
-                // Adjust confidence based on whether this key is common for this progression
-                bool keyMatch = false;
-                for (const auto& key : pattern->commonKeys) {
-                    if (key == possibleKey || key == possibleKey + "m") {
-                        keyMatch = true;
-                        break;
-                    }
-                }
-                
-                if (keyMatch) {
-                    confidence *= 1.2; // Boost confidence for common keys
-                } else {
-                    confidence *= 0.8; // Reduce confidence for uncommon keys
-                }
-                
-                // If confidence is high enough, add to results
-                if (confidence >= 0.6) {
-                    auto progression = std::make_shared<ChordProgression>();
-                    progression->progressionName = pattern->name + " in " + possibleKey;
-                    progression->confidence = confidence;
-                    
-                    // Add chord indices
-                    for (size_t i = 0; i < pattern->chordQualities.size(); i++) {
-                        progression->chordIndices.push_back(startIdx + i);
-                    }
-                    
-                    results.push_back(progression);
+            for (size_t startIdx = first; startIdx <= last; startIdx++) {
+                double confidence = 0.0;
+                if (matchWindow(*patterns[p], chordParts, startIdx, confidence)) {
+                    added.emplace_back(p, startIdx, length, confidence);
                 }
             }
+            nextStart = std::max(nextStart, last + 1);
         }
     }
     
-    // Sort results by confidence (highest first)
-    std::sort(results.begin(), results.end(), 
-              [](const std::shared_ptr<ChordProgression>& a, const std::shared_ptr<ChordProgression>& b) {
-                  return a->confidence > b->confidence;
-              });
+    if (added.empty()) {
+        return;
+    }
     
-    return results;
+    // Merge the new matches in from the back, so each kept result moves once
+    std::sort(added.begin(), added.end(), resultBefore);
+    matches.resize(kept + added.size());
+    results.resize(kept + added.size());
+    
+    size_t from = kept;
+    size_t next = added.size();
+    for (size_t to = matches.size(); next > 0; to--) {
+        if (from > 0 && resultBefore(added[next - 1], matches[from - 1])) {
+            matches[to - 1] = matches[from - 1];
+            results[to - 1] = std::move(results[from - 1]);
+            from--;
+        } else {
+            const ProgressionMatch& match = added[--next];
+            matches[to - 1] = match;
+            results[to - 1] = makeProgression(*patterns[match.patternIndex], chordParts, match);
+        }
+    }
 }
 
 void ChordProgressionAnalyzer::addPattern(const ProgressionPattern& pattern) {
-    auto newPattern = std::make_shared<ProgressionPattern>(pattern);
-    knownPatterns.push_back(newPattern);
+    {
+        // Make sure the first set exists, so the copy starts from it
+        RcuReadGuard guard;
+        currentPatterns();
+    }
+    
+    auto newPattern = std::make_shared<const ProgressionPattern>(pattern);
+    patternSet.update([&](PatternSet& set) {
+        set.patterns.push_back(newPattern);
+    });
+}
+
+void ChordProgressionAnalyzer::reloadPatterns(std::shared_ptr<const RuleDatabase> database) {
+    {
+        RcuReadGuard guard;
+        currentPatterns();
+    }
+    
+    // Built under the writer lock, so a pattern added meanwhile is not lost
+    patternSet.update([&](PatternSet& set) {
+        auto next = buildPatternSet(database);
+        next->patterns.insert(next->patterns.end(), set.patterns.begin() + set.customBegin, set.patterns.end());
+        set = std::move(*next);
+    });
 }
 
-std::vector<std::shared_ptr<ProgressionPattern>> ChordProgressionAnalyzer::getKnownPatterns() const {
-    return knownPatterns;
+std::vector<std::shared_ptr<const ProgressionPattern>> ChordProgressionAnalyzer::getKnownPatterns() const {
+    RcuReadGuard guard;
+    return currentPatterns().patterns;
 }
 
 } // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "../../include/core/chord_quality.h"
+
+#include <initializer_list>
+
+namespace midi_transformer {
+
+namespace {
+
+const char* const QUALITY_SUFFIXES[CHORD_QUALITY_COUNT] = {
+    "", "m", "7", "maj7", "m7", "dim7", "m7b5", "9", "maj9", "m9", "13",
+    "6", "m6", "sus4", "sus2", "7sus4", "aug", "dim", "add9", "madd9"
+};
+
+// Bit i set for an interval of i semitones (mod 12)
+constexpr uint16_t intervalMask(std::initializer_list<int> intervals) {
+    uint16_t mask = 0;
+    for (int interval : intervals) {
+        mask |= static_cast<uint16_t>(1u << (interval % 12));
+    }
+    return mask;
+}
+
+const uint16_t QUALITY_INTERVALS[CHORD_QUALITY_COUNT] = {
+    intervalMask({0, 4, 7}),             // major
+    intervalMask({0, 3, 7}),             // m
+    intervalMask({0, 4, 7, 10}),         // 7
+    intervalMask({0, 4, 7, 11}),         // maj7
+    intervalMask({0, 3, 7, 10}),         // m7
+    intervalMask({0, 3, 6, 9}),          // dim7
+    intervalMask({0, 3, 6, 10}),         // m7b5
+    intervalMask({0, 4, 7, 10, 14}),     // 9
+    intervalMask({0, 4, 7, 11, 14}),     // maj9
+    intervalMask({0, 3, 7, 10, 14}),     // m9
+    intervalMask({0, 4, 7, 10, 14, 21}), // 13
+    intervalMask({0, 4, 7, 9}),          // 6
+    intervalMask({0, 3, 7, 9}),          // m6
+    intervalMask({0, 5, 7}),             // sus4
+    intervalMask({0, 2, 7}),             // sus2
+    intervalMask({0, 5, 7, 10}),         // 7sus4
+    intervalMask({0, 4, 8}),             // aug
+    intervalMask({0, 3, 6}),             // dim
+    intervalMask({0, 4, 7, 14}),         // add9
+    intervalMask({0, 3, 7, 14})          // madd9
+};
+
+const char* const ROOT_NAMES[12] = {
+    "C", "Db", "D", "Eb", "E", "F", "Gb", "G", "Ab", "A", "Bb", "B"
+};
+
+} // namespace
+
+const char* chordQualitySuffix(ChordQuality quality) {
+    size_t index = static_cast<size_t>(quality);
+    return index < CHORD_QUALITY_COUNT ? QUALITY_SUFFIXES[index] : "";
+}
+
+uint16_t chordQualityIntervals(ChordQuality quality) {
+    size_t index = static_cast<size_t>(quality);
+    return index < CHORD_QUALITY_COUNT ? QUALITY_INTERVALS[index] : 0;
+}
+
+bool chordQualityFromSuffix(const std::string& suffix, ChordQuality& quality) {
+    // Alternative spelling of the half-diminished seventh
+    if (suffix == "ø") {
+        quality = ChordQuality::HALF_DIMINISHED_7;
+        return true;
+    }
+    
+    for (size_t i = 0; i < CHORD_QUALITY_COUNT; i++) {
+        if (suffix == QUALITY_SUFFIXES[i]) {
+            quality = static_cast<ChordQuality>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseChordSymbol(const std::string& chordName, int& rootPitchClass, ChordQuality& quality) {
+    static const int LETTER_PITCH_CLASSES[7] = {9, 11, 0, 2, 4, 5, 7}; // A to G
+    
+    if (chordName.empty() || chordName[0] < 'A' || chordName[0] > 'G') {
+        return false;
+    }
+    if (chordName.find('/') != std::string::npos) {
+        return false;
+    }
+    
+    int root = LETTER_PITCH_CLASSES[chordName[0] - 'A'];
+    size_t pos = 1;
+    if (pos < chordName.size() && chordName[pos] == '#') {
+        root++;
+        pos++;
+    } else if (pos < chordName.size() && chordName[pos] == 'b') {
+        root--;
+        pos++;
+    }
+    
+    if (!chordQualityFromSuffix(chordName.substr(pos), quality)) {
+        return false;
+    }
+    rootPitchClass = (root + 12) % 12;
+    return true;
+}
+
+std::string chordSymbol(int rootPitchClass, ChordQuality quality) {
+    return std::string(ROOT_NAMES[((rootPitchClass % 12) + 12) % 12]) + chordQualitySuffix(quality);
+}
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -1,100 +1,190 @@
 #include "../../include/core/chord_substitution.h"
+#include "../../include/core/rule_database.h"
+#include "../../include/core/voice_assignment.h"
 #include "../../include/utils/midi_utils.h"
 
 #include <algorithm>
+#include <cmath>
+#include <thread>
 #include <unordered_map>
 #include <iostream>
 
 namespace midi_transformer {
 
-ChordSubstitutionEngine::ChordSubstitutionEngine() {
-    initializeSubstitutionDatabase();
+ChordSubstitutionEngine::ChordSubstitutionEngine()
+    : ChordSubstitutionEngine(RuleDatabase::shared()) {
 }
 
-void ChordSubstitutionEngine::initializeSubstitutionDatabase() {
-    // Initialize common chord substitutions
+ChordSubstitutionEngine::ChordSubstitutionEngine(std::shared_ptr<const RuleDatabase> database) {
+    ruleSet.initialize(buildRuleSet(std::move(database), {}));
+}
+
+std::unique_ptr<SubstitutionRuleSet> ChordSubstitutionEngine::buildRuleSet(
+    std::shared_ptr<const RuleDatabase> database,
+    const std::vector<ChordSubstitution>& customSubstitutions) {
+    
+    auto set = std::make_unique<SubstitutionRuleSet>();
+    set->database = std::move(database);
+    
+    if (set->database) {
+        // Custom rules share the database's relationship ids
+        for (size_t id = 0; id < set->database->relationshipCount(); id++) {
+            set->relationshipNames.push_back(set->database->relationship(static_cast<uint8_t>(id)));
+        }
+    } else {
+        initializeSubstitutionDatabase(*set);
+    }
+    
+    for (const auto& substitution : customSubstitutions) {
+        set->add(substitution);
+    }
+    set->customSubstitutions = customSubstitutions;
+    
+    return set;
+}
+
+void ChordSubstitutionEngine::initializeSubstitutionDatabase(SubstitutionRuleSet& set) {
+    // Initialize common chord substitutions. Each entry is stored as a rule
+    // relative to its root, so one example per rule covers every key.
     
     // Tritone substitutions
-    addCustomSubstitution({"G7", "Db7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"C7", "Gb7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"F7", "B7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"Bb7", "E7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"Eb7", "A7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"Ab7", "D7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"Db7", "G7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"Gb7", "C7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"B7", "F7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"E7", "Bb7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"A7", "Eb7", "tritone sub", 0.3f, 8});
-    addCustomSubstitution({"D7", "Ab7", "tritone sub", 0.3f, 8});
+    set.add({"G7", "Db7", "tritone sub", 0.3f, 8});
     
     // Relative major/minor
-    addCustomSubstitution({"C", "Am", "relative minor", -0.2f, 9});
-    addCustomSubstitution({"Am", "C", "relative major", 0.2f, 9});
-    addCustomSubstitution({"G", "Em", "relative minor", -0.2f, 9});
-    addCustomSubstitution({"Em", "G", "relative major", 0.2f, 9});
-    addCustomSubstitution({"F", "Dm", "relative minor", -0.2f, 9});
-    addCustomSubstitution({"Dm", "F", "relative major", 0.2f, 9});
+    set.add({"C", "Am", "relative minor", -0.2f, 9});
+    set.add({"Am", "C", "relative major", 0.2f, 9});
     
     // Diatonic substitutions
-    addCustomSubstitution({"Cmaj7", "Em7", "diatonic sub", -0.1f, 7});
-    addCustomSubstitution({"Cmaj7", "Am7", "diatonic sub", -0.1f, 7});
-    addCustomSubstitution({"G7", "Bm7b5", "diatonic sub", 0.1f, 6});
-    addCustomSubstitution({"Dm7", "Fmaj7", "diatonic sub", 0.1f, 7});
+    set.add({"Cmaj7", "Em7", "diatonic sub", -0.1f, 7});
+    set.add({"Cmaj7", "Am7", "diatonic sub", -0.1f, 7});
+    set.add({"G7", "Bm7b5", "diatonic sub", 0.1f, 6});
+    set.add({"Dm7", "Fmaj7", "diatonic sub", 0.1f, 7});
     
     // Modal interchange
-    addCustomSubstitution({"C", "Cm", "modal interchange", -0.2f, 8});
-    addCustomSubstitution({"Cm", "C", "modal interchange", 0.2f, 8});
-    addCustomSubstitution({"F", "Fm", "modal interchange", -0.2f, 8});
-    addCustomSubstitution({"Fm", "F", "modal interchange", 0.2f, 8});
+    set.add({"C", "Cm", "modal interchange", -0.2f, 8});
+    set.add({"Cm", "C", "modal interchange", 0.2f, 8});
     
     // Secondary dominants
-    addCustomSubstitution({"Dm7", "A7", "secondary dominant", 0.4f, 5});
-    addCustomSubstitution({"G7", "D7", "secondary dominant", 0.4f, 5});
-    addCustomSubstitution({"Em7", "B7", "secondary dominant", 0.4f, 5});
+    set.add({"Dm7", "A7", "secondary dominant", 0.4f, 5});
+    set.add({"G7", "D7", "secondary dominant", 0.4f, 5});
     
     // Extended substitutions
-    addCustomSubstitution({"C", "C6", "extension", 0.1f, 9});
-    addCustomSubstitution({"C", "Cmaj7", "extension", 0.1f, 9});
-    addCustomSubstitution({"C", "Cmaj9", "extension", 0.2f, 8});
-    addCustomSubstitution({"Cm", "Cm7", "extension", 0.1f, 9});
-    addCustomSubstitution({"Cm", "Cm9", "extension", 0.2f, 8});
-    addCustomSubstitution({"G7", "G9", "extension", 0.1f, 9});
-    addCustomSubstitution({"G7", "G13", "extension", 0.3f, 8});
+    set.add({"C", "C6", "extension", 0.1f, 9});
+    set.add({"C", "Cmaj7", "extension", 0.1f, 9});
+    set.add({"C", "Cmaj9", "extension", 0.2f, 8});
+    set.add({"Cm", "Cm7", "extension", 0.1f, 9});
+    set.add({"Cm", "Cm9", "extension", 0.2f, 8});
+    set.add({"G7", "G9", "extension", 0.1f, 9});
+    set.add({"G7", "G13", "extension", 0.3f, 8});
     
     // Diminished substitutions
-    addCustomSubstitution({"G7", "Bdim7", "diminished sub", 0.2f, 7});
-    addCustomSubstitution({"C7", "Edim7", "diminished sub", 0.2f, 7});
+    set.add({"G7", "Bdim7", "diminished sub", 0.2f, 7});
     
     // Suspended chords
-    addCustomSubstitution({"C", "Csus4", "suspended", 0.0f, 8});
-    addCustomSubstitution({"G", "Gsus4", "suspended", 0.0f, 8});
-    addCustomSubstitution({"G7", "G7sus4", "suspended", 0.0f, 8});
+    set.add({"C", "Csus4", "suspended", 0.0f, 8});
+    set.add({"G7", "G7sus4", "suspended", 0.0f, 8});
+}
+
+uint8_t SubstitutionRuleSet::getRelationshipId(const std::string& relationship) {
+    for (size_t i = 0; i < relationshipNames.size(); i++) {
+        if (relationshipNames[i] == relationship) {
+            return static_cast<uint8_t>(i);
+        }
+    }
+    relationshipNames.push_back(relationship);
+    return static_cast<uint8_t>(relationshipNames.size() - 1);
+}
+
+std::vector<ChordSubstitution> ChordSubstitutionEngine::lookupSubstitutions(
+    const std::string& chordName,
+    const std::function<bool(const std::string&, float, int)>& accept) const {
+    
+    std::vector<ChordSubstitution> results;
+    
+    RcuReadGuard guard;
+    const SubstitutionRuleSet& set = *ruleSet.read();
+    const RuleDatabase* database = set.database.get();
+    
+    int root = 0;
+    ChordQuality quality;
+    if (parseChordSymbol(chordName, root, quality)) {
+        auto applyRule = [&](const SubstitutionRule& rule) {
+            const std::string& relationship = set.relationshipNames[rule.relationshipId];
+            if (accept && !accept(relationship, rule.tensionChange, rule.functionalSimilarity)) {
+                return;
+            }
+            results.push_back({chordName,
+                               chordSymbol(root + rule.rootInterval, rule.targetQuality),
+                               relationship,
+                               rule.tensionChange,
+                               rule.functionalSimilarity});
+        };
+        
+        if (database) {
+            size_t ruleCount = 0;
+            const SubstitutionRule* databaseRules = database->substitutionRules(ruleCount);
+            RuleRange databaseRange = database->qualityRange(quality);
+            for (uint32_t r = databaseRange.begin; r < databaseRange.end; r++) {
+                applyRule(databaseRules[r]);
+            }
+        }
+        
+        const auto& range = set.ruleRanges[static_cast<size_t>(quality)];
+        for (uint32_t r = range.first; r < range.second; r++) {
+            applyRule(set.rules[r]);
+        }
+    }
+    
+    if (database) {
+        size_t literalCount = 0;
+        const RuleLiteralSubstitution* literals = database->literalSubstitutions(literalCount);
+        for (size_t i = 0; i < literalCount; i++) {
+            const RuleLiteralSubstitution& literal = literals[i];
+            if (!database->equals(literal.originalChord, chordName)) {
+                continue;
+            }
+            std::string relationship = database->string(literal.relationship);
+            if (!accept || accept(relationship, literal.tensionChange, literal.functionalSimilarity)) {
+                results.push_back({chordName,
+                                   database->string(literal.substitutionChord),
+                                   relationship,
+                                   literal.tensionChange,
+                                   literal.functionalSimilarity});
+            }
+        }
+    }
+    
+    for (const auto& sub : set.literalSubstitutions) {
+        if (sub.originalChord == chordName &&
+            (!accept || accept(sub.relationship, sub.tensionChange, sub.functionalSimilarity))) {
+            results.push_back(sub);
+        }
+    }
+    
+    return results;
 }
 
 SubstitutionOptions ChordSubstitutionEngine::getSubstitutionOptions(const std::string& chordName) {
     SubstitutionOptions options;
     
     // Find all substitutions for this chord
-    for (const auto& sub : substitutionDatabase) {
-        if (sub.originalChord == chordName) {
-            // Categorize by relationship
-            if (sub.relationship == "tritone sub" || 
-                sub.relationship == "diatonic sub" || 
-                sub.relationship == "relative minor" || 
-                sub.relationship == "relative major" || 
-                sub.relationship == "modal interchange") {
-                options.commonSubs.push_back(sub);
-            } else if (sub.relationship == "secondary dominant" || 
-                       sub.relationship == "diminished sub" || 
-                       sub.relationship == "extension") {
-                options.jazzSubs.push_back(sub);
-            } else if (sub.relationship == "modal interchange") {
-                options.modalSubs.push_back(sub);
-            } else {
-                // Other substitutions go to common subs
-                options.commonSubs.push_back(sub);
-            }
+    for (const auto& sub : lookupSubstitutions(chordName)) {
+        // Categorize by relationship
+        if (sub.relationship == "tritone sub" || 
+            sub.relationship == "diatonic sub" || 
+            sub.relationship == "relative minor" || 
+            sub.relationship == "relative major" || 
+            sub.relationship == "modal interchange") {
+            options.commonSubs.push_back(sub);
+        } else if (sub.relationship == "secondary dominant" || 
+                   sub.relationship == "diminished sub" || 
+                   sub.relationship == "extension") {
+            options.jazzSubs.push_back(sub);
+        } else if (sub.relationship == "modal interchange") {
+            options.modalSubs.push_back(sub);
+        } else {
+            // Other substitutions go to common subs
+            options.commonSubs.push_back(sub);
         }
     }
     
@@ -116,13 +206,10 @@ std::vector<ChordSubstitution> ChordSubstitutionEngine::findSubstitutionsByType(
     const std::string& chordName, 
     const std::string& substitutionType) {
     
-    std::vector<ChordSubstitution> results;
-    
-    for (const auto& sub : substitutionDatabase) {
-        if (sub.originalChord == chordName && sub.relationship == substitutionType) {
-            results.push_back(sub);
-        }
-    }
+    std::vector<ChordSubstitution> results = lookupSubstitutions(chordName,
+        [&](const std::string& relationship, float, int) {
+            return relationship == substitutionType;
+        });
     
     return results;
 }
@@ -131,13 +218,10 @@ std::vector<ChordSubstitution> ChordSubstitutionEngine::findSubstitutionsByFunct
     const std::string& chordName, 
     int minFunctionalSimilarity) {
     
-    std::vector<ChordSubstitution> results;
-    
-    for (const auto& sub : substitutionDatabase) {
-        if (sub.originalChord == chordName && sub.functionalSimilarity >= minFunctionalSimilarity) {
-            results.push_back(sub);
-        }
-    }
+    std::vector<ChordSubstitution> results = lookupSubstitutions(chordName,
+        [&](const std::string&, float, int functionalSimilarity) {
+            return functionalSimilarity >= minFunctionalSimilarity;
+        });
     
     // Sort by functional similarity (highest first)
     std::sort(results.begin(), results.end(), 
@@ -153,15 +237,10 @@ std::vector<ChordSubstitution> ChordSubstitutionEngine::findSubstitutionsByTensi
     float minTension, 
     float maxTension) {
     
-    std::vector<ChordSubstitution> results;
-    
-    for (const auto& sub : substitutionDatabase) {
-        if (sub.originalChord == chordName && 
-            sub.tensionChange >= minTension && 
-            sub.tensionChange <= maxTension) {
-            results.push_back(sub);
-        }
-    }
+    std::vector<ChordSubstitution> results = lookupSubstitutions(chordName,
+        [&](const std::string&, float tensionChange, int) {
+            return tensionChange >= minTension && tensionChange <= maxTension;
+        });
     
     // Sort by tension change (lowest first)
     std::sort(results.begin(), results.end(), 
@@ -172,8 +251,245 @@ std::vector<ChordSubstitution> ChordSubstitutionEngine::findSubstitutionsByTensi
     return results;
 }
 
+bool ChordSubstitutionEngine::makeRule(const ChordSubstitution& substitution, SubstitutionRule& rule) {
+    int sourceRoot = 0;
+    int targetRoot = 0;
+    ChordQuality sourceQuality;
+    ChordQuality targetQuality;
+    
+    if (!parseChordSymbol(substitution.originalChord, sourceRoot, sourceQuality) ||
+        !parseChordSymbol(substitution.substitutionChord, targetRoot, targetQuality)) {
+        return false;
+    }
+    
+    rule.sourceQuality = sourceQuality;
+    rule.targetQuality = targetQuality;
+    rule.rootInterval = static_cast<uint8_t>((targetRoot - sourceRoot + 12) % 12);
+    rule.tensionChange = substitution.tensionChange;
+    rule.functionalSimilarity = substitution.functionalSimilarity;
+    return true;
+}
+
+void SubstitutionRuleSet::add(const ChordSubstitution& substitution) {
+    SubstitutionRule rule;
+    if (!ChordSubstitutionEngine::makeRule(substitution, rule)) {
+        literalSubstitutions.push_back(substitution);
+        return;
+    }
+    rule.relationshipId = getRelationshipId(substitution.relationship);
+    
+    auto sameRule = [&](const SubstitutionRule& existing) {
+        return existing.targetQuality == rule.targetQuality &&
+               existing.rootInterval == rule.rootInterval &&
+               existing.relationshipId == rule.relationshipId;
+    };
+    
+    if (database) {
+        size_t ruleCount = 0;
+        const SubstitutionRule* databaseRules = database->substitutionRules(ruleCount);
+        RuleRange databaseRange = database->qualityRange(rule.sourceQuality);
+        for (uint32_t r = databaseRange.begin; r < databaseRange.end; r++) {
+            if (sameRule(databaseRules[r])) {
+                return;
+            }
+        }
+    }
+    
+    auto& range = ruleRanges[static_cast<size_t>(rule.sourceQuality)];
+    for (uint32_t r = range.first; r < range.second; r++) {
+        if (sameRule(rules[r])) {
+            return;
+        }
+    }
+    
+    // Append to the end of this quality's range and shift the ranges after it
+    rules.insert(rules.begin() + range.second, rule);
+    range.second++;
+    for (size_t q = static_cast<size_t>(rule.sourceQuality) + 1; q < CHORD_QUALITY_COUNT; q++) {
+        ruleRanges[q].first++;
+        ruleRanges[q].second++;
+    }
+}
+
 void ChordSubstitutionEngine::addCustomSubstitution(const ChordSubstitution& substitution) {
-    substitutionDatabase.push_back(substitution);
+    ruleSet.update([&](SubstitutionRuleSet& set) {
+        set.add(substitution);
+        set.customSubstitutions.push_back(substitution);
+    });
+}
+
+void ChordSubstitutionEngine::reloadRules(std::shared_ptr<const RuleDatabase> database) {
+    // Built under the writer lock, so a custom substitution added meanwhile is not lost
+    ruleSet.update([&](SubstitutionRuleSet& set) {
+        set = std::move(*buildRuleSet(database, set.customSubstitutions));
+    });
+}
+
+size_t ChordSubstitutionEngine::getRuleCount() const {
+    RcuReadGuard guard;
+    const SubstitutionRuleSet& set = *ruleSet.read();
+    
+    size_t databaseRuleCount = 0;
+    if (set.database) {
+        set.database->substitutionRules(databaseRuleCount);
+    }
+    return databaseRuleCount + set.rules.size();
+}
+
+std::vector<ChordSubstitution> ChordSubstitutionEngine::getChoices(const std::string& chordName) const {
+    std::vector<ChordSubstitution> choices;
+    choices.push_back({chordName, chordName, "original", 0.0f, 10});
+    
+    std::vector<ChordSubstitution> substitutions = lookupSubstitutions(chordName);
+    choices.insert(choices.end(), substitutions.begin(), substitutions.end());
+    
+    return choices;
+}
+
+std::vector<Reharmonization> ChordSubstitutionEngine::reharmonize(
+    const std::vector<std::string>& progression,
+    const ReharmonizationOptions& options) const {
+    
+    std::vector<Reharmonization> results;
+    const size_t length = progression.size();
+    if (length == 0) {
+        return results;
+    }
+    
+    // Choices per position; repeated chord names share one lookup
+    std::unordered_map<std::string, std::vector<ChordSubstitution>> choiceCache;
+    std::vector<const std::vector<ChordSubstitution>*> choices(length);
+    for (size_t i = 0; i < length; i++) {
+        auto it = choiceCache.find(progression[i]);
+        if (it == choiceCache.end()) {
+            it = choiceCache.emplace(progression[i], getChoices(progression[i])).first;
+        }
+        choices[i] = &it->second;
+    }
+    
+    // Score every choice, and every transition into it from the previous
+    // position's choices. Positions are independent, so they are split
+    // into contiguous ranges across threads.
+    std::vector<std::vector<float>> choiceScores(length);
+    std::vector<std::vector<float>> transitionScores(length); // [previous * count + current]
+    
+    auto scorePositions = [&](size_t first, size_t last) {
+        // Plain semitone distance: no movement limit, no penalty
+        VoiceAssigner assigner(12, 0);
+        std::vector<std::vector<uint8_t>> previousNotes;
+        std::vector<std::vector<uint8_t>> currentNotes;
+        
+        for (size_t i = first; i < last; i++) {
+            const auto& current = *choices[i];
+            
+            choiceScores[i].resize(current.size());
+            currentNotes.clear();
+            for (size_t c = 0; c < current.size(); c++) {
+                float tensionMiss = std::abs(current[c].tensionChange - options.targetTension);
+                choiceScores[i][c] = options.functionWeight * current[c].functionalSimilarity
+                                   - options.tensionWeight * tensionMiss;
+                currentNotes.push_back(utils::getChordNotesFromName(current[c].substitutionChord, 4));
+            }
+            
+            if (i > 0) {
+                // The first position of a range has no previous notes yet
+                if (i == first) {
+                    previousNotes.clear();
+                    for (const auto& choice : *choices[i - 1]) {
+                        previousNotes.push_back(utils::getChordNotesFromName(choice.substitutionChord, 4));
+                    }
+                }
+                
+                transitionScores[i].resize(previousNotes.size() * currentNotes.size());
+                for (size_t p = 0; p < previousNotes.size(); p++) {
+                    for (size_t c = 0; c < currentNotes.size(); c++) {
+                        int movement = assigner.assign(previousNotes[p], currentNotes[c]);
+                        transitionScores[i][p * currentNotes.size() + c] = -options.voiceLeadingWeight * movement;
+                    }
+                }
+            }
+            
+            std::swap(previousNotes, currentNotes);
+        }
+    };
+    
+    unsigned threadCount = options.threadCount > 0 ? options.threadCount : std::thread::hardware_concurrency();
+    threadCount = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threadCount, length)));
+    
+    if (threadCount == 1) {
+        scorePositions(0, length);
+    } else {
+        std::vector<std::thread> workers;
+        size_t chunk = (length + threadCount - 1) / threadCount;
+        for (size_t first = 0; first < length; first += chunk) {
+            workers.emplace_back(scorePositions, first, std::min(length, first + chunk));
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    // Beam search. Each layer keeps (parent, choice, score); the best
+    // beamWidth entries survive, ties in generation order.
+    struct BeamEntry {
+        size_t parent;
+        size_t choice;
+        float score;
+    };
+    auto better = [](const BeamEntry& a, const BeamEntry& b) {
+        return a.score > b.score;
+    };
+    
+    const size_t beamWidth = std::max<size_t>(1, options.beamWidth);
+    std::vector<std::vector<BeamEntry>> layers(length);
+    
+    for (size_t c = 0; c < choices[0]->size(); c++) {
+        layers[0].push_back({0, c, choiceScores[0][c]});
+    }
+    
+    for (size_t i = 0; i < length; i++) {
+        auto& layer = layers[i];
+        if (i > 0) {
+            const size_t count = choices[i]->size();
+            for (size_t b = 0; b < layers[i - 1].size(); b++) {
+                const BeamEntry& parent = layers[i - 1][b];
+                for (size_t c = 0; c < count; c++) {
+                    float score = parent.score + choiceScores[i][c]
+                                + transitionScores[i][parent.choice * count + c];
+                    layer.push_back({b, c, score});
+                }
+            }
+        }
+        
+        size_t kept = std::min(beamWidth, layer.size());
+        std::stable_sort(layer.begin(), layer.end(), better);
+        layer.resize(kept);
+    }
+    
+    // Walk the best final entries back through their parents
+    size_t resultCount = std::min(options.resultCount, layers.back().size());
+    for (size_t r = 0; r < resultCount; r++) {
+        Reharmonization reharmonization;
+        reharmonization.score = layers.back()[r].score;
+        reharmonization.chords.resize(length);
+        reharmonization.relationships.resize(length);
+        
+        size_t entry = r;
+        for (size_t i = length; i-- > 0;) {
+            const BeamEntry& step = layers[i][entry];
+            const ChordSubstitution& choice = (*choices[i])[step.choice];
+            reharmonization.chords[i] = choice.substitutionChord;
+            reharmonization.relationships[i] = choice.relationship;
+            if (step.choice != 0) {
+                reharmonization.substitutionCount++;
+            }
+            entry = step.parent;
+        }
+        
+        results.push_back(reharmonization);
+    }
+    
+    return results;
 }
 
 } // namespace midi_transformer
\ No newline at end of file
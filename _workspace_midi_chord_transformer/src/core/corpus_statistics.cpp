@@ -0,0 +1,459 @@
+#include "../../include/core/corpus_statistics.h"
+#include "../../include/core/chord_index.h"
+#include "../../include/core/midi_processor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <cstring>
+
+namespace midi_transformer {
+
+namespace {
+
+uint64_t mixHash(uint64_t key) {
+    // splitmix64 finalizer
+    key += 0x9E3779B97F4A7C15ULL;
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+std::string qualityLabel(size_t qualityId) {
+    if (qualityId >= CHORD_QUALITY_COUNT) {
+        return "other";
+    }
+    std::string suffix = chordQualitySuffix(static_cast<ChordQuality>(qualityId));
+    return suffix.empty() ? "major" : suffix;
+}
+
+std::string keyName(const KeyRegion& region) {
+    return region.rootNote + (region.isMajor ? "" : "m");
+}
+
+} // namespace
+
+// CountMinSketch
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : width(roundUpToPowerOfTwo(std::max<size_t>(1, width))),
+      depth(std::max<size_t>(1, depth)),
+      counters(this->width * this->depth, 0) {
+}
+
+void CountMinSketch::add(uint64_t key, uint32_t count) {
+    for (size_t row = 0; row < depth; row++) {
+        uint32_t& counter = counters[row * width + (mixHash(key ^ (row * 0x5851F42D4C957F2DULL)) & (width - 1))];
+        counter = counter > UINT32_MAX - count ? UINT32_MAX : counter + count;
+    }
+}
+
+uint32_t CountMinSketch::estimate(uint64_t key) const {
+    uint32_t smallest = UINT32_MAX;
+    for (size_t row = 0; row < depth; row++) {
+        smallest = std::min(smallest, counters[row * width + (mixHash(key ^ (row * 0x5851F42D4C957F2DULL)) & (width - 1))]);
+    }
+    return smallest;
+}
+
+bool CountMinSketch::merge(const CountMinSketch& other) {
+    if (other.width != width || other.depth != depth) {
+        std::cerr << "Error: Cannot merge count-min sketches of different sizes" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < counters.size(); i++) {
+        counters[i] = counters[i] > UINT32_MAX - other.counters[i] ? UINT32_MAX : counters[i] + other.counters[i];
+    }
+    return true;
+}
+
+size_t CountMinSketch::getWidth() const {
+    return width;
+}
+
+size_t CountMinSketch::getDepth() const {
+    return depth;
+}
+
+// HyperLogLog
+
+HyperLogLog::HyperLogLog(uint32_t precision)
+    : precision(std::max<uint32_t>(4, std::min<uint32_t>(precision, 18))),
+      registers(size_t(1) << this->precision, 0) {
+}
+
+void HyperLogLog::add(uint64_t key) {
+    uint64_t hash = mixHash(key);
+    size_t index = static_cast<size_t>(hash >> (64 - precision));
+    
+    // Rank of the first set bit in the remaining bits, 1-based
+    uint64_t remaining = hash << precision;
+    uint8_t rank = 1;
+    while (rank <= 64 - precision && !(remaining & (uint64_t(1) << 63))) {
+        remaining <<= 1;
+        rank++;
+    }
+    registers[index] = std::max(registers[index], rank);
+}
+
+double HyperLogLog::estimate() const {
+    double m = static_cast<double>(registers.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t value : registers) {
+        sum += std::ldexp(1.0, -static_cast<int>(value));
+        if (value == 0) {
+            zeros++;
+        }
+    }
+    
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double raw = alpha * m * m / sum;
+    
+    // Linear counting is more accurate while many registers are still empty
+    if (raw <= 2.5 * m && zeros > 0) {
+        return m * std::log(m / static_cast<double>(zeros));
+    }
+    return raw;
+}
+
+bool HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.precision != precision) {
+        std::cerr << "Error: Cannot merge HyperLogLog sketches of different precision" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < registers.size(); i++) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+    return true;
+}
+
+// CorpusStatistics
+
+CorpusStatistics::CorpusStatistics(uint32_t gramLength, size_t topGramCount)
+    : gramLength(std::max<uint32_t>(2, std::min(gramLength, CHORD_INDEX_MAX_GRAM_LENGTH))),
+      topGramCount(topGramCount),
+      fileCount(0),
+      failedFileCount(0),
+      noteCount(0),
+      chordCount(0),
+      qualityCounts(CHORD_QUALITY_COUNT + 1, 0),
+      transitions((CHORD_QUALITY_COUNT + 1) * (CHORD_QUALITY_COUNT + 1), 0),
+      gramCount(0),
+      candidateFloor(0) {
+    std::fill(rootMotion, rootMotion + 12, 0);
+}
+
+void CorpusStatistics::addFile(const std::vector<std::shared_ptr<Chord>>& chords,
+                               const std::vector<KeyRegion>& keyTimeline, size_t fileNoteCount) {
+    fileCount++;
+    noteCount += fileNoteCount;
+    chordCount += chords.size();
+    
+    std::vector<GramChord> reduced;
+    reduced.reserve(chords.size());
+    for (const auto& chord : chords) {
+        reduced.push_back(gramChord(chord->name));
+    }
+    
+    size_t region = 0;
+    for (size_t i = 0; i < reduced.size(); i++) {
+        size_t quality = reduced[i].parsed ? static_cast<size_t>(reduced[i].quality) : CHORD_QUALITY_COUNT;
+        qualityCounts[quality]++;
+        
+        if (i > 0) {
+            size_t previous = reduced[i - 1].parsed ? static_cast<size_t>(reduced[i - 1].quality) : CHORD_QUALITY_COUNT;
+            transitions[previous * (CHORD_QUALITY_COUNT + 1) + quality]++;
+            if (reduced[i - 1].parsed && reduced[i].parsed) {
+                rootMotion[(reduced[i].root - reduced[i - 1].root + 12) % 12]++;
+            }
+        }
+        
+        // Chords and key regions are both in time order
+        while (region + 1 < keyTimeline.size() && keyTimeline[region + 1].startTime <= chords[i]->startTime) {
+            region++;
+        }
+        if (!keyTimeline.empty()) {
+            keyChordCounts[keyName(keyTimeline[region])]++;
+        }
+    }
+    
+    for (size_t first = 0; first + gramLength <= reduced.size(); first++) {
+        uint64_t gram;
+        if (!packGram(reduced, first, gramLength, gram)) {
+            continue;
+        }
+        gramCount++;
+        gramSketch.add(gram);
+        distinctGrams.add(gram);
+        offerCandidate(gram, gramSketch.estimate(gram));
+    }
+}
+
+void CorpusStatistics::addFailedFile() {
+    failedFileCount++;
+}
+
+void CorpusStatistics::offerCandidate(uint64_t gram, uint32_t estimate) {
+    // Space for a few times the reported grams, so ones that only become
+    // frequent late in the corpus still get a place
+    const size_t capacity = std::max<size_t>(16, topGramCount * 4);
+    
+    auto it = gramCandidates.find(gram);
+    if (it != gramCandidates.end()) {
+        it->second = estimate;
+        return;
+    }
+    if (gramCandidates.size() >= capacity) {
+        if (estimate <= candidateFloor) {
+            return;
+        }
+        auto smallest = std::min_element(gramCandidates.begin(), gramCandidates.end(),
+            [](const std::pair<const uint64_t, uint32_t>& a, const std::pair<const uint64_t, uint32_t>& b) {
+                return a.second < b.second;
+            });
+        gramCandidates.erase(smallest);
+    }
+    gramCandidates[gram] = estimate;
+    
+    if (gramCandidates.size() >= capacity) {
+        candidateFloor = UINT32_MAX;
+        for (const auto& candidate : gramCandidates) {
+            candidateFloor = std::min(candidateFloor, candidate.second);
+        }
+    }
+}
+
+bool CorpusStatistics::merge(const CorpusStatistics& other) {
+    if (other.gramLength != gramLength) {
+        std::cerr << "Error: Cannot merge corpus statistics of different n-gram lengths" << std::endl;
+        return false;
+    }
+    if (!gramSketch.merge(other.gramSketch) || !distinctGrams.merge(other.distinctGrams)) {
+        return false;
+    }
+    
+    fileCount += other.fileCount;
+    failedFileCount += other.failedFileCount;
+    noteCount += other.noteCount;
+    chordCount += other.chordCount;
+    gramCount += other.gramCount;
+    for (size_t i = 0; i < qualityCounts.size(); i++) {
+        qualityCounts[i] += other.qualityCounts[i];
+    }
+    for (size_t i = 0; i < transitions.size(); i++) {
+        transitions[i] += other.transitions[i];
+    }
+    for (int i = 0; i < 12; i++) {
+        rootMotion[i] += other.rootMotion[i];
+    }
+    for (const auto& key : other.keyChordCounts) {
+        keyChordCounts[key.first] += key.second;
+    }
+    
+    // Candidates of both sides, re-estimated from the merged sketch
+    std::vector<uint64_t> grams;
+    for (const auto& candidate : gramCandidates) {
+        grams.push_back(candidate.first);
+    }
+    for (const auto& candidate : other.gramCandidates) {
+        grams.push_back(candidate.first);
+    }
+    gramCandidates.clear();
+    candidateFloor = 0;
+    for (uint64_t gram : grams) {
+        offerCandidate(gram, gramSketch.estimate(gram));
+    }
+    return true;
+}
+
+bool CorpusStatistics::collect(const std::vector<std::string>& midiFiles,
+                               const CorpusStatisticsOptions& options, CorpusStatistics& statistics) {
+    unsigned threadCount = options.threadCount > 0 ? options.threadCount : std::thread::hardware_concurrency();
+    threadCount = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threadCount, midiFiles.size())));
+    
+    std::vector<std::unique_ptr<CorpusStatistics>> accumulators;
+    for (unsigned t = 0; t < threadCount; t++) {
+        accumulators.push_back(std::make_unique<CorpusStatistics>(options.gramLength, options.topGramCount));
+    }
+    
+    // Workers take files one at a time, since file sizes vary widely
+    std::atomic<size_t> nextFile(0);
+    auto analyzeFiles = [&](CorpusStatistics& accumulator) {
+        for (size_t i = nextFile++; i < midiFiles.size(); i = nextFile++) {
+            MidiProcessor processor;
+            if (!processor.loadMidiFile(midiFiles[i])) {
+                std::cerr << "Warning: Could not analyze " << midiFiles[i] << std::endl;
+                accumulator.addFailedFile();
+                continue;
+            }
+            std::vector<std::shared_ptr<Chord>> chords = processor.getChords();
+            accumulator.addFile(chords, processor.getKeyTimeline(), processor.getNotes().size());
+        }
+    };
+    
+    if (threadCount == 1) {
+        analyzeFiles(*accumulators[0]);
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threadCount; t++) {
+            workers.emplace_back(analyzeFiles, std::ref(*accumulators[t]));
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    for (const auto& accumulator : accumulators) {
+        if (!statistics.merge(*accumulator)) {
+            return false;
+        }
+    }
+    return statistics.fileCount > 0 || midiFiles.empty();
+}
+
+std::vector<std::pair<uint64_t, uint32_t>> CorpusStatistics::topGrams() const {
+    std::vector<std::pair<uint64_t, uint32_t>> grams;
+    for (const auto& candidate : gramCandidates) {
+        grams.push_back({candidate.first, gramSketch.estimate(candidate.first)});
+    }
+    std::sort(grams.begin(), grams.end(),
+              [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) {
+                  return a.second != b.second ? a.second > b.second : a.first < b.first;
+              });
+    if (grams.size() > topGramCount) {
+        grams.resize(topGramCount);
+    }
+    return grams;
+}
+
+std::string CorpusStatistics::gramName(uint64_t gram) const {
+    // Spelled from C, e.g. "Cm7 F7 Bbmaj7 G7" for a ii-V-I-VI in any key
+    std::string name;
+    for (uint32_t i = 0; i < gramLength; i++) {
+        uint64_t chord = (gram >> (9 * (gramLength - 1 - i))) & 0x1FF;
+        if (i > 0) {
+            name += " ";
+        }
+        name += chordSymbol(static_cast<int>(chord >> 5), static_cast<ChordQuality>(chord & 0x1F));
+    }
+    return name;
+}
+
+std::string CorpusStatistics::toJson() const {
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"files\": " << fileCount << ",\n";
+    json << "  \"failedFiles\": " << failedFileCount << ",\n";
+    json << "  \"notes\": " << noteCount << ",\n";
+    json << "  \"chords\": " << chordCount << ",\n";
+    
+    json << "  \"qualities\": {";
+    for (size_t q = 0; q < qualityCounts.size(); q++) {
+        json << (q > 0 ? ", " : "") << "\"" << qualityLabel(q) << "\": " << qualityCounts[q];
+    }
+    json << "},\n";
+    
+    json << "  \"transitions\": {\n    \"labels\": [";
+    for (size_t q = 0; q < qualityCounts.size(); q++) {
+        json << (q > 0 ? ", " : "") << "\"" << qualityLabel(q) << "\"";
+    }
+    json << "],\n    \"counts\": [\n";
+    for (size_t from = 0; from < qualityCounts.size(); from++) {
+        json << "      [";
+        for (size_t to = 0; to < qualityCounts.size(); to++) {
+            json << (to > 0 ? ", " : "") << transitions[from * qualityCounts.size() + to];
+        }
+        json << "]" << (from + 1 < qualityCounts.size() ? "," : "") << "\n";
+    }
+    json << "    ]\n  },\n";
+    
+    json << "  \"rootMotion\": [";
+    for (int i = 0; i < 12; i++) {
+        json << (i > 0 ? ", " : "") << rootMotion[i];
+    }
+    json << "],\n";
+    
+    json << "  \"keys\": {";
+    bool firstKey = true;
+    for (const auto& key : keyChordCounts) {
+        json << (firstKey ? "" : ", ") << "\"" << key.first << "\": " << key.second;
+        firstKey = false;
+    }
+    json << "},\n";
+    
+    json << "  \"grams\": {\n";
+    json << "    \"length\": " << gramLength << ",\n";
+    json << "    \"total\": " << gramCount << ",\n";
+    json << "    \"distinctEstimate\": " << static_cast<uint64_t>(std::llround(distinctGrams.estimate())) << ",\n";
+    json << "    \"sketchWidth\": " << gramSketch.getWidth() << ",\n";
+    json << "    \"sketchDepth\": " << gramSketch.getDepth() << ",\n";
+    json << "    \"top\": [";
+    std::vector<std::pair<uint64_t, uint32_t>> grams = topGrams();
+    for (size_t i = 0; i < grams.size(); i++) {
+        json << (i > 0 ? "," : "") << "\n      {\"chords\": \"" << gramName(grams[i].first)
+             << "\", \"estimate\": " << grams[i].second << "}";
+    }
+    json << (grams.empty() ? "" : "\n    ") << "]\n";
+    json << "  }\n";
+    json << "}\n";
+    return json.str();
+}
+
+bool CorpusStatistics::writeJson(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not write corpus statistics " << filename << std::endl;
+        return false;
+    }
+    file << toJson();
+    return static_cast<bool>(file);
+}
+
+uint64_t CorpusStatistics::getFileCount() const {
+    return fileCount;
+}
+
+uint64_t CorpusStatistics::getChordCount() const {
+    return chordCount;
+}
+
+uint64_t CorpusStatistics::getQualityCount(ChordQuality quality) const {
+    return qualityCounts[std::min(static_cast<size_t>(quality), CHORD_QUALITY_COUNT)];
+}
+
+uint64_t CorpusStatistics::getTransitionCount(ChordQuality from, ChordQuality to) const {
+    size_t row = std::min(static_cast<size_t>(from), CHORD_QUALITY_COUNT);
+    size_t column = std::min(static_cast<size_t>(to), CHORD_QUALITY_COUNT);
+    return transitions[row * (CHORD_QUALITY_COUNT + 1) + column];
+}
+
+uint64_t CorpusStatistics::getGramEstimate(const std::vector<std::string>& chordNames) const {
+    if (chordNames.size() != gramLength) {
+        return 0;
+    }
+    std::vector<GramChord> chords;
+    for (const auto& name : chordNames) {
+        chords.push_back(gramChord(name));
+    }
+    uint64_t gram;
+    return packGram(chords, 0, gramLength, gram) ? gramSketch.estimate(gram) : 0;
+}
+
+double CorpusStatistics::getDistinctGramEstimate() const {
+    return distinctGrams.estimate();
+}
+
+} // namespace midi_transformer
\ No newline at end of file
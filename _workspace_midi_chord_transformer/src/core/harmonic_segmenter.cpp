@@ -0,0 +1,212 @@
+#include "../../include/core/harmonic_segmenter.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+namespace midi_transformer {
+
+namespace {
+
+// A note boundary in the sweep
+struct SweepEvent {
+    uint32_t time;
+    uint8_t pitch;
+    bool isStart;
+};
+
+// 12-bit pitch-class set with the bass pitch class in bits 12-15
+uint16_t harmonyKey(const PitchSet& pitches) {
+    uint16_t classes = 0;
+    int bass = -1;
+    for (int pitch = 0; pitch < 128; pitch++) {
+        if (pitches.contains(static_cast<uint8_t>(pitch))) {
+            classes |= static_cast<uint16_t>(1u << (pitch % 12));
+            if (bass < 0) bass = pitch % 12;
+        }
+    }
+    return static_cast<uint16_t>(classes | ((bass < 0 ? 0 : bass) << 12));
+}
+
+} // namespace
+
+HarmonicSegmenter::HarmonicSegmenter(const SegmentationOptions& opts) : options(opts) {
+}
+
+void HarmonicSegmenter::setOptions(const SegmentationOptions& opts) {
+    options = opts;
+}
+
+SegmentationOptions HarmonicSegmenter::getOptions() const {
+    return options;
+}
+
+uint32_t HarmonicSegmenter::effectiveEndTime(
+    const Note& note,
+    const std::vector<std::vector<SustainSpan>>& spansByChannel) const {
+    
+    uint32_t endTime = note.startTime + note.duration;
+    if (!options.useSustainPedal || note.channel >= spansByChannel.size()) {
+        return endTime;
+    }
+    
+    // Find the last pedal span that starts at or before the release
+    const auto& spans = spansByChannel[note.channel];
+    auto it = std::upper_bound(spans.begin(), spans.end(), endTime,
+                               [](uint32_t time, const SustainSpan& span) {
+                                   return time < span.startTime;
+                               });
+    if (it == spans.begin()) {
+        return endTime;
+    }
+    --it;
+    
+    // A note released while the pedal is down rings until the pedal comes up
+    if (endTime < it->endTime) {
+        return it->endTime;
+    }
+    return endTime;
+}
+
+std::vector<HarmonicSegment> HarmonicSegmenter::segment(
+    const std::vector<Note>& notes,
+    const std::vector<SustainSpan>& sustainSpans) const {
+    
+    std::vector<HarmonicSegment> segments;
+    if (notes.empty()) {
+        return segments;
+    }
+    
+    // Index pedal spans by channel; spans arrive sorted and non-overlapping
+    std::vector<std::vector<SustainSpan>> spansByChannel(16);
+    for (const auto& span : sustainSpans) {
+        if (span.channel < spansByChannel.size()) {
+            spansByChannel[span.channel].push_back(span);
+        }
+    }
+    
+    // Build the boundary list: one start and one end per note
+    std::vector<SweepEvent> events;
+    events.reserve(notes.size() * 2);
+    for (const auto& note : notes) {
+        if (note.pitch > 127) {
+            continue;
+        }
+        uint32_t endTime = effectiveEndTime(note, spansByChannel);
+        if (endTime <= note.startTime) {
+            continue;
+        }
+        events.push_back({note.startTime, note.pitch, true});
+        events.push_back({endTime, note.pitch, false});
+    }
+    
+    // Releases sort before attacks at the same instant so re-struck notes
+    // don't leave a stale voice behind
+    std::sort(events.begin(), events.end(), [](const SweepEvent& a, const SweepEvent& b) {
+        if (a.time != b.time) return a.time < b.time;
+        return !a.isStart && b.isStart;
+    });
+    
+    // Sweep the boundaries, keeping a reference count per pitch
+    std::array<uint32_t, 128> soundingCount{};
+    PitchSet sounding;
+    PitchSet segmentMask;
+    uint32_t segmentStart = 0;
+    uint16_t previousHarmonyKey = 0;
+    
+    auto emitSegment = [&](uint32_t endTime) {
+        if (endTime <= segmentStart) {
+            return;
+        }
+        uint32_t duration = endTime - segmentStart;
+        std::vector<uint8_t> segmentNotes = segmentMask.toNotes();
+        if (duration < options.minSegmentDuration ||
+            segmentNotes.size() < options.minSegmentNotes) {
+            return;
+        }
+        
+        // Coalesce with the previous segment when only a short gap in between
+        // was dropped; a longer gap separates two statements of the chord
+        if (!segments.empty() && segments.back().notes == segmentNotes) {
+            uint32_t gap = segmentStart - (segments.back().startTime + segments.back().duration);
+            if (gap == 0 || gap < options.minSegmentDuration) {
+                segments.back().duration = endTime - segments.back().startTime;
+                return;
+            }
+        }
+        
+        // An arpeggio filling in the same harmony extends the previous segment
+        uint16_t segmentHarmony = harmonyKey(segmentMask);
+        if (options.mergeEqualHarmony && !segments.empty() && segmentHarmony == previousHarmonyKey &&
+            segments.back().startTime + segments.back().duration == segmentStart) {
+            auto& previous = segments.back();
+            std::vector<uint8_t> merged;
+            std::set_union(previous.notes.begin(), previous.notes.end(),
+                           segmentNotes.begin(), segmentNotes.end(),
+                           std::back_inserter(merged));
+            previous.notes = std::move(merged);
+            previous.duration = endTime - previous.startTime;
+            return;
+        }
+        previousHarmonyKey = segmentHarmony;
+        
+        HarmonicSegment segment;
+        segment.startTime = segmentStart;
+        segment.duration = duration;
+        segment.notes = std::move(segmentNotes);
+        segments.push_back(std::move(segment));
+    };
+    
+    size_t i = 0;
+    while (i < events.size()) {
+        uint32_t time = events[i].time;
+        
+        // Apply every boundary at this instant before comparing pitch sets
+        for (; i < events.size() && events[i].time == time; i++) {
+            const auto& event = events[i];
+            if (event.isStart) {
+                if (soundingCount[event.pitch]++ == 0) {
+                    sounding.add(event.pitch);
+                }
+            } else if (soundingCount[event.pitch] > 0) {
+                if (--soundingCount[event.pitch] == 0) {
+                    sounding.remove(event.pitch);
+                }
+            }
+        }
+        
+        if (sounding != segmentMask) {
+            emitSegment(time);
+            segmentMask = sounding;
+            segmentStart = time;
+        }
+    }
+    
+    return segments;
+}
+
+std::vector<uint8_t> HarmonicSegmenter::reduceToClosePosition(const std::vector<uint8_t>& notes) {
+    if (notes.empty()) {
+        return {};
+    }
+    
+    uint8_t bass = *std::min_element(notes.begin(), notes.end());
+    
+    // Keep the bass, then stack each remaining pitch class within the octave above it
+    std::vector<uint8_t> reduced = {bass};
+    for (uint8_t note : notes) {
+        int offset = (note - bass) % 12;
+        if (offset == 0) {
+            continue;
+        }
+        int pitch = bass + offset;
+        if (pitch <= 127 && std::find(reduced.begin(), reduced.end(), pitch) == reduced.end()) {
+            reduced.push_back(static_cast<uint8_t>(pitch));
+        }
+    }
+    
+    std::sort(reduced.begin(), reduced.end());
+    return reduced;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "../../include/core/input_deduplicator.h"
+#include "../../include/utils/midi_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+namespace midi_transformer {
+
+namespace {
+
+uint64_t combineHash(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    hash = (hash ^ (hash >> 31)) * 0xBF58476D1CE4E5B9ULL;
+    return hash ^ (hash >> 29);
+}
+
+uint32_t read32BE(const std::vector<uint8_t>& buffer, size_t position) {
+    return (static_cast<uint32_t>(buffer[position]) << 24) | (static_cast<uint32_t>(buffer[position + 1]) << 16) |
+           (static_cast<uint32_t>(buffer[position + 2]) << 8) | buffer[position + 3];
+}
+
+bool readVariableLength(const std::vector<uint8_t>& buffer, size_t& position, size_t end, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < 4 && position < end; i++) {
+        uint8_t byte = buffer[position++];
+        value = (value << 7) | (byte & 0x7F);
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Channel events at their absolute ticks, parsed with the same rules as
+// MidiProcessor::decodeTrack: only channel messages set the running status,
+// and bytes of unknown event types are skipped up to the next status byte.
+// Meta and system exclusive events are not hashed, but their delta times
+// still count towards the ticks. False where decodeTrack would reject the track.
+bool hashTrack(const std::vector<uint8_t>& buffer, size_t position, size_t end, uint64_t& hash) {
+    hash = 0;
+    uint64_t tick = 0;
+    uint8_t runningStatus = 0;
+    
+    while (position < end) {
+        uint32_t delta;
+        if (!readVariableLength(buffer, position, end, delta)) {
+            return false;
+        }
+        if (position >= end) {
+            break;
+        }
+        tick += delta;
+        
+        uint8_t status;
+        if (buffer[position] & 0x80) {
+            status = buffer[position++];
+            if (status < 0xF0) {
+                runningStatus = status;
+            }
+        } else {
+            status = runningStatus;
+        }
+        
+        if (status == 0xFF || status == 0xF0 || status == 0xF7) {
+            if (status == 0xFF) {
+                if (position >= end) {
+                    return false;
+                }
+                position++;
+            }
+            uint32_t length;
+            if (!readVariableLength(buffer, position, end, length) || position + length > end) {
+                return false;
+            }
+            position += length;
+            continue;
+        }
+        
+        size_t dataLength;
+        switch (status & 0xF0) {
+            case 0x80: case 0x90: case 0xA0: case 0xB0: case 0xE0:
+                dataLength = 2;
+                break;
+            case 0xC0: case 0xD0:
+                dataLength = 1;
+                break;
+            default:
+                while (position < end && !(buffer[position] & 0x80)) {
+                    position++;
+                }
+                continue;
+        }
+        if (position + dataLength > end) {
+            return false;
+        }
+        
+        uint64_t event = (tick << 24) | (static_cast<uint64_t>(status) << 16) |
+                         (static_cast<uint64_t>(buffer[position]) << 8) |
+                         (dataLength == 2 ? buffer[position + 1] : 0);
+        hash = combineHash(hash, event);
+        position += dataLength;
+    }
+    return true;
+}
+
+} // namespace
+
+void InputDeduplicator::fingerprintBuffer(const std::vector<uint8_t>& buffer, InputFingerprint& fingerprint) {
+    fingerprint = InputFingerprint();
+    fingerprint.size = buffer.size();
+    fingerprint.contentHash = utils::hashBytes(buffer.data(), buffer.size());
+    
+    if (buffer.size() < 14 || buffer[0] != 'M' || buffer[1] != 'T' || buffer[2] != 'h' || buffer[3] != 'd') {
+        return;
+    }
+    uint32_t headerLength = read32BE(buffer, 4);
+    if (headerLength < 6 || 8 + static_cast<size_t>(headerLength) > buffer.size()) {
+        return;
+    }
+    uint16_t division = static_cast<uint16_t>((buffer[12] << 8) | buffer[13]);
+    
+    size_t position = 8 + headerLength;
+    while (position + 8 <= buffer.size()) {
+        bool isTrack = buffer[position] == 'M' && buffer[position + 1] == 'T' &&
+                       buffer[position + 2] == 'r' && buffer[position + 3] == 'k';
+        size_t chunkEnd = std::min(buffer.size(), position + 8 + static_cast<size_t>(read32BE(buffer, position + 4)));
+        if (isTrack) {
+            // A track the parser would reject has no music hash; the content
+            // hash stands in for it
+            uint64_t trackHash;
+            if (!hashTrack(buffer, position + 8, chunkEnd, trackHash)) {
+                fingerprint.trackHashes.clear();
+                return;
+            }
+            fingerprint.trackHashes.push_back(trackHash);
+        }
+        position = chunkEnd;
+    }
+    
+    fingerprint.musicHash = combineHash(0, division);
+    for (uint64_t trackHash : fingerprint.trackHashes) {
+        fingerprint.musicHash = combineHash(fingerprint.musicHash, trackHash);
+    }
+    fingerprint.valid = true;
+}
+
+bool InputDeduplicator::fingerprint(const std::string& path, InputFingerprint& fingerprint) {
+    // Reading a pipe or device could block forever
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(path, error)) {
+        std::cerr << "Error: Not a regular file " << path << std::endl;
+        return false;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    fingerprintBuffer(buffer, fingerprint);
+    return true;
+}
+
+std::vector<BatchInput> InputDeduplicator::plan(const std::vector<std::string>& paths, unsigned threadCount) {
+    std::vector<BatchInput> inputs(paths.size());
+    
+    // Hashing is bound by reading the files, so each worker takes one at a time
+    std::atomic<size_t> nextInput(0);
+    auto fingerprintInputs = [&]() {
+        for (size_t i = nextInput++; i < paths.size(); i = nextInput++) {
+            inputs[i].path = paths[i];
+            inputs[i].readable = fingerprint(paths[i], inputs[i].fingerprint);
+        }
+    };
+    
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threadCount, paths.size())));
+    
+    if (threadCount == 1) {
+        fingerprintInputs();
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threadCount; t++) {
+            workers.emplace_back(fingerprintInputs);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    // Grouped in input order, so the first input with some content represents it
+    std::unordered_map<uint64_t, size_t> byContent;
+    std::unordered_map<uint64_t, size_t> byMusic;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        BatchInput& input = inputs[i];
+        input.representative = i;
+        if (!input.readable) {
+            continue;
+        }
+        
+        auto content = byContent.find(input.fingerprint.contentHash);
+        if (content != byContent.end() && inputs[content->second].fingerprint.size == input.fingerprint.size) {
+            input.kind = DuplicateKind::IDENTICAL_BYTES;
+            input.representative = content->second;
+            continue;
+        }
+        byContent.emplace(input.fingerprint.contentHash, i);
+        
+        if (!input.fingerprint.valid) {
+            continue;
+        }
+        auto music = byMusic.find(input.fingerprint.musicHash);
+        if (music != byMusic.end() && inputs[music->second].fingerprint.trackHashes == input.fingerprint.trackHashes) {
+            input.kind = DuplicateKind::IDENTICAL_TRACKS;
+            input.representative = music->second;
+            continue;
+        }
+        byMusic.emplace(input.fingerprint.musicHash, i);
+    }
+    return inputs;
+}
+
+size_t InputDeduplicator::countDuplicates(const std::vector<BatchInput>& inputs) {
+    return static_cast<size_t>(std::count_if(inputs.begin(), inputs.end(),
+        [](const BatchInput& input) { return input.kind != DuplicateKind::UNIQUE; }));
+}
+
+} // namespace midi_transformer
\ No newline at end of file
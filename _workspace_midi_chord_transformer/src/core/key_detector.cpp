@@ -1,18 +1,91 @@
 #include "../../include/core/key_detector.h"
+#include "../../include/core/rule_database.h"
 #include "../../include/utils/midi_utils.h"
 
 #include <algorithm>
 #include <unordered_map>
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <climits>
 
 namespace midi_transformer {
 
-KeyDetector::KeyDetector() {
-    initializeKeySignatures();
+namespace {
+
+const size_t KEY_COUNT = 24;
+
+// Histograms scored together, one per vector lane
+const size_t ROW_BLOCK = 8;
+
+// Krumhansl-Kessler probe-tone ratings, starting on the tonic
+const float MAJOR_PROFILE[12] = {6.35f, 2.23f, 3.48f, 2.33f, 4.38f, 4.09f, 2.52f, 5.19f, 2.39f, 3.66f, 2.29f, 2.88f};
+const float MINOR_PROFILE[12] = {6.33f, 2.68f, 3.52f, 5.38f, 2.60f, 3.53f, 2.54f, 4.75f, 3.98f, 2.69f, 3.34f, 3.17f};
+
+// Key profiles centred and scaled to unit length: each note of pitch class
+// i adds weights[k][i] to the score of key k. Keys 0-11 are major on tonic
+// k, keys 12-23 minor on tonic k - 12. A histogram's score divided by its
+// own centred length is then its correlation with the key.
+struct KeyProfileWeights {
+    float weights[KEY_COUNT][12];
+    
+    KeyProfileWeights() {
+        for (int mode = 0; mode < 2; mode++) {
+            const float* profile = mode == 0 ? MAJOR_PROFILE : MINOR_PROFILE;
+            
+            float mean = 0.0f;
+            for (int i = 0; i < 12; i++) {
+                mean += profile[i] / 12.0f;
+            }
+            float length = 0.0f;
+            for (int i = 0; i < 12; i++) {
+                length += (profile[i] - mean) * (profile[i] - mean);
+            }
+            length = std::sqrt(length);
+            
+            for (int tonic = 0; tonic < 12; tonic++) {
+                for (int i = 0; i < 12; i++) {
+                    weights[mode * 12 + tonic][i] = (profile[(i - tonic + 12) % 12] - mean) / length;
+                }
+            }
+        }
+    }
+};
+
+const KeyProfileWeights& keyProfileWeights() {
+    static const KeyProfileWeights profileWeights;
+    return profileWeights;
+}
+
+} // namespace
+
+KeyDetector::KeyDetector()
+    : KeyDetector(RuleDatabase::shared()) {
+}
+
+KeyDetector::KeyDetector(std::shared_ptr<const RuleDatabase> database)
+    : database(std::move(database)), keysLoaded(false) {
+}
+
+void KeyDetector::ensureKeySignatures() const {
+    if (keysLoaded) {
+        return;
+    }
+    keysLoaded = true;
+    
+    if (!database) {
+        initializeKeySignatures();
+        return;
+    }
+    
+    std::vector<std::string> names;
+    std::vector<std::shared_ptr<KeySignature>> keys = database->keySignatures(names);
+    for (size_t i = 0; i < keys.size(); i++) {
+        keySignatures[names[i]] = keys[i];
+    }
 }
 
-void KeyDetector::initializeKeySignatures() {
+void KeyDetector::initializeKeySignatures() const {
     // Initialize key signatures for all major and minor keys
     
     // Major keys
@@ -109,8 +182,10 @@ std::shared_ptr<KeySignature> KeyDetector::detectKey(const std::vector<std::shar
     // Calculate key scores for each possible key
     std::unordered_map<std::string, double> keyScores;
     
+    ensureKeySignatures();
     for (const auto& [keyName, key] : keySignatures) {
         // Count how many notes are in the key
+        PitchClassMask keyNotes = pitchClassMask(key->scaleDegrees);
         int notesInKey = 0;
         int totalNotes = 0;
         
@@ -119,7 +194,7 @@ std::shared_ptr<KeySignature> KeyDetector::detectKey(const std::vector<std::shar
                 totalNotes += pitchClassCounts[i];
                 
                 // Check if this pitch class is in the key
-                if (std::find(key->scaleDegrees.begin(), key->scaleDegrees.end(), i) != key->scaleDegrees.end()) {
+                if ((keyNotes >> i) & 1) {
                     notesInKey += pitchClassCounts[i];
                 }
             }
@@ -201,124 +276,56 @@ std::shared_ptr<KeySignature> KeyDetector::detectKey(const std::vector<std::shar
     return nullptr;
 }
 
-std::vector<std::shared_ptr<ScaleConstraint>> KeyDetector::getScaleConstraints(
+std::vector<ScaleConstraint> KeyDetector::getScaleConstraints(
     const std::shared_ptr<KeySignature>& key) {
     
-    std::vector<std::shared_ptr<ScaleConstraint>> constraints;
+    std::vector<ScaleConstraint> constraints;
     
-    if (!key) {
+    ScaleMode mode = ScaleMode::MAJOR;
+    if (!key || !getScaleEntry(*key, &mode)) {
         return constraints;
     }
     
-    // Create constraint for the main scale
-    auto mainScale = std::make_shared<ScaleConstraint>();
-    mainScale->scaleType = key->isMajor ? "major" : "minor";
-    mainScale->rootNote = utils::noteNameToMidi(key->rootNote) % 12;
-    mainScale->allowedNotes = key->scaleDegrees;
-    
-    // Add allowed chords based on diatonic chords
-    for (const auto& [degree, quality] : key->diatonicChords) {
-        // Calculate root note of this chord
-        int degreeIndex = degree - 1; // Convert from 1-based to 0-based
-        if (degreeIndex >= 0 && degreeIndex < static_cast<int>(key->scaleDegrees.size())) {
-            uint8_t chordRoot = key->scaleDegrees[degreeIndex];
-            std::string rootName = utils::midiNoteToName(chordRoot);
-            mainScale->allowedChords.push_back(rootName + quality);
-        }
-    }
-    
-    constraints.push_back(mainScale);
+    uint8_t root = key->scaleDegrees[0];
+    constraints.emplace_back(mode, root);
     
     // Add additional constraints for common modal interchange scales
     if (key->isMajor) {
-        // Add parallel minor (for modal interchange)
-        auto parallelMinor = std::make_shared<ScaleConstraint>();
-        parallelMinor->scaleType = "parallel minor";
-        parallelMinor->rootNote = mainScale->rootNote;
-        
-        // Calculate natural minor scale degrees
-        uint8_t root = parallelMinor->rootNote;
-        parallelMinor->allowedNotes = {
-            root,
-            (root + 2) % 12,
-            (root + 3) % 12,
-            (root + 5) % 12,
-            (root + 7) % 12,
-            (root + 8) % 12,
-            (root + 10) % 12
-        };
-        
-        // Add common borrowed chords
-        std::string rootName = utils::midiNoteToName(root);
-        parallelMinor->allowedChords = {
-            rootName + "m",                                  // i
-            utils::midiNoteToName((root + 3) % 12),          // bIII
-            utils::midiNoteToName((root + 5) % 12) + "m",    // iv
-            utils::midiNoteToName((root + 8) % 12),          // bVI
-            utils::midiNoteToName((root + 10) % 12)          // bVII
-        };
-        
-        constraints.push_back(parallelMinor);
+        constraints.emplace_back(ScaleMode::NATURAL_MINOR, root);
     } else {
-        // Add harmonic minor
-        auto harmonicMinor = std::make_shared<ScaleConstraint>();
-        harmonicMinor->scaleType = "harmonic minor";
-        harmonicMinor->rootNote = mainScale->rootNote;
-        
-        // Calculate harmonic minor scale degrees
-        uint8_t root = harmonicMinor->rootNote;
-        harmonicMinor->allowedNotes = {
-            root,
-            (root + 2) % 12,
-            (root + 3) % 12,
-            (root + 5) % 12,
-            (root + 7) % 12,
-            (root + 8) % 12,
-            (root + 11) % 12 // Raised 7th
-        };
-        
-        // Add common harmonic minor chords
-        std::string rootName = utils::midiNoteToName(root);
-        harmonicMinor->allowedChords = {
-            rootName + "m",                                  // i
-            utils::midiNoteToName((root + 7) % 12) + "7",    // V7 (dominant)
-            utils::midiNoteToName((root + 11) % 12) + "dim7" // vii°7
-        };
-        
-        constraints.push_back(harmonicMinor);
-        
-        // Add melodic minor
-        auto melodicMinor = std::make_shared<ScaleConstraint>();
-        melodicMinor->scaleType = "melodic minor";
-        melodicMinor->rootNote = mainScale->rootNote;
-        
-        // Calculate melodic minor scale degrees (ascending)
-        root = melodicMinor->rootNote;
-        melodicMinor->allowedNotes = {
-            root,
-            (root + 2) % 12,
-            (root + 3) % 12,
-            (root + 5) % 12,
-            (root + 7) % 12,
-            (root + 9) % 12, // Raised 6th
-            (root + 11) % 12 // Raised 7th
-        };
-        
-        // Add common melodic minor chords
-        rootName = utils::midiNoteToName(root);
-        melodicMinor->allowedChords = {
-            rootName + "m6",                                 // i6
-            utils::midiNoteToName((root + 7) % 12) + "7",    // V7
-            utils::midiNoteToName((root + 9) % 12) + "m7b5"  // vi half-diminished
-        };
-        
-        constraints.push_back(melodicMinor);
+        constraints.emplace_back(ScaleMode::HARMONIC_MINOR, root);
+        constraints.emplace_back(ScaleMode::MELODIC_MINOR, root);
     }
     
     return constraints;
 }
 
+const ScaleEntry* KeyDetector::getScaleEntry(const KeySignature& key, ScaleMode* mode) {
+    if (key.scaleDegrees.empty()) {
+        return nullptr;
+    }
+    
+    PitchClassMask notes = pitchClassMask(key.scaleDegrees);
+    uint8_t root = key.scaleDegrees[0] % 12;
+    for (size_t m = 0; m < SCALE_MODE_COUNT; m++) {
+        const ScaleEntry& entry = scaleEntry(root, static_cast<ScaleMode>(m));
+        if (entry.notes == notes) {
+            if (mode) {
+                *mode = static_cast<ScaleMode>(m);
+            }
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+PitchClassMask KeyDetector::getScaleMask(const KeyRegion& region) {
+    uint8_t root = utils::noteNameToMidi(region.rootNote) % 12;
+    return scaleEntry(root, region.isMajor ? ScaleMode::MAJOR : ScaleMode::NATURAL_MINOR).notes;
+}
+
 std::shared_ptr<KeySignature> KeyDetector::getKeySignature(const std::string& keyName) {
+    ensureKeySignatures();
     auto it = keySignatures.find(keyName);
     if (it != keySignatures.end()) {
         return it->second;
@@ -327,6 +334,7 @@ std::shared_ptr<KeySignature> KeyDetector::getKeySignature(const std::string& ke
 }
 
 std::vector<std::string> KeyDetector::getAllKeyNames() const {
+    ensureKeySignatures();
     std::vector<std::string> names;
     names.reserve(keySignatures.size());
     
@@ -337,14 +345,102 @@ std::vector<std::string> KeyDetector::getAllKeyNames() const {
     return names;
 }
 
+void KeyDetector::addToPitchClassHistogram(const std::vector<std::shared_ptr<Chord>>& chords, float* histogram) {
+    for (const auto& chord : chords) {
+        for (uint8_t note : chord->notes) {
+            histogram[note % 12] += 1.0f;
+        }
+    }
+}
+
+void KeyDetector::detectKeys(const float* histograms, size_t rowCount, KeyEstimate* estimates) {
+    const KeyProfileWeights& profileWeights = keyProfileWeights();
+    
+    // Rows are scored a block at a time with one row per lane, so the
+    // multiply-adds and the running best key are plain vector operations
+    // with no per-row branches
+    for (size_t first = 0; first < rowCount; first += ROW_BLOCK) {
+        size_t count = std::min(ROW_BLOCK, rowCount - first);
+        
+        // counts[i][r] is pitch class i of row first + r; missing rows stay empty
+        float counts[12][ROW_BLOCK] = {};
+        for (size_t r = 0; r < count; r++) {
+            for (int i = 0; i < 12; i++) {
+                counts[i][r] = histograms[(first + r) * 12 + i];
+            }
+        }
+        
+        float sum[ROW_BLOCK] = {};
+        float sumOfSquares[ROW_BLOCK] = {};
+        for (int i = 0; i < 12; i++) {
+            for (size_t r = 0; r < ROW_BLOCK; r++) {
+                sum[r] += counts[i][r];
+                sumOfSquares[r] += counts[i][r] * counts[i][r];
+            }
+        }
+        
+        // Best scores are tracked as integers that order like the floats
+        // (sign-magnitude flipped to two's complement), so the comparison
+        // and selection stay branch-free vector integer operations
+        int32_t bestOrder[ROW_BLOCK];
+        int32_t bestKey[ROW_BLOCK];
+        for (size_t r = 0; r < ROW_BLOCK; r++) {
+            bestOrder[r] = INT32_MIN;
+            bestKey[r] = 0;
+        }
+        
+        for (size_t k = 0; k < KEY_COUNT; k++) {
+            float score[ROW_BLOCK] = {};
+            for (int i = 0; i < 12; i++) {
+                float weight = profileWeights.weights[k][i];
+                for (size_t r = 0; r < ROW_BLOCK; r++) {
+                    score[r] += counts[i][r] * weight;
+                }
+            }
+            
+            int32_t bits[ROW_BLOCK];
+            std::memcpy(bits, score, sizeof(bits));
+            
+            // Ties keep the earlier key
+            for (size_t r = 0; r < ROW_BLOCK; r++) {
+                int32_t order = bits[r] ^ ((bits[r] >> 31) & INT32_MAX);
+                int32_t better = -static_cast<int32_t>(order > bestOrder[r]);
+                bestOrder[r] = (order & better) | (bestOrder[r] & ~better);
+                bestKey[r] = (static_cast<int32_t>(k) & better) | (bestKey[r] & ~better);
+            }
+        }
+        
+        float bestScore[ROW_BLOCK];
+        for (size_t r = 0; r < ROW_BLOCK; r++) {
+            bestOrder[r] ^= (bestOrder[r] >> 31) & INT32_MAX;
+        }
+        std::memcpy(bestScore, bestOrder, sizeof(bestScore));
+        
+        for (size_t r = 0; r < count; r++) {
+            // Centred length of the histogram; a flat or empty one fits no key
+            float variance = sumOfSquares[r] - sum[r] * sum[r] / 12.0f;
+            bool flat = !(variance > 1e-6f * sumOfSquares[r]);
+            
+            KeyEstimate& estimate = estimates[first + r];
+            estimate.tonic = flat ? 0 : static_cast<uint8_t>(bestKey[r] % 12);
+            estimate.isMajor = flat || bestKey[r] < 12;
+            estimate.confidence = flat ? 0.0f : bestScore[r] / std::sqrt(variance);
+        }
+    }
+}
+
+std::vector<KeyEstimate> KeyDetector::detectKeys(const std::vector<float>& histograms) {
+    std::vector<KeyEstimate> estimates(histograms.size() / 12);
+    detectKeys(histograms.data(), estimates.size(), estimates.data());
+    return estimates;
+}
+
 int KeyDetector::countNotesInKey(const std::vector<uint8_t>& notes, const std::shared_ptr<KeySignature>& key) {
+    PitchClassMask keyNotes = pitchClassMask(key->scaleDegrees);
     int count = 0;
     
     for (uint8_t note : notes) {
-        uint8_t pitchClass = note % 12;
-        if (std::find(key->scaleDegrees.begin(), key->scaleDegrees.end(), pitchClass) != key->scaleDegrees.end()) {
-            count++;
-        }
+        count += (keyNotes >> (note % 12)) & 1;
     }
     
     return count;
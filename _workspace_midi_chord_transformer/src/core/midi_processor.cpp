@@ -4,6 +4,10 @@
 #include "../../include/core/key_detector.h"
 #include "../../include/core/chord_synthesizer.h"
 #include "../../include/core/action_manager.h"
+#include "../../include/core/harmonic_segmenter.h"
+#include "../../include/core/onset_dendrogram.h"
+#include "../../include/core/session_file.h"
+#include "../../include/core/input_deduplicator.h"
 #include "../../include/utils/midi_utils.h"
 
 #include <fstream>
@@ -17,8 +21,35 @@
 
 namespace midi_transformer {
 
+namespace {
+
+bool sameChord(const Chord& a, const Chord& b) {
+    return a.startTime == b.startTime && a.duration == b.duration && a.name == b.name &&
+           a.notes == b.notes && a.isTransformed == b.isTransformed &&
+           a.originalNotes == b.originalNotes && a.originalName == b.originalName;
+}
+
+bool noteBefore(const Note& note, uint32_t time) {
+    return note.startTime < time;
+}
+
+bool timeBefore(uint32_t time, const Note& note) {
+    return time < note.startTime;
+}
+
+} // namespace
+
 // Constructor
-MidiProcessor::MidiProcessor() : timeTolerance(120) {
+MidiProcessor::MidiProcessor()
+    : fileData(nullptr),
+      fileSize(0),
+      musicHash(0),
+      musicHashValid(false),
+      timeTolerance(120),
+      autoTimeTolerance(true),
+      detectionMode(ChordDetectionMode::ONSET_GROUPING),
+      analysisRequested(false),
+      noteEditCount(0) {
     // Initialize with default values
     midiFile = std::make_unique<MidiFile>();
     progressionAnalyzer = std::make_unique<ChordProgressionAnalyzer>();
@@ -29,45 +60,115 @@ MidiProcessor::MidiProcessor() : timeTolerance(120) {
     
     keyDetector = std::make_unique<KeyDetector>();
     synthesizer = std::make_unique<ChordSynthesizer>();
+    harmonicSegmenter = std::make_unique<HarmonicSegmenter>();
+    onsetDendrogram = std::make_unique<OnsetDendrogram>();
     actionManager = std::make_shared<ActionManager>(*this);
+    
+    defineAnalysisStages();
+}
+
+// Out of line, where the engine types are complete
+MidiProcessor::~MidiProcessor() = default;
+
+void MidiProcessor::defineAnalysisStages() {
+    analysisGraph.define(AnalysisStage::TRACKS, {}, 
+        [this]() { return decodeActiveTracks(); });
+    
+    analysisGraph.define(AnalysisStage::NOTES, {AnalysisStage::TRACKS}, 
+        [this]() { extractNotes(); return true; });
+    
+    analysisGraph.define(AnalysisStage::TOLERANCE, {AnalysisStage::NOTES}, 
+        [this]() {
+            if (autoTimeTolerance) {
+                calibrateTimeTolerance();
+            }
+            return true;
+        });
+    
+    // Detection results are memoized per file, tracks, options and tolerance
+    analysisGraph.define(AnalysisStage::CHORDS, {AnalysisStage::NOTES, AnalysisStage::TOLERANCE}, 
+        [this]() {
+            detectChords();
+            if (noteEditCount == 0) {
+                storeDetection(detectionCacheKey());
+            }
+            chordsReplaced();
+            return true;
+        },
+        [this]() { return restoreDetection(); });
+    
+    analysisGraph.define(AnalysisStage::KEY, {AnalysisStage::CHORDS}, 
+        [this]() { detectKeyTimeline(); return true; });
+    
+    analysisGraph.define(AnalysisStage::PROGRESSIONS, {AnalysisStage::CHORDS}, 
+        [this]() {
+            progressions = progressionAnalyzer->detectProgressions(chords, progressionMatchState);
+            return true;
+        });
 }
 
 // MIDI File I/O Methods
 
 bool MidiProcessor::loadMidiFile(const std::string& filename) {
+    if (!openMidiFile(filename)) {
+        return false;
+    }
+    return analyzeActiveTracks();
+}
+
+bool MidiProcessor::openMidiFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: Could not open file " << filename << std::endl;
         return false;
     }
     
-    // Check if we have a cached analysis for this file
-    std::string fileHash = calculateFileHash(filename);
-    auto cacheIt = detectionCache.find(fileHash);
-    if (cacheIt != detectionCache.end()) {
-        // Use cached chord detection
-        chords = cacheIt->second->detectedChords;
-        currentFilename = filename;
-        return true;
-    }
-    
     // Reset data
     midiFile = std::make_unique<MidiFile>();
+    trackDirectory.clear();
+    activeTracks.clear();
     notes.clear();
+    sustainSpans.clear();
     chords.clear();
+    keyTimeline.clear();
+    progressions.clear();
+    progressionMatchState = ProgressionMatchState();
+    onsetDendrogram->clear();
+    detectedKey.reset();
     currentFilename = filename;
+    loadedOptions = parseOptions;
+    parseStatistics = ParseStatistics();
+    analysisRequested = false;
+    noteEditCount = 0;
+    analysisGraph.invalidateAll();
     
-    // Read file into a buffer
+    // Read file into a buffer; it is kept for decoding tracks on demand
     file.seekg(0, std::ios::end);
-    size_t fileSize = file.tellg();
+    size_t length = file.tellg();
     file.seekg(0, std::ios::beg);
     
-    std::vector<uint8_t> buffer(fileSize);
-    file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
+    sessionView.reset();
+    fileBuffer.assign(length, 0);
+    file.read(reinterpret_cast<char*>(fileBuffer.data()), length);
     file.close();
+    fileData = fileBuffer.data();
+    fileSize = fileBuffer.size();
+    
+    if (!buildTrackDirectory()) {
+        return false;
+    }
+    fileHash = calculateFileHash(fileBuffer);
+    musicHash = 0;
+    musicHashValid = false;
+    
+    return true;
+}
+
+bool MidiProcessor::buildTrackDirectory() {
+    const uint8_t* buffer = fileData;
     
     // Parse MIDI header
-    if (buffer.size() < 14 || 
+    if (fileSize < 14 || 
         buffer[0] != 'M' || buffer[1] != 'T' || 
         buffer[2] != 'h' || buffer[3] != 'd') {
         std::cerr << "Error: Invalid MIDI file header" << std::endl;
@@ -75,147 +176,364 @@ bool MidiProcessor::loadMidiFile(const std::string& filename) {
     }
     
     size_t position = 4;
-    uint32_t headerLength = read32BE(buffer, position);
+    uint32_t headerLength = read32BE(buffer, fileSize, position);
     position += 4;
     
-    midiFile->format = read16BE(buffer, position);
-    position += 2;
-    
-    midiFile->numTracks = read16BE(buffer, position);
-    position += 2;
+    if (headerLength < 6 || 8 + static_cast<size_t>(headerLength) > fileSize) {
+        std::cerr << "Error: Invalid MIDI header length" << std::endl;
+        return false;
+    }
     
-    midiFile->division = read16BE(buffer, position);
-    position += 2;
+    midiFile->format = read16BE(buffer, fileSize, position);
+    midiFile->numTracks = read16BE(buffer, fileSize, position + 2);
+    midiFile->division = read16BE(buffer, fileSize, position + 4);
+    position += headerLength;
     
-    // Parse MIDI tracks
-    for (uint16_t i = 0; i < midiFile->numTracks; i++) {
-        // Check for track header
-        if (position + 8 > buffer.size() || 
-            buffer[position] != 'M' || buffer[position+1] != 'T' || 
-            buffer[position+2] != 'r' || buffer[position+3] != 'k') {
+    // Build the chunk directory; no events are decoded here
+    while (trackDirectory.size() < midiFile->numTracks) {
+        if (position + 8 > fileSize) {
             std::cerr << "Error: Invalid track header at position " << position << std::endl;
             return false;
         }
         
-        position += 4;
-        uint32_t trackLength = read32BE(buffer, position);
-        position += 4;
+        bool isTrack = buffer[position] == 'M' && buffer[position+1] == 'T' && 
+                       buffer[position+2] == 'r' && buffer[position+3] == 'k';
+        uint32_t chunkLength = read32BE(buffer, fileSize, position + 4);
+        position += 8;
         
-        MidiTrack track;
-        size_t trackEnd = position + trackLength;
-        
-        if (trackEnd > buffer.size()) {
+        if (position + chunkLength > fileSize) {
             std::cerr << "Error: Track length exceeds file size" << std::endl;
             return false;
         }
         
-        uint8_t runningStatus = 0;
+        // Unknown chunk types are skipped, as the SMF specification requires
+        if (isTrack) {
+            TrackChunkInfo chunk;
+            chunk.offset = position;
+            chunk.length = chunkLength;
+            chunk.name = peekTrackName(chunk);
+            trackDirectory.push_back(chunk);
+        }
+        position += chunkLength;
+    }
+    
+    midiFile->tracks.resize(trackDirectory.size());
+    for (size_t i = 0; i < trackDirectory.size(); i++) {
+        if (!trackDirectory[i].name.empty()) {
+            midiFile->tracks[i].name = trackDirectory[i].name;
+        }
+    }
+    
+    return true;
+}
+
+bool MidiProcessor::analyzeActiveTracks() {
+    if (fileSize == 0) {
+        std::cerr << "Error: No MIDI file loaded" << std::endl;
+        return false;
+    }
+    
+    // Round-trip loads only need the events for writing back, and tracks
+    // that were never decoded are written straight from their raw chunks
+    if (loadedOptions.profile == ParseProfile::ROUND_TRIP) {
+        return true;
+    }
+    
+    // Decoding, extraction and detection rerun only for what changed since
+    // the last analysis, and detection results come from the cache when
+    // this file was analyzed the same way before
+    analysisRequested = true;
+    return analysisGraph.require(AnalysisStage::CHORDS);
+}
+
+bool MidiProcessor::decodeActiveTracks() {
+    // Round-trip loads are never analyzed
+    if (loadedOptions.profile == ParseProfile::ROUND_TRIP) {
+        return true;
+    }
+    
+    for (size_t index : getActiveTracks()) {
+        if (!decodeTrack(index)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t MidiProcessor::getMusicHash() {
+    // Sessions store the hash, so only files opened from disk compute it
+    if (!musicHashValid) {
+        musicHash = calculateMusicHash(fileBuffer);
+        musicHashValid = true;
+    }
+    return musicHash;
+}
+
+std::string MidiProcessor::detectionCacheKey() {
+    // Channel events, detection mode, parse options, tracks and time
+    // tolerance; files differing only in meta events share results. Edited
+    // notes no longer match the channel events and are never cached.
+    std::string cacheKey = std::to_string(getMusicHash()) + "/" + 
+                           std::to_string(static_cast<int>(detectionMode)) + "/" + 
+                           std::to_string(static_cast<int>(loadedOptions.profile)) + "/" + 
+                           std::to_string(loadedOptions.excludedChannels) + "/";
+    for (size_t index : activeTracks) {
+        cacheKey += std::to_string(index) + ",";
+    }
+    cacheKey += "/" + (autoTimeTolerance ? std::string("auto") : std::to_string(timeTolerance));
+    return cacheKey;
+}
+
+bool MidiProcessor::restoreDetection() {
+    if (noteEditCount > 0) {
+        return false;
+    }
+    auto cacheIt = detectionCache.find(detectionCacheKey());
+    if (cacheIt == detectionCache.end()) {
+        return false;
+    }
+    
+    // Copies, so transformations never reach the cached chords
+    const ChordDetectionCache& cache = *cacheIt->second;
+    chords.clear();
+    chords.reserve(cache.detectedChords.size());
+    for (const auto& chord : cache.detectedChords) {
+        chords.push_back(std::make_shared<Chord>(*chord));
+    }
+    if (autoTimeTolerance) {
+        timeTolerance = cache.timeTolerance;
+        toleranceCalibration = cache.toleranceCalibration;
+    }
+    
+    chordsReplaced();
+    return true;
+}
+
+void MidiProcessor::storeDetection(const std::string& cacheKey) {
+    auto cache = std::make_shared<ChordDetectionCache>();
+    cache->midiFileHash = cacheKey;
+    cache->detectedChords.reserve(chords.size());
+    for (const auto& chord : chords) {
+        cache->detectedChords.push_back(std::make_shared<Chord>(*chord));
+    }
+    cache->timeTolerance = timeTolerance;
+    cache->toleranceCalibration = toleranceCalibration;
+    cache->timestamp = std::chrono::system_clock::now();
+    detectionCache[cacheKey] = cache;
+}
+
+void MidiProcessor::chordsReplaced() {
+    // Chord indices change, so recorded transformations and results read
+    // from the old chords no longer apply
+    keyTimeline.clear();
+    detectedKey.reset();
+    progressions.clear();
+    progressionMatchState = ProgressionMatchState();
+    actionManager->clearHistory();
+}
+
+std::string MidiProcessor::peekTrackName(const TrackChunkInfo& chunk) {
+    // Names sit among the meta events at time zero; stop at the first timed or channel event
+    size_t position = chunk.offset;
+    size_t trackEnd = chunk.offset + chunk.length;
+    
+    while (position < trackEnd) {
+        uint32_t deltaTime = readVariableLength(fileData, fileSize, position);
+        if (deltaTime != 0 || position + 2 > trackEnd || 
+            fileData[position] != static_cast<uint8_t>(MidiEventType::META_EVENT)) {
+            break;
+        }
         
-        // Parse track events
-        while (position < trackEnd) {
-            MidiEvent event;
+        uint8_t metaType = fileData[position + 1];
+        position += 2;
+        uint32_t length = readVariableLength(fileData, fileSize, position);
+        if (position + length > trackEnd) {
+            break;
+        }
+        if (metaType == static_cast<uint8_t>(MetaEventType::TRACK_NAME)) {
+            return std::string(fileData + position, fileData + position + length);
+        }
+        position += length;
+    }
+    
+    return "";
+}
+
+bool MidiProcessor::decodeTrack(size_t index) {
+    if (index >= trackDirectory.size()) {
+        std::cerr << "Error: Track index " << index << " out of range" << std::endl;
+        return false;
+    }
+    
+    TrackChunkInfo& chunk = trackDirectory[index];
+    if (chunk.decoded) {
+        return true;
+    }
+    
+    const uint8_t* buffer = fileData;
+    bool analysisOnly = loadedOptions.profile == ParseProfile::ANALYSIS_ONLY;
+    
+    MidiTrack track;
+    track.name = midiFile->tracks[index].name;
+    size_t position = chunk.offset;
+    size_t trackEnd = chunk.offset + chunk.length;
+    
+    uint8_t runningStatus = 0;
+    
+    // Delta time of events the profile drops, carried into the next kept event
+    uint32_t pendingDelta = 0;
+    
+    // Parse track events
+    while (position < trackEnd) {
+        uint32_t deltaTime = readVariableLength(buffer, fileSize, position);
+        if (position >= trackEnd) {
+            break;
+        }
+        
+        // Read status byte; only channel messages set the running status
+        uint8_t status;
+        if (buffer[position] & 0x80) {
+            status = buffer[position++];
+            if (status < 0xF0) {
+                runningStatus = status;
+            }
+        } else {
+            status = runningStatus;
+        }
+        
+        parseStatistics.totalEvents++;
+        
+        MidiEvent event;
+        event.deltaTime = pendingDelta + deltaTime;
+        event.status = status;
+        bool keep = true;
+        
+        // Handle different event types
+        if (status == static_cast<uint8_t>(MidiEventType::META_EVENT)) {
+            // Meta event
+            uint8_t metaType = buffer[position++];
+            uint32_t length = readVariableLength(buffer, fileSize, position);
+            if (position + length > trackEnd) {
+                std::cerr << "Error: Meta event exceeds track length at position " << position << std::endl;
+                return false;
+            }
             
-            // Read delta time
-            event.deltaTime = readVariableLength(buffer, position);
+            // Extract track name
+            if (metaType == static_cast<uint8_t>(MetaEventType::TRACK_NAME)) {
+                track.name = std::string(buffer + position, buffer + position + length);
+            }
             
-            // Read status byte
-            if (buffer[position] & 0x80) {
-                // This is a status byte
-                event.status = buffer[position++];
-                runningStatus = event.status;
+            if (analysisOnly && !isAnalysisMetaEvent(metaType)) {
+                keep = false;
+                parseStatistics.skippedEvents++;
             } else {
-                // Use running status
-                event.status = runningStatus;
+                event.isMetaEvent = true;
+                event.metaType = metaType;
+                event.data.assign(buffer + position, buffer + position + length);
+            }
+            position += length;
+        } else if (status == static_cast<uint8_t>(MidiEventType::SYSTEM_EXCLUSIVE) || 
+                   status == static_cast<uint8_t>(MidiEventType::SYSTEM_EXCLUSIVE_ESCAPE)) {
+            // System exclusive: keep the length prefix with the payload so the
+            // writer reproduces the event byte for byte
+            size_t dataStart = position;
+            uint32_t length = readVariableLength(buffer, fileSize, position);
+            if (position + length > trackEnd) {
+                std::cerr << "Error: SysEx event exceeds track length at position " << position << std::endl;
+                return false;
             }
+            position += length;
             
-            // Handle different event types
-            if (event.status == 0xFF) {
-                // Meta event
-                event.isMetaEvent = true;
-                event.metaType = buffer[position++];
-                
-                uint32_t length = readVariableLength(buffer, position);
-                event.data.assign(buffer.begin() + position, buffer.begin() + position + length);
-                position += length;
-                
-                // Extract track name
-                if (event.metaType == static_cast<uint8_t>(MetaEventType::TRACK_NAME)) {
-                    track.name = std::string(event.data.begin(), event.data.end());
-                }
+            if (analysisOnly) {
+                keep = false;
+                parseStatistics.skippedEvents++;
             } else {
-                // MIDI event
-                event.isMetaEvent = false;
+                event.data.assign(buffer + dataStart, buffer + position);
+            }
+        } else {
+            // MIDI event
+            uint8_t eventType = status & 0xF0;
+            uint8_t channel = status & 0x0F;
+            
+            size_t dataLength;
+            switch (eventType) {
+                case static_cast<uint8_t>(MidiEventType::NOTE_OFF):
+                case static_cast<uint8_t>(MidiEventType::NOTE_ON):
+                case static_cast<uint8_t>(MidiEventType::POLY_AFTERTOUCH):
+                case static_cast<uint8_t>(MidiEventType::CONTROL_CHANGE):
+                case static_cast<uint8_t>(MidiEventType::PITCH_BEND):
+                    // Two data bytes
+                    dataLength = 2;
+                    break;
                 
-                uint8_t eventType = event.status & 0xF0;
-                uint8_t channel = event.status & 0x0F;
+                case static_cast<uint8_t>(MidiEventType::PROGRAM_CHANGE):
+                case static_cast<uint8_t>(MidiEventType::CHANNEL_AFTERTOUCH):
+                    // These events have 1 data byte
+                    dataLength = 1;
+                    break;
                 
-                switch (eventType) {
-                    case static_cast<uint8_t>(MidiEventType::NOTE_OFF):
-                    case static_cast<uint8_t>(MidiEventType::NOTE_ON):
-                        // Note events have 2 data bytes
-                        event.data.push_back(buffer[position++]); // Note number
-                        event.data.push_back(buffer[position++]); // Velocity
-                        break;
-                        
-                    case static_cast<uint8_t>(MidiEventType::POLY_AFTERTOUCH):
-                        // Polyphonic aftertouch has 2 data bytes
-                        event.data.push_back(buffer[position++]); // Note number
-                        event.data.push_back(buffer[position++]); // Pressure
-                        break;
-                        
-                    case static_cast<uint8_t>(MidiEventType::CONTROL_CHANGE):
-                        // Control change has 2 data bytes
-                        event.data.push_back(buffer[position++]); // Controller number
-                        event.data.push_back(buffer[position++]); // Value
-                        break;
-                        
-                    case static_cast<uint8_t>(MidiEventType::PROGRAM_CHANGE):
-                    case static_cast<uint8_t>(MidiEventType::CHANNEL_AFTERTOUCH):
-                        // These events have 1 data byte
-                        event.data.push_back(buffer[position++]);
-                        break;
-                        
-                    case static_cast<uint8_t>(MidiEventType::PITCH_BEND):
-                        // Pitch bend has 2 data bytes
-                        event.data.push_back(buffer[position++]); // LSB
-                        event.data.push_back(buffer[position++]); // MSB
-                        break;
-                        
-                    default:
-                        // Unknown event type, try to recover
-                        std::cerr << "Warning: Unknown event type 0x" 
-                                  << std::hex << static_cast<int>(eventType) 
-                                  << " at position " << std::dec << position << std::endl;
-                        
-                        // Skip to the next status byte
-                        while (position < trackEnd && !(buffer[position] & 0x80)) {
-                            position++;
-                        }
-                        continue;
+                default:
+                    // Unknown event type, try to recover
+                    std::cerr << "Warning: Unknown event type 0x" 
+                              << std::hex << static_cast<int>(eventType) 
+                              << " at position " << std::dec << position << std::endl;
+                    
+                    // Skip to the next status byte
+                    while (position < trackEnd && !(buffer[position] & 0x80)) {
+                        position++;
+                    }
+                    parseStatistics.skippedEvents++;
+                    pendingDelta = event.deltaTime;
+                    continue;
+            }
+            
+            if (position + dataLength > trackEnd) {
+                std::cerr << "Error: MIDI event exceeds track length at position " << position << std::endl;
+                return false;
+            }
+            
+            if (analysisOnly) {
+                // Chord analysis only reads notes and the sustain pedal
+                bool needed = eventType == static_cast<uint8_t>(MidiEventType::NOTE_ON) || 
+                              eventType == static_cast<uint8_t>(MidiEventType::NOTE_OFF) || 
+                              (eventType == static_cast<uint8_t>(MidiEventType::CONTROL_CHANGE) && 
+                               buffer[position] == 64);
+                if (!needed) {
+                    keep = false;
+                    parseStatistics.skippedEvents++;
+                } else if (loadedOptions.excludedChannels & (1u << channel)) {
+                    keep = false;
+                    parseStatistics.excludedChannelEvents++;
                 }
             }
             
-            track.events.push_back(event);
+            if (keep) {
+                event.data.assign(buffer + position, buffer + position + dataLength);
+            }
+            position += dataLength;
         }
         
-        midiFile->tracks.push_back(track);
+        if (keep) {
+            track.events.push_back(std::move(event));
+            parseStatistics.keptEvents++;
+            pendingDelta = 0;
+        } else {
+            pendingDelta = event.deltaTime;
+        }
     }
     
-    // Extract notes and detect chords
-    extractNotes();
-    detectChords();
-    
-    // Cache the results
-    auto cache = std::make_shared<ChordDetectionCache>();
-    cache->midiFileHash = fileHash;
-    cache->detectedChords = chords;
-    cache->timestamp = std::chrono::system_clock::now();
-    detectionCache[fileHash] = cache;
-    
+    midiFile->tracks[index] = std::move(track);
+    chunk.decoded = true;
     return true;
 }
 
 bool MidiProcessor::writeMidiFile(const std::string& filename) {
+    if (loadedOptions.profile == ParseProfile::ANALYSIS_ONLY) {
+        std::cerr << "Error: " << currentFilename 
+                  << " was loaded for analysis only and cannot be written back" << std::endl;
+        return false;
+    }
+    
     std::ofstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: Could not open file " << filename << " for writing" << std::endl;
@@ -238,13 +556,23 @@ bool MidiProcessor::writeMidiFile(const std::string& filename) {
     write16BE(buffer, midiFile->format);
     
     // Number of tracks
-    write16BE(buffer, midiFile->numTracks);
+    write16BE(buffer, static_cast<uint16_t>(midiFile->tracks.size()));
     
     // Division (ticks per quarter note)
     write16BE(buffer, midiFile->division);
     
     // Write each track
-    for (const auto& track : midiFile->tracks) {
+    for (size_t trackIndex = 0; trackIndex < midiFile->tracks.size(); trackIndex++) {
+        const MidiTrack& track = midiFile->tracks[trackIndex];
+        
+        // Tracks that were never decoded are copied from the loaded file unchanged
+        if (trackIndex < trackDirectory.size() && !trackDirectory[trackIndex].decoded) {
+            const TrackChunkInfo& chunk = trackDirectory[trackIndex];
+            buffer.insert(buffer.end(), fileData + chunk.offset - 8, 
+                          fileData + chunk.offset + chunk.length);
+            continue;
+        }
+        
         // Track header
         buffer.push_back('M');
         buffer.push_back('T');
@@ -291,12 +619,26 @@ bool MidiProcessor::writeMidiFile(const std::string& filename) {
     return true;
 }
 
-uint32_t MidiProcessor::readVariableLength(const std::vector<uint8_t>& data, size_t& position) {
+bool MidiProcessor::isAnalysisMetaEvent(uint8_t metaType) {
+    // Timing, key and naming information; text, lyrics and the like are dropped
+    switch (metaType) {
+        case static_cast<uint8_t>(MetaEventType::TRACK_NAME):
+        case static_cast<uint8_t>(MetaEventType::END_OF_TRACK):
+        case static_cast<uint8_t>(MetaEventType::SET_TEMPO):
+        case static_cast<uint8_t>(MetaEventType::TIME_SIGNATURE):
+        case static_cast<uint8_t>(MetaEventType::KEY_SIGNATURE):
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t MidiProcessor::readVariableLength(const uint8_t* data, size_t size, size_t& position) {
     uint32_t value = 0;
     uint8_t byte;
     
     do {
-        if (position >= data.size()) {
+        if (position >= size) {
             std::cerr << "Error: Unexpected end of data while reading variable length value" << std::endl;
             return 0;
         }
@@ -323,8 +665,8 @@ void MidiProcessor::writeVariableLength(std::vector<uint8_t>& data, uint32_t val
     }
 }
 
-uint16_t MidiProcessor::read16BE(const std::vector<uint8_t>& data, size_t position) {
-    if (position + 1 >= data.size()) {
+uint16_t MidiProcessor::read16BE(const uint8_t* data, size_t size, size_t position) {
+    if (position + 1 >= size) {
         std::cerr << "Error: Unexpected end of data while reading 16-bit value" << std::endl;
         return 0;
     }
@@ -337,8 +679,8 @@ void MidiProcessor::write16BE(std::vector<uint8_t>& data, uint16_t value) {
     data.push_back(value & 0xFF);
 }
 
-uint32_t MidiProcessor::read32BE(const std::vector<uint8_t>& data, size_t position) {
-    if (position + 3 >= data.size()) {
+uint32_t MidiProcessor::read32BE(const uint8_t* data, size_t size, size_t position) {
+    if (position + 3 >= size) {
         std::cerr << "Error: Unexpected end of data while reading 32-bit value" << std::endl;
         return 0;
     }
@@ -358,23 +700,35 @@ void MidiProcessor::write32BE(std::vector<uint8_t>& data, uint32_t value) {
 
 void MidiProcessor::extractNotes() {
     notes.clear();
+    sustainSpans.clear();
+    onsetDendrogram->clear();
     
     // Map to track active notes (key: note number, value: {start time, velocity, channel})
     std::unordered_map<uint8_t, std::tuple<uint32_t, uint8_t, uint8_t>> activeNotes;
     
+    // Sustain pedal state per channel (start time of the pedal press, if down)
+    bool pedalDown[16] = {};
+    uint32_t pedalStart[16] = {};
+    
     // Process each track
     uint32_t absoluteTime = 0;
     
-    for (const auto& track : midiFile->tracks) {
+    for (size_t trackIndex : getActiveTracks()) {
+        const MidiTrack& track = midiFile->tracks[trackIndex];
         absoluteTime = 0;
+        std::fill(std::begin(pedalDown), std::end(pedalDown), false);
         
         for (const auto& event : track.events) {
             absoluteTime += event.deltaTime;
             
-            if (!event.isMetaEvent) {
+            if (!event.isMetaEvent && event.status < 0xF0) {
                 uint8_t eventType = event.status & 0xF0;
                 uint8_t channel = event.status & 0x0F;
                 
+                if (loadedOptions.excludedChannels & (1u << channel)) {
+                    continue;
+                }
+                
                 if (eventType == static_cast<uint8_t>(MidiEventType::NOTE_ON) && 
                     event.data.size() >= 2) {
                     
@@ -416,10 +770,29 @@ void MidiProcessor::extractNotes() {
                         
                         activeNotes.erase(it);
                     }
+                } else if (eventType == static_cast<uint8_t>(MidiEventType::CONTROL_CHANGE) && 
+                           event.data.size() >= 2 && event.data[0] == 64) {
+                    
+                    // Sustain pedal: values of 64 and above hold, below release
+                    bool down = event.data[1] >= 64;
+                    if (down && !pedalDown[channel]) {
+                        pedalDown[channel] = true;
+                        pedalStart[channel] = absoluteTime;
+                    } else if (!down && pedalDown[channel]) {
+                        pedalDown[channel] = false;
+                        sustainSpans.emplace_back(channel, pedalStart[channel], absoluteTime);
+                    }
                 }
             }
         }
         
+        // Release any pedal still held at the end of the track
+        for (uint8_t channel = 0; channel < 16; channel++) {
+            if (pedalDown[channel]) {
+                sustainSpans.emplace_back(channel, pedalStart[channel], absoluteTime);
+            }
+        }
+        
         // Handle any notes that are still active at the end of the track
         for (const auto& [noteNumber, noteInfo] : activeNotes) {
             uint32_t startTime = std::get<0>(noteInfo);
@@ -437,6 +810,23 @@ void MidiProcessor::extractNotes() {
     // Sort notes by start time
     std::sort(notes.begin(), notes.end(), 
               [](const Note& a, const Note& b) { return a.startTime < b.startTime; });
+    
+    // Sort pedal spans per channel and merge spans that overlap across tracks
+    std::sort(sustainSpans.begin(), sustainSpans.end(), 
+              [](const SustainSpan& a, const SustainSpan& b) {
+                  return a.channel != b.channel ? a.channel < b.channel : a.startTime < b.startTime;
+              });
+    
+    std::vector<SustainSpan> mergedSpans;
+    for (const auto& span : sustainSpans) {
+        if (!mergedSpans.empty() && mergedSpans.back().channel == span.channel && 
+            span.startTime <= mergedSpans.back().endTime) {
+            mergedSpans.back().endTime = std::max(mergedSpans.back().endTime, span.endTime);
+        } else {
+            mergedSpans.push_back(span);
+        }
+    }
+    sustainSpans.swap(mergedSpans);
 }
 
 void MidiProcessor::detectChords() {
@@ -446,62 +836,38 @@ void MidiProcessor::detectChords() {
         return;
     }
     
-    // Group notes by start time (with tolerance)
-    std::unordered_map<uint32_t, std::vector<uint8_t>> timeToNotes;
-    std::vector<uint32_t> chordStartTimes;
+    if (detectionMode == ChordDetectionMode::HARMONIC_SEGMENTATION) {
+        detectChordsFromSegments();
+        return;
+    }
     
-    for (const auto& note : notes) {
-        // Find a matching chord start time within tolerance
-        bool foundMatch = false;
-        for (uint32_t startTime : chordStartTimes) {
-            if (std::abs(static_cast<int>(note.startTime) - static_cast<int>(startTime)) <= static_cast<int>(timeTolerance)) {
-                timeToNotes[startTime].push_back(note.pitch);
-                foundMatch = true;
-                break;
-            }
-        }
-        
-        if (!foundMatch) {
-            // Create a new chord start time
-            chordStartTimes.push_back(note.startTime);
-            timeToNotes[note.startTime].push_back(note.pitch);
-        }
+    // Single-linkage onset clusters for every tolerance, built once per note set
+    if (!onsetDendrogram->isBuilt()) {
+        onsetDendrogram->build(notes);
     }
     
-    // Sort chord start times
-    std::sort(chordStartTimes.begin(), chordStartTimes.end());
+    std::vector<OnsetGroup> groups = onsetDendrogram->groupsForTolerance(timeTolerance);
     
     // Create chords
-    for (size_t i = 0; i < chordStartTimes.size(); i++) {
-        uint32_t startTime = chordStartTimes[i];
-        std::vector<uint8_t> chordNotes = timeToNotes[startTime];
-        
-        // Remove duplicates
-        std::sort(chordNotes.begin(), chordNotes.end());
-        chordNotes.erase(std::unique(chordNotes.begin(), chordNotes.end()), chordNotes.end());
+    for (size_t i = 0; i < groups.size(); i++) {
+        const OnsetGroup& group = groups[i];
+        std::vector<uint8_t> chordNotes = onsetDendrogram->groupPitches(group);
         
         // Only consider groups of 3 or more notes as chords
         if (chordNotes.size() >= 3) {
             auto chord = std::make_shared<Chord>();
-            chord->notes = chordNotes;
-            chord->startTime = startTime;
+            chord->startTime = group.startTime;
             
             // Calculate duration (until next chord or end)
-            if (i < chordStartTimes.size() - 1) {
-                chord->duration = chordStartTimes[i + 1] - startTime;
+            if (i < groups.size() - 1) {
+                chord->duration = groups[i + 1].startTime - group.startTime;
             } else {
                 // Last chord - use the longest note duration
-                uint32_t maxDuration = 0;
-                for (const auto& note : notes) {
-                    if (std::abs(static_cast<int>(note.startTime) - static_cast<int>(startTime)) <= static_cast<int>(timeTolerance)) {
-                        maxDuration = std::max(maxDuration, note.duration);
-                    }
-                }
-                chord->duration = maxDuration;
+                chord->duration = onsetDendrogram->groupMaxDuration(group);
             }
             
-            // Identify chord name
-            chord->name = identifyChord(chordNotes);
+            chord->name = chordNameFor(chordNotes);
+            chord->notes = std::move(chordNotes);
             chord->isTransformed = false;
             
             chords.push_back(chord);
@@ -509,6 +875,29 @@ void MidiProcessor::detectChords() {
     }
 }
 
+void MidiProcessor::detectChordsFromSegments() {
+    // Segments shorter than the time tolerance are treated as passing overlaps
+    SegmentationOptions segmentOptions = harmonicSegmenter->getOptions();
+    segmentOptions.minSegmentDuration = timeTolerance;
+    harmonicSegmenter->setOptions(segmentOptions);
+    
+    auto segments = harmonicSegmenter->segment(notes, sustainSpans);
+    
+    for (auto& segment : segments) {
+        auto chord = std::make_shared<Chord>();
+        chord->startTime = segment.startTime;
+        chord->duration = segment.duration;
+        
+        // Name the chord from its close-position reduction so doubled and
+        // widely spread pedal voicings still match known chord shapes
+        chord->name = identifyChord(HarmonicSegmenter::reduceToClosePosition(segment.notes));
+        chord->notes = std::move(segment.notes);
+        chord->isTransformed = false;
+        
+        chords.push_back(chord);
+    }
+}
+
 std::vector<int> MidiProcessor::normalizeChord(const std::vector<uint8_t>& notes) {
     if (notes.empty()) {
         return {};
@@ -529,6 +918,16 @@ std::vector<int> MidiProcessor::normalizeChord(const std::vector<uint8_t>& notes
     return intervals;
 }
 
+std::string MidiProcessor::chordNameFor(const std::vector<uint8_t>& chordNotes) {
+    // The same voicing recurs often, so names are memoized
+    std::string noteKey(chordNotes.begin(), chordNotes.end());
+    auto nameIt = chordNameCache.find(noteKey);
+    if (nameIt == chordNameCache.end()) {
+        nameIt = chordNameCache.emplace(noteKey, identifyChord(chordNotes)).first;
+    }
+    return nameIt->second;
+}
+
 std::string MidiProcessor::identifyChord(const std::vector<uint8_t>& notes) {
     if (notes.size() < 3) {
         return "N/A";
@@ -694,6 +1093,16 @@ void MidiProcessor::transformSelectedChords(
     std::vector<std::shared_ptr<Chord>> originalChords;
     std::vector<std::shared_ptr<Chord>> transformedChords;
     
+    // Key-constrained transforms without a key of their own use the
+    // detected key at each chord
+    TransformationOptions keyOptions;
+    for (size_t i = 0; i < selectedIndices.size(); i++) {
+        if (options[i]->type == TransformationType::KEY_CONSTRAINED && options[i]->keyScale == 0) {
+            requireAnalysis(AnalysisStage::KEY);
+            break;
+        }
+    }
+    
     for (size_t i = 0; i < selectedIndices.size(); i++) {
         int index = selectedIndices[i];
         if (index < 0 || index >= static_cast<int>(chords.size())) {
@@ -710,13 +1119,22 @@ void MidiProcessor::transformSelectedChords(
             chord->originalName = chord->name;
         }
         
+        const TransformationOptions* chordOptions = options[i].get();
+        if (chordOptions->type == TransformationType::KEY_CONSTRAINED && chordOptions->keyScale == 0) {
+            keyOptions = *chordOptions;
+            keyOptions.keyScale = keyScaleAt(chord->startTime);
+            chordOptions = &keyOptions;
+        }
+        
         // Use the VoiceLeadingEngine for transformation
         std::vector<uint8_t> newNotes = transformChord(
-            chord->notes, targetChordNames[i], *options[i]);
+            chord->notes, targetChordNames[i], *chordOptions);
         
-        // Update the chord
+        // Update the chord; snapping to the key can change the chord itself,
+        // so key-constrained chords are named from their new notes
         chord->notes = newNotes;
-        chord->name = targetChordNames[i];
+        chord->name = chordOptions->type == TransformationType::KEY_CONSTRAINED ? 
+                      chordNameFor(newNotes) : targetChordNames[i];
         chord->isTransformed = true;
         
         // Store transformed chord
@@ -728,9 +1146,43 @@ void MidiProcessor::transformSelectedChords(
         actionManager->recordTransformation(
             selectedIndices, originalChords, transformedChords,
             "Transform " + std::to_string(selectedIndices.size()) + " chords");
+        chordsEdited(selectedIndices);
     }
 }
 
+void MidiProcessor::constrainChordsToKey(const std::vector<int>& selectedIndices) {
+    std::vector<int> indices = selectedIndices;
+    if (indices.empty()) {
+        for (size_t i = 0; i < chords.size(); i++) {
+            indices.push_back(static_cast<int>(i));
+        }
+    }
+    
+    auto options = std::make_shared<TransformationOptions>();
+    options->type = TransformationType::KEY_CONSTRAINED;
+    
+    std::vector<std::string> targetChordNames;
+    targetChordNames.reserve(indices.size());
+    for (int index : indices) {
+        bool valid = index >= 0 && index < static_cast<int>(chords.size());
+        targetChordNames.push_back(valid ? chords[index]->name : std::string());
+    }
+    
+    std::vector<std::shared_ptr<TransformationOptions>> chordOptions(indices.size(), options);
+    transformSelectedChords(indices, targetChordNames, chordOptions);
+}
+
+uint16_t MidiProcessor::keyScaleAt(uint32_t time) const {
+    // Last region starting at or before the tick; the first region also
+    // covers anything earlier
+    auto it = std::upper_bound(keyTimeline.begin(), keyTimeline.end(), time,
+        [](uint32_t tick, const KeyRegion& region) { return tick < region.startTime; });
+    if (it != keyTimeline.begin()) {
+        --it;
+    }
+    return it != keyTimeline.end() ? KeyDetector::getScaleMask(*it) : 0;
+}
+
 void MidiProcessor::switchTonality(size_t chordIndex) {
     if (chordIndex >= chords.size()) {
         return;
@@ -794,46 +1246,490 @@ void MidiProcessor::switchTonality(size_t chordIndex) {
         
         actionManager->recordTransformation(
             indices, before, after, "Switch tonality of chord " + std::to_string(chordIndex));
+        chordsEdited(indices);
     }
 }
 
-// Utility Methods
+// Note Editing
 
-std::string MidiProcessor::calculateFileHash(const std::string& filename) {
-    // Simple hash function for demonstration
-    // In a real implementation, use a proper hash algorithm like MD5 or SHA-1
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        return "";
+const std::vector<Note>& MidiProcessor::getNotes() const {
+    return notes;
+}
+
+bool MidiProcessor::insertNote(const Note& note, ChordDiff& diff) {
+    return editNotes(nullptr, &note, "Insert note " + std::to_string(note.pitch) + 
+                     " at " + std::to_string(note.startTime), diff);
+}
+
+bool MidiProcessor::removeNote(const Note& note, ChordDiff& diff) {
+    return editNotes(&note, nullptr, "Remove note " + std::to_string(note.pitch) + 
+                     " at " + std::to_string(note.startTime), diff);
+}
+
+bool MidiProcessor::moveNote(const Note& note, uint32_t newStartTime, uint8_t newPitch, ChordDiff& diff) {
+    size_t index = findNote(note);
+    if (index >= notes.size()) {
+        std::cerr << "Error: Note " << static_cast<int>(note.pitch) << " at " 
+                  << note.startTime << " not found" << std::endl;
+        return false;
     }
     
-    std::stringstream ss;
-    ss << file.rdbuf();
-    std::string content = ss.str();
+    Note moved = notes[index];
+    moved.startTime = newStartTime;
+    moved.pitch = newPitch;
+    return editNotes(&note, &moved, "Move note " + std::to_string(note.pitch) + 
+                     " to " + std::to_string(newStartTime), diff);
+}
+
+bool MidiProcessor::editNotes(const Note* removeNote, const Note* addNote, 
+                              const std::string& description, ChordDiff& diff) {
+    diff.hunks.clear();
     
-    size_t hash = 0;
-    for (char c : content) {
-        hash = hash * 31 + c;
+    // Edits patch the current notes and chords, so bring both up to date first
+    if (!requireAnalysis(AnalysisStage::NOTES) || !requireAnalysis(AnalysisStage::CHORDS)) {
+        std::cerr << "Error: No analyzed notes to edit" << std::endl;
+        return false;
     }
     
+    size_t removeIndex = notes.size();
+    if (removeNote) {
+        removeIndex = findNote(*removeNote);
+        if (removeIndex >= notes.size()) {
+            std::cerr << "Error: Note " << static_cast<int>(removeNote->pitch) << " at " 
+                      << removeNote->startTime << " not found" << std::endl;
+            return false;
+        }
+    }
+    if (addNote && addNote->pitch > 127) {
+        std::cerr << "Error: Invalid note pitch " << static_cast<int>(addNote->pitch) << std::endl;
+        return false;
+    }
+    
+    // Time windows holding whole onset groups both before and after the
+    // edit: the old group of a removed note and the new group of an added one
+    bool segmented = detectionMode == ChordDetectionMode::HARMONIC_SEGMENTATION;
+    std::vector<std::pair<uint32_t, uint32_t>> windows;
+    NoteEdit edit;
+    
+    if (removeNote) {
+        if (!segmented) {
+            auto [first, end] = onsetGroupSpan(notes[removeIndex].startTime);
+            windows.push_back({notes[first].startTime, notes[end - 1].startTime});
+        }
+        edit.removedNotes.push_back(notes[removeIndex]);
+        if (!addNote) {
+            notes.erase(notes.begin() + removeIndex);
+        }
+    }
+    
+    if (addNote) {
+        if (removeNote) {
+            replaceNoteSorted(removeIndex, *addNote);
+        } else {
+            insertNoteSorted(*addNote);
+        }
+        edit.addedNotes.push_back(*addNote);
+        if (!segmented) {
+            auto [first, end] = onsetGroupSpan(addNote->startTime);
+            windows.push_back({notes[first].startTime, notes[end - 1].startTime});
+        }
+    }
+    
+    if (segmented) {
+        // Segments depend on note ends and pedal spans across the whole
+        // file, so detect again and keep only what changed
+        std::vector<std::shared_ptr<Chord>> previous = chords;
+        detectChords();
+        std::vector<std::shared_ptr<Chord>> detected;
+        detected.swap(chords);
+        chords.swap(previous);
+        replaceChords(0, chords.size(), std::move(detected), diff);
+    } else {
+        // Overlapping windows regroup together, in time order
+        std::sort(windows.begin(), windows.end());
+        for (size_t i = 0; i < windows.size(); i++) {
+            uint32_t firstTime = windows[i].first;
+            uint32_t lastTime = windows[i].second;
+            while (i + 1 < windows.size() && windows[i + 1].first <= lastTime) {
+                lastTime = std::max(lastTime, windows[++i].second);
+            }
+            regroupWindow(firstTime, lastTime, diff);
+        }
+    }
+    
+    edit.chordDiff = diff;
+    notesEdited(diff);
+    actionManager->recordNoteEdit(edit, description);
+    return true;
+}
+
+void MidiProcessor::applyNoteEdit(const NoteEdit& edit, bool revert) {
+    const std::vector<Note>& removeNotes = revert ? edit.addedNotes : edit.removedNotes;
+    const std::vector<Note>& addNotes = revert ? edit.removedNotes : edit.addedNotes;
+    
+    if (removeNotes.size() == 1 && addNotes.size() == 1 && findNote(removeNotes[0]) < notes.size()) {
+        replaceNoteSorted(findNote(removeNotes[0]), addNotes[0]);
+    } else {
+        for (const Note& note : removeNotes) {
+            size_t index = findNote(note);
+            if (index < notes.size()) {
+                notes.erase(notes.begin() + index);
+            }
+        }
+        for (const Note& note : addNotes) {
+            insertNoteSorted(note);
+        }
+    }
+    
+    const auto& hunks = edit.chordDiff.hunks;
+    if (revert) {
+        for (size_t i = hunks.size(); i-- > 0;) {
+            applyHunk(hunks[i], true);
+        }
+    } else {
+        for (const auto& hunk : hunks) {
+            applyHunk(hunk, false);
+        }
+    }
+    
+    notesEdited(edit.chordDiff);
+}
+
+size_t MidiProcessor::findNote(const Note& note) const {
+    auto it = std::lower_bound(notes.begin(), notes.end(), note.startTime, noteBefore);
+    for (; it != notes.end() && it->startTime == note.startTime; ++it) {
+        if (it->pitch == note.pitch && it->channel == note.channel) {
+            return it - notes.begin();
+        }
+    }
+    return notes.size();
+}
+
+void MidiProcessor::insertNoteSorted(const Note& note) {
+    // After notes with the same start, where a stable sort by start time puts it
+    auto it = std::upper_bound(notes.begin(), notes.end(), note.startTime, timeBefore);
+    notes.insert(it, note);
+}
+
+void MidiProcessor::replaceNoteSorted(size_t index, const Note& note) {
+    // A moved note usually lands close by, so shift only the notes between
+    // its old and new places rather than erasing and inserting
+    size_t target = std::upper_bound(notes.begin(), notes.end(), note.startTime, timeBefore) - notes.begin();
+    if (target > index) {
+        std::rotate(notes.begin() + index, notes.begin() + index + 1, notes.begin() + target);
+        notes[target - 1] = note;
+    } else {
+        std::rotate(notes.begin() + target, notes.begin() + index, notes.begin() + index + 1);
+        notes[target] = note;
+    }
+}
+
+std::pair<size_t, size_t> MidiProcessor::onsetGroupSpan(uint32_t time) const {
+    // Walk out from the onset while consecutive onsets stay within the tolerance
+    size_t first = std::lower_bound(notes.begin(), notes.end(), time, noteBefore) - notes.begin();
+    uint32_t onset = time;
+    while (first > 0 && onset - notes[first - 1].startTime <= timeTolerance) {
+        onset = notes[--first].startTime;
+    }
+    
+    size_t end = std::upper_bound(notes.begin(), notes.end(), time, timeBefore) - notes.begin();
+    onset = time;
+    while (end < notes.size() && notes[end].startTime - onset <= timeTolerance) {
+        onset = notes[end++].startTime;
+    }
+    return {first, end};
+}
+
+std::pair<size_t, size_t> MidiProcessor::chordRange(uint32_t firstTime, uint32_t lastTime) const {
+    auto first = std::lower_bound(chords.begin(), chords.end(), firstTime,
+        [](const std::shared_ptr<Chord>& chord, uint32_t time) { return chord->startTime < time; });
+    auto end = std::upper_bound(first, chords.end(), lastTime,
+        [](uint32_t time, const std::shared_ptr<Chord>& chord) { return time < chord->startTime; });
+    return {static_cast<size_t>(first - chords.begin()), static_cast<size_t>(end - chords.begin())};
+}
+
+void MidiProcessor::regroupWindow(uint32_t firstTime, uint32_t lastTime, ChordDiff& diff) {
+    // Same grouping as detectChords, over the notes of the window only
+    size_t first = std::lower_bound(notes.begin(), notes.end(), firstTime, noteBefore) - notes.begin();
+    size_t end = std::upper_bound(notes.begin(), notes.end(), lastTime, timeBefore) - notes.begin();
+    auto [oldFirst, oldEnd] = chordRange(firstTime, lastTime);
+    
+    std::vector<std::shared_ptr<Chord>> newChords;
+    size_t firstChord = oldFirst;
+    
+    // A chord lasts until the next group starts, so the chord of the group
+    // just before the window changes when the window's first onset does
+    if (first > 0 && oldFirst > 0) {
+        auto [groupFirst, groupEnd] = onsetGroupSpan(notes[first - 1].startTime);
+        const Chord& previous = *chords[oldFirst - 1];
+        if (previous.startTime == notes[groupFirst].startTime) {
+            auto updated = std::make_shared<Chord>(previous);
+            if (first < notes.size()) {
+                updated->duration = notes[first].startTime - previous.startTime;
+            } else {
+                updated->duration = 0;
+                for (size_t i = groupFirst; i < groupEnd; i++) {
+                    updated->duration = std::max(updated->duration, notes[i].duration);
+                }
+            }
+            firstChord = oldFirst - 1;
+            newChords.push_back(updated);
+        }
+    }
+    
+    for (size_t i = first; i < end;) {
+        PitchSet pitches;
+        uint32_t longest = 0;
+        uint32_t onset = notes[i].startTime;
+        size_t groupEnd = i;
+        while (groupEnd < end && notes[groupEnd].startTime - onset <= timeTolerance) {
+            onset = notes[groupEnd].startTime;
+            pitches.add(notes[groupEnd].pitch);
+            longest = std::max(longest, notes[groupEnd].duration);
+            groupEnd++;
+        }
+        
+        std::vector<uint8_t> chordNotes = pitches.toNotes();
+        if (chordNotes.size() >= 3) {
+            auto chord = std::make_shared<Chord>();
+            chord->startTime = notes[i].startTime;
+            
+            // A transformed chord whose detected notes did not change keeps its transformation
+            auto [sameFirst, sameEnd] = chordRange(chord->startTime, chord->startTime);
+            for (size_t c = std::max(sameFirst, oldFirst); c < std::min(sameEnd, oldEnd); c++) {
+                const Chord& old = *chords[c];
+                if ((old.isTransformed ? old.originalNotes : old.notes) == chordNotes) {
+                    *chord = old;
+                    break;
+                }
+            }
+            
+            if (!chord->isTransformed) {
+                chord->name = chordNameFor(chordNotes);
+                chord->notes = std::move(chordNotes);
+            }
+            chord->duration = groupEnd < notes.size() ? notes[groupEnd].startTime - chord->startTime : longest;
+            newChords.push_back(chord);
+        }
+        i = groupEnd;
+    }
+    
+    replaceChords(firstChord, oldEnd, std::move(newChords), diff);
+}
+
+void MidiProcessor::replaceChords(size_t firstChord, size_t endChord,
+                                  std::vector<std::shared_ptr<Chord>> newChords, ChordDiff& diff) {
+    // Keep the diff minimal: chords equal at either end are left alone
+    size_t prefix = 0;
+    while (prefix < newChords.size() && firstChord + prefix < endChord &&
+           sameChord(*chords[firstChord + prefix], *newChords[prefix])) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < newChords.size() - prefix && firstChord + prefix + suffix < endChord &&
+           sameChord(*chords[endChord - 1 - suffix], *newChords[newChords.size() - 1 - suffix])) {
+        suffix++;
+    }
+    
+    ChordHunk hunk;
+    hunk.firstChord = firstChord + prefix;
+    for (size_t c = firstChord + prefix; c < endChord - suffix; c++) {
+        hunk.removed.push_back(*chords[c]);
+    }
+    for (size_t c = prefix; c < newChords.size() - suffix; c++) {
+        hunk.added.push_back(*newChords[c]);
+    }
+    if (hunk.removed.empty() && hunk.added.empty()) {
+        return;
+    }
+    
+    auto from = chords.begin() + hunk.firstChord;
+    if (hunk.removed.size() == hunk.added.size()) {
+        std::move(newChords.begin() + prefix, newChords.end() - suffix, from);
+    } else {
+        from = chords.erase(from, from + hunk.removed.size());
+        chords.insert(from, std::make_move_iterator(newChords.begin() + prefix),
+                      std::make_move_iterator(newChords.end() - suffix));
+    }
+    diff.hunks.push_back(std::move(hunk));
+}
+
+void MidiProcessor::applyHunk(const ChordHunk& hunk, bool revert) {
+    const std::vector<Chord>& from = revert ? hunk.added : hunk.removed;
+    const std::vector<Chord>& to = revert ? hunk.removed : hunk.added;
+    if (hunk.firstChord + from.size() > chords.size()) {
+        std::cerr << "Error: Chord diff does not match the chord list" << std::endl;
+        return;
+    }
+    
+    std::vector<std::shared_ptr<Chord>> replacement;
+    replacement.reserve(to.size());
+    for (const Chord& chord : to) {
+        replacement.push_back(std::make_shared<Chord>(chord));
+    }
+    
+    auto first = chords.erase(chords.begin() + hunk.firstChord, chords.begin() + hunk.firstChord + from.size());
+    chords.insert(first, replacement.begin(), replacement.end());
+}
+
+void MidiProcessor::notesEdited(const ChordDiff& diff) {
+    // The edited notes no longer match the file or the onset clusters
+    noteEditCount++;
+    onsetDendrogram->clear();
+    
+    // Progressions are patched when chords only changed in place; inserted
+    // or removed chords shift every later index, so they are matched again
+    std::vector<int> changed;
+    bool sameCount = true;
+    for (const auto& hunk : diff.hunks) {
+        sameCount = sameCount && hunk.removed.size() == hunk.added.size();
+        for (size_t i = 0; i < hunk.added.size(); i++) {
+            changed.push_back(static_cast<int>(hunk.firstChord + i));
+        }
+    }
+    
+    if (sameCount) {
+        chordsEdited(changed);
+    } else {
+        analysisGraph.invalidate(AnalysisStage::KEY);
+        analysisGraph.invalidate(AnalysisStage::PROGRESSIONS);
+        keyTimeline.clear();
+        detectedKey.reset();
+        progressions.clear();
+    }
+}
+
+// Utility Methods
+
+std::string MidiProcessor::calculateFileHash(const std::vector<uint8_t>& data) {
+    uint64_t hash = utils::hashBytes(data.data(), data.size());
+    
     std::stringstream hashStr;
     hashStr << std::hex << std::setw(16) << std::setfill('0') << hash;
     return hashStr.str();
 }
 
+uint64_t MidiProcessor::calculateMusicHash(const std::vector<uint8_t>& data) {
+    InputFingerprint fingerprint;
+    InputDeduplicator::fingerprintBuffer(data, fingerprint);
+    return fingerprint.valid ? fingerprint.musicHash : fingerprint.contentHash;
+}
+
 void MidiProcessor::setTimeTolerance(uint32_t tolerance) {
+    // An explicit tolerance overrides automatic calibration
+    autoTimeTolerance = false;
+    if (tolerance == timeTolerance) {
+        return;
+    }
     timeTolerance = tolerance;
+    
+    // Chords regroup on next use; onset grouping reads straight off the dendrogram
+    analysisGraph.invalidate(AnalysisStage::CHORDS);
 }
 
 uint32_t MidiProcessor::getTimeTolerance() const {
     return timeTolerance;
 }
 
+void MidiProcessor::setAutoTimeTolerance(bool enabled) {
+    if (enabled != autoTimeTolerance) {
+        autoTimeTolerance = enabled;
+        analysisGraph.invalidate(AnalysisStage::TOLERANCE);
+    }
+}
+
+bool MidiProcessor::isAutoTimeTolerance() const {
+    return autoTimeTolerance;
+}
+
+ToleranceCalibration MidiProcessor::calibrateTimeTolerance() {
+    // Notes are already sorted by start time after extraction
+    OnsetCalibrator calibrator;
+    toleranceCalibration = calibrator.calibrate(notes, midiFile->division);
+    timeTolerance = toleranceCalibration.tolerance;
+    return toleranceCalibration;
+}
+
+ToleranceCalibration MidiProcessor::getToleranceCalibration() const {
+    return toleranceCalibration;
+}
+
+void MidiProcessor::setDetectionMode(ChordDetectionMode mode) {
+    if (mode != detectionMode) {
+        detectionMode = mode;
+        analysisGraph.invalidate(AnalysisStage::CHORDS);
+    }
+}
+
+ChordDetectionMode MidiProcessor::getDetectionMode() const {
+    return detectionMode;
+}
+
+void MidiProcessor::setParseOptions(const ParseOptions& options) {
+    parseOptions = options;
+}
+
+ParseOptions MidiProcessor::getParseOptions() const {
+    return parseOptions;
+}
+
+ParseStatistics MidiProcessor::getParseStatistics() const {
+    return parseStatistics;
+}
+
+std::vector<TrackChunkInfo> MidiProcessor::getTrackDirectory() const {
+    return trackDirectory;
+}
+
+void MidiProcessor::setActiveTracks(const std::vector<size_t>& trackIndices) {
+    std::vector<size_t> selection;
+    for (size_t index : trackIndices) {
+        if (index < trackDirectory.size()) {
+            selection.push_back(index);
+        }
+    }
+    std::sort(selection.begin(), selection.end());
+    selection.erase(std::unique(selection.begin(), selection.end()), selection.end());
+    
+    if (selection != activeTracks) {
+        activeTracks.swap(selection);
+        analysisGraph.invalidate(AnalysisStage::TRACKS);
+    }
+}
+
+std::vector<size_t> MidiProcessor::getActiveTracks() const {
+    // No selection means every track
+    if (!activeTracks.empty()) {
+        return activeTracks;
+    }
+    std::vector<size_t> allTracks(trackDirectory.size());
+    for (size_t i = 0; i < allTracks.size(); i++) {
+        allTracks[i] = i;
+    }
+    return allTracks;
+}
+
+const MidiTrack* MidiProcessor::getTrack(size_t index) {
+    if (!decodeTrack(index)) {
+        return nullptr;
+    }
+    return &midiFile->tracks[index];
+}
+
+bool MidiProcessor::canWriteMidiFile() const {
+    return loadedOptions.profile != ParseProfile::ANALYSIS_ONLY;
+}
+
 std::string MidiProcessor::getCurrentFilename() const {
     return currentFilename;
 }
 
-std::vector<std::shared_ptr<Chord>> MidiProcessor::getChords() const {
+std::string MidiProcessor::getFileHash() const {
+    return fileHash;
+}
+
+std::vector<std::shared_ptr<Chord>> MidiProcessor::getChords() {
+    requireAnalysis(AnalysisStage::CHORDS);
     return chords;
 }
 
@@ -920,52 +1816,284 @@ bool MidiProcessor::saveChordAnalysis(const std::string& filename) const {
 }
 
 void MidiProcessor::analyzeProgression() {
-    if (progressionAnalyzer && !chords.empty()) {
-        auto progressions = progressionAnalyzer->detectProgressions(chords);
-        
-        std::cout << "Chord Progression Analysis:" << std::endl;
-        std::cout << "--------------------------" << std::endl;
-        
-        if (progressions.empty()) {
-            std::cout << "No recognized progressions found." << std::endl;
-        } else {
-            for (const auto& prog : progressions) {
-                std::cout << "Found progression: " << prog->progressionName 
-                          << " (confidence: " << prog->confidence << ")" << std::endl;
-                
-                std::cout << "  Chords: ";
-                for (size_t i = 0; i < prog->chordIndices.size(); i++) {
-                    int idx = prog->chordIndices[i];
-                    if (idx >= 0 && idx < static_cast<int>(chords.size())) {
-                        std::cout << chords[idx]->name;
-                        if (i < prog->chordIndices.size() - 1) {
-                            std::cout << " -> ";
-                        }
+    if (!requireAnalysis(AnalysisStage::PROGRESSIONS) || chords.empty()) {
+        return;
+    }
+    
+    std::cout << "Chord Progression Analysis:" << std::endl;
+    std::cout << "--------------------------" << std::endl;
+    
+    if (progressions.empty()) {
+        std::cout << "No recognized progressions found." << std::endl;
+    } else {
+        for (const auto& prog : progressions) {
+            std::cout << "Found progression: " << prog->progressionName 
+                      << " (confidence: " << prog->confidence << ")" << std::endl;
+            
+            std::cout << "  Chords: ";
+            for (size_t i = 0; i < prog->chordIndices.size(); i++) {
+                int idx = prog->chordIndices[i];
+                if (idx >= 0 && idx < static_cast<int>(chords.size())) {
+                    std::cout << chords[idx]->name;
+                    if (i < prog->chordIndices.size() - 1) {
+                        std::cout << " -> ";
                     }
                 }
-                std::cout << std::endl;
             }
+            std::cout << std::endl;
         }
     }
 }
 
 void MidiProcessor::detectKey() {
-    if (keyDetector && !chords.empty()) {
-        auto key = keyDetector->detectKey(chords);
-        
-        if (key) {
-            std::cout << "Key Detection:" << std::endl;
-            std::cout << "-------------" << std::endl;
-            std::cout << "Detected key: " << key->rootNote 
-                      << (key->isMajor ? " Major" : " Minor") << std::endl;
-            
+    if (!requireAnalysis(AnalysisStage::KEY) || chords.empty()) {
+        return;
+    }
+    
+    if (!keyTimeline.empty()) {
+        const KeyRegion& key = keyTimeline.front();
+        std::cout << "Key Detection:" << std::endl;
+        std::cout << "-------------" << std::endl;
+        std::cout << "Detected key: " << key.rootNote 
+                  << (key.isMajor ? " Major" : " Minor") << std::endl;
+        
+        // Keys restored from a session carry no diatonic chord table
+        if (detectedKey) {
             std::cout << "Diatonic chords in this key:" << std::endl;
-            for (const auto& [degree, quality] : key->diatonicChords) {
+            for (const auto& [degree, quality] : detectedKey->diatonicChords) {
                 std::cout << "  " << degree << ": " << quality << std::endl;
             }
-        } else {
-            std::cout << "Could not determine key with confidence." << std::endl;
         }
+    } else {
+        std::cout << "Could not determine key with confidence." << std::endl;
+    }
+}
+
+void MidiProcessor::detectKeyTimeline() {
+    keyTimeline.clear();
+    detectedKey.reset();
+    if (!keyDetector || chords.empty()) {
+        return;
+    }
+    
+    // The detector finds one key for the whole piece
+    detectedKey = keyDetector->detectKey(chords);
+    if (detectedKey) {
+        keyTimeline.emplace_back(0, detectedKey->rootNote, detectedKey->isMajor);
+    }
+}
+
+void MidiProcessor::chordsEdited(const std::vector<int>& changedIndices) {
+    analysisGraph.invalidate(AnalysisStage::KEY);
+    keyTimeline.clear();
+    detectedKey.reset();
+    
+    // Analyzed progressions are patched in place; ones loaded from a
+    // session have no match state yet and are detected afresh
+    if (!analysisGraph.isDirty(AnalysisStage::PROGRESSIONS)) {
+        progressionAnalyzer->updateProgressions(chords, changedIndices, progressionMatchState, progressions);
+    }
+}
+
+std::vector<KeyRegion> MidiProcessor::getKeyTimeline() {
+    requireAnalysis(AnalysisStage::KEY);
+    return keyTimeline;
+}
+
+std::vector<std::shared_ptr<ChordProgression>> MidiProcessor::getProgressions() {
+    requireAnalysis(AnalysisStage::PROGRESSIONS);
+    return progressions;
+}
+
+bool MidiProcessor::requireAnalysis(AnalysisStage stage) {
+    // Nothing is analyzed before analyzeActiveTracks, so opening a file
+    // stays a directory read
+    if (!analysisRequested) {
+        return false;
+    }
+    return analysisGraph.require(stage);
+}
+
+bool MidiProcessor::isAnalysisCurrent(AnalysisStage stage) const {
+    return analysisRequested && !analysisGraph.isDirty(stage);
+}
+
+size_t MidiProcessor::getAnalysisComputeCount(AnalysisStage stage) const {
+    return analysisGraph.getComputeCount(stage);
+}
+
+// Session Files
+
+bool MidiProcessor::saveSession(const std::string& filename) {
+    if (fileSize == 0) {
+        std::cerr << "Error: No MIDI file loaded" << std::endl;
+        return false;
+    }
+    
+    // Loading marks every saved stage current, so notes and chords are
+    // brought up to date before they are written
+    if (!analyzeActiveTracks()) {
+        return false;
+    }
+    
+    SessionContents contents;
+    contents.sourceFilename = currentFilename;
+    contents.sourceHash = fileHash;
+    contents.timeTolerance = timeTolerance;
+    contents.autoTimeTolerance = autoTimeTolerance;
+    contents.detectionMode = detectionMode;
+    contents.parseOptions = loadedOptions;
+    contents.activeTracks = activeTracks;
+    contents.calibrationGrid = toleranceCalibration.grid;
+    contents.calibrationSpread = toleranceCalibration.humanizationSpread;
+    contents.calibrationTolerance = toleranceCalibration.tolerance;
+    contents.calibrationIntervals = toleranceCalibration.intervalCount;
+    contents.calibrationConfidence = toleranceCalibration.gridConfidence;
+    contents.musicHash = getMusicHash();
+    contents.noteEditCount = noteEditCount;
+    contents.smfImage = fileData;
+    contents.smfImageSize = fileSize;
+    contents.notes = &notes;
+    contents.sustainSpans = &sustainSpans;
+    contents.chords = &chords;
+    
+    // Loading marks a saved key or progression list current, so stale ones
+    // are left out and recomputed on demand after loading
+    std::vector<KeyRegion> noKeyTimeline;
+    std::vector<std::shared_ptr<ChordProgression>> noProgressions;
+    contents.keyTimeline = isAnalysisCurrent(AnalysisStage::KEY) ? &keyTimeline : &noKeyTimeline;
+    contents.progressions = isAnalysisCurrent(AnalysisStage::PROGRESSIONS) ? &progressions : &noProgressions;
+    
+    return SessionWriter::write(filename, contents);
+}
+
+bool MidiProcessor::loadSession(const std::string& filename) {
+    auto mapping = std::make_unique<SessionView>();
+    if (!mapping->open(filename)) {
+        return false;
+    }
+    const SessionView& view = *mapping;
+    
+    const SessionInfo* info = view.info();
+    size_t imageLength = 0;
+    const uint8_t* image = view.smfImage(imageLength);
+    
+    // Reset data
+    midiFile = std::make_unique<MidiFile>();
+    trackDirectory.clear();
+    notes.clear();
+    sustainSpans.clear();
+    chords.clear();
+    keyTimeline.clear();
+    progressions.clear();
+    progressionMatchState = ProgressionMatchState();
+    onsetDendrogram->clear();
+    detectedKey.reset();
+    parseStatistics = ParseStatistics();
+    actionManager->clearHistory();
+    
+    // The original file bytes back lazy track decoding and writing, as after
+    // openMidiFile. They are read in place, so the mapping stays open.
+    fileBuffer.clear();
+    fileBuffer.shrink_to_fit();
+    sessionView = std::move(mapping);
+    fileData = image;
+    fileSize = imageLength;
+    if (!buildTrackDirectory()) {
+        return false;
+    }
+    
+    currentFilename = view.string(info->sourceFilename);
+    fileHash = view.string(info->sourceHash);
+    musicHash = info->musicHash;
+    musicHashValid = true;
+    noteEditCount = info->noteEditCount;
+    timeTolerance = info->timeTolerance;
+    autoTimeTolerance = info->autoTimeTolerance != 0;
+    detectionMode = static_cast<ChordDetectionMode>(info->detectionMode);
+    loadedOptions.profile = static_cast<ParseProfile>(info->parseProfile);
+    loadedOptions.excludedChannels = static_cast<uint16_t>(info->excludedChannels);
+    
+    std::vector<size_t> trackIndices(view.indices(info->activeTracksOffset), 
+                                     view.indices(info->activeTracksOffset) + info->activeTrackCount);
+    setActiveTracks(trackIndices);
+    
+    toleranceCalibration.grid = info->calibrationGrid;
+    toleranceCalibration.humanizationSpread = info->calibrationSpread;
+    toleranceCalibration.tolerance = info->calibrationTolerance;
+    toleranceCalibration.intervalCount = static_cast<size_t>(info->calibrationIntervals);
+    toleranceCalibration.gridConfidence = info->calibrationConfidence;
+    
+    size_t count = 0;
+    const SessionNote* noteRecords = view.notes(count);
+    notes.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const SessionNote& record = noteRecords[i];
+        notes.emplace_back(record.pitch, record.startTime, record.duration, record.velocity, record.channel);
+    }
+    
+    const SessionSustainSpan* spanRecords = view.sustainSpans(count);
+    sustainSpans.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        sustainSpans.emplace_back(static_cast<uint8_t>(spanRecords[i].channel), 
+                                  spanRecords[i].startTime, spanRecords[i].endTime);
+    }
+    
+    const SessionChord* chordRecords = view.chords(count);
+    chords.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const SessionChord& record = chordRecords[i];
+        auto chord = std::make_shared<Chord>();
+        const uint8_t* chordNotes = view.pitches(record.notesOffset);
+        const uint8_t* originalNotes = view.pitches(record.originalNotesOffset);
+        chord->notes.assign(chordNotes, chordNotes + record.noteCount);
+        chord->originalNotes.assign(originalNotes, originalNotes + record.originalNoteCount);
+        chord->name = view.string(record.name);
+        chord->originalName = view.string(record.originalName);
+        chord->startTime = record.startTime;
+        chord->duration = record.duration;
+        chord->isTransformed = record.isTransformed != 0;
+        chords.push_back(chord);
+    }
+    
+    const SessionKeyRegion* keyRecords = view.keyRegions(count);
+    for (size_t i = 0; i < count; i++) {
+        keyTimeline.emplace_back(keyRecords[i].startTime, view.string(keyRecords[i].rootNote), 
+                                 keyRecords[i].isMajor != 0);
+    }
+    
+    const SessionProgression* progressionRecords = view.progressions(count);
+    for (size_t i = 0; i < count; i++) {
+        const SessionProgression& record = progressionRecords[i];
+        auto progression = std::make_shared<ChordProgression>();
+        const int32_t* chordIndices = view.indices(record.indicesOffset);
+        progression->chordIndices.assign(chordIndices, chordIndices + record.indexCount);
+        progression->progressionName = view.string(record.name);
+        progression->confidence = record.confidence;
+        progressions.push_back(progression);
+    }
+    
+    // Restored results are current; tracks decode and anything the session
+    // lacks is computed on demand
+    analysisGraph.invalidateAll();
+    analysisGraph.markComputed(AnalysisStage::NOTES);
+    analysisGraph.markComputed(AnalysisStage::TOLERANCE);
+    analysisGraph.markComputed(AnalysisStage::CHORDS);
+    if (!keyTimeline.empty()) {
+        analysisGraph.markComputed(AnalysisStage::KEY);
+    }
+    if (!progressions.empty()) {
+        analysisGraph.markComputed(AnalysisStage::PROGRESSIONS);
+    }
+    analysisRequested = true;
+    
+    return true;
+}
+
+void MidiProcessor::rememberDetection() {
+    // Edited notes no longer match the file, as in the CHORDS stage
+    if (noteEditCount == 0 && isAnalysisCurrent(AnalysisStage::CHORDS)) {
+        storeDetection(detectionCacheKey());
     }
 }
 
@@ -976,11 +2104,22 @@ void MidiProcessor::previewChord(size_t index) {
 }
 
 bool MidiProcessor::undo() {
-    return actionManager->undo();
+    // The action about to be undone becomes the next redo
+    std::vector<int> indices = actionManager->getUndoIndices();
+    if (!actionManager->undo()) {
+        return false;
+    }
+    chordsEdited(indices);
+    return true;
 }
 
 bool MidiProcessor::redo() {
-    return actionManager->redo();
+    std::vector<int> indices = actionManager->getRedoIndices();
+    if (!actionManager->redo()) {
+        return false;
+    }
+    chordsEdited(indices);
+    return true;
 }
 
 } // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "../../include/core/onset_calibrator.h"
+
+#include <algorithm>
+
+namespace midi_transformer {
+
+namespace {
+
+// Value below which the given share of a histogram's mass lies
+uint32_t histogramPercentile(const std::vector<uint64_t>& histogram, double share) {
+    uint64_t total = 0;
+    for (uint64_t count : histogram) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    
+    uint64_t threshold = static_cast<uint64_t>(total * share);
+    uint64_t cumulative = 0;
+    for (size_t value = 0; value < histogram.size(); value++) {
+        cumulative += histogram[value];
+        if (cumulative > threshold) {
+            return static_cast<uint32_t>(value);
+        }
+    }
+    return static_cast<uint32_t>(histogram.size() - 1);
+}
+
+} // namespace
+
+OnsetCalibrator::OnsetCalibrator(double minConfidence) : minGridConfidence(minConfidence) {
+}
+
+uint64_t OnsetCalibrator::rangeSum(const std::vector<uint64_t>& prefix, int64_t first, int64_t last) {
+    int64_t maxIndex = static_cast<int64_t>(prefix.size()) - 2;
+    first = std::max<int64_t>(first, 0);
+    last = std::min<int64_t>(last, maxIndex);
+    if (first > last) {
+        return 0;
+    }
+    return prefix[last + 1] - prefix[first];
+}
+
+ToleranceCalibration OnsetCalibrator::calibrate(const std::vector<Note>& sortedNotes, uint16_t division) const {
+    ToleranceCalibration result;
+    
+    // SMPTE divisions (top bit set) have no beat; fall back to a typical resolution
+    uint32_t ticksPerQuarter = (division == 0 || (division & 0x8000)) ? 480 : division;
+    result.tolerance = std::max<uint32_t>(1, ticksPerQuarter / 4);
+    
+    if (sortedNotes.size() < 2) {
+        return result;
+    }
+    
+    // Single pass: histogram of inter-onset intervals up to a whole note.
+    // Simultaneous onsets carry no timing information and are skipped.
+    uint32_t maxInterval = ticksPerQuarter * 4;
+    std::vector<uint64_t> histogram(maxInterval + 1, 0);
+    uint64_t longIntervals = 0;
+    
+    for (size_t i = 1; i < sortedNotes.size(); i++) {
+        uint32_t interval = sortedNotes[i].startTime - sortedNotes[i - 1].startTime;
+        if (interval == 0) {
+            continue;
+        }
+        if (interval <= maxInterval) {
+            histogram[interval]++;
+        } else {
+            longIntervals++;
+        }
+    }
+    
+    std::vector<uint64_t> prefix(histogram.size() + 1, 0);
+    for (size_t i = 0; i < histogram.size(); i++) {
+        prefix[i + 1] = prefix[i] + histogram[i];
+    }
+    
+    result.intervalCount = static_cast<size_t>(prefix.back() + longIntervals);
+    if (prefix.back() == 0) {
+        return result;
+    }
+    
+    // Try grids from coarsest to finest (whole note down to 32nd-note triplets)
+    // and keep the first one that explains most inter-chord intervals
+    static const uint32_t subdivisions[] = {1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48};
+    
+    for (uint32_t subdivision : subdivisions) {
+        uint32_t grid = maxInterval / subdivision;
+        if (grid < 8) {
+            break;
+        }
+        
+        // Intervals shorter than a quarter of the step are spread within a chord
+        int64_t window = grid / 8;
+        int64_t stepFloor = grid / 4;
+        uint64_t steps = rangeSum(prefix, stepFloor, maxInterval);
+        if (steps == 0) {
+            continue;
+        }
+        
+        uint64_t explained = 0;
+        for (int64_t multiple = grid; multiple - window <= maxInterval; multiple += grid) {
+            explained += rangeSum(prefix, std::max(multiple - window, stepFloor), multiple + window);
+        }
+        
+        // Without an accepted grid, report the best fit seen
+        double confidence = static_cast<double>(explained) / steps;
+        result.gridConfidence = std::max(result.gridConfidence, confidence);
+        
+        if (confidence >= minGridConfidence) {
+            result.grid = grid;
+            result.gridConfidence = confidence;
+            break;
+        }
+    }
+    
+    // Humanization: how far onsets stray from the grid, plus the small gaps
+    // between notes that belong to the same chord
+    uint32_t spreadLimit = result.grid > 0 ? result.grid / 4 : ticksPerQuarter / 4;
+    std::vector<uint64_t> deviations(spreadLimit + 1, 0);
+    
+    for (uint32_t interval = 1; interval < spreadLimit && interval <= maxInterval; interval++) {
+        deviations[interval] += histogram[interval];
+    }
+    
+    if (result.grid > 0) {
+        uint32_t window = result.grid / 8;
+        for (uint32_t interval = spreadLimit; interval <= maxInterval; interval++) {
+            if (histogram[interval] == 0) {
+                continue;
+            }
+            uint32_t multiple = ((interval + result.grid / 2) / result.grid) * result.grid;
+            uint32_t deviation = interval > multiple ? interval - multiple : multiple - interval;
+            if (deviation <= window) {
+                deviations[deviation] += histogram[interval];
+            }
+        }
+    }
+    
+    result.humanizationSpread = histogramPercentile(deviations, 0.95);
+    
+    // Leave some headroom above the spread but stay well inside one grid step
+    uint32_t tolerance = result.humanizationSpread + result.humanizationSpread / 2;
+    if (result.grid > 0) {
+        tolerance = std::clamp<uint32_t>(tolerance, std::max<uint32_t>(1, result.grid / 8), result.grid / 2);
+    } else {
+        tolerance = std::clamp<uint32_t>(tolerance, std::max<uint32_t>(1, ticksPerQuarter / 32),
+                                         std::max<uint32_t>(1, ticksPerQuarter / 4));
+    }
+    result.tolerance = tolerance;
+    
+    return result;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
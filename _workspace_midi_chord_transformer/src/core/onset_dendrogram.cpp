@@ -0,0 +1,119 @@
+#include "../../include/core/onset_dendrogram.h"
+
+namespace midi_transformer {
+
+OnsetDendrogram::OnsetDendrogram() : built(false), root(-1) {
+}
+
+void OnsetDendrogram::build(const std::vector<Note>& sortedNotes) {
+    clear();
+    
+    // Collapse notes into distinct onsets with their pitch content
+    std::vector<PitchSet> onsetPitches;
+    std::vector<uint32_t> onsetDurations;
+    
+    for (const auto& note : sortedNotes) {
+        if (onsetTimes.empty() || onsetTimes.back() != note.startTime) {
+            onsetTimes.push_back(note.startTime);
+            onsetPitches.emplace_back();
+            onsetDurations.push_back(0);
+        }
+        onsetPitches.back().add(note.pitch);
+        onsetDurations.back() = std::max(onsetDurations.back(), note.duration);
+    }
+    
+    size_t gapCount = onsetTimes.empty() ? 0 : onsetTimes.size() - 1;
+    gaps.resize(gapCount);
+    for (size_t i = 0; i < gapCount; i++) {
+        gaps[i] = onsetTimes[i + 1] - onsetTimes[i];
+    }
+    
+    // Build the Cartesian tree in one stack pass: each gap pops the smaller
+    // gaps to its left and adopts them as its left subtree
+    leftChild.assign(gapCount, -1);
+    rightChild.assign(gapCount, -1);
+    std::vector<int32_t> stack;
+    stack.reserve(64);
+    
+    for (size_t i = 0; i < gapCount; i++) {
+        int32_t last = -1;
+        while (!stack.empty() && gaps[stack.back()] < gaps[i]) {
+            last = stack.back();
+            stack.pop_back();
+        }
+        leftChild[i] = last;
+        if (!stack.empty()) {
+            rightChild[stack.back()] = static_cast<int32_t>(i);
+        }
+        stack.push_back(static_cast<int32_t>(i));
+    }
+    root = stack.empty() ? -1 : stack.front();
+    
+    pitchTable.build(std::move(onsetPitches));
+    durationTable.build(std::move(onsetDurations));
+    built = true;
+}
+
+void OnsetDendrogram::clear() {
+    built = false;
+    onsetTimes.clear();
+    gaps.clear();
+    leftChild.clear();
+    rightChild.clear();
+    root = -1;
+    pitchTable.clear();
+    durationTable.clear();
+}
+
+bool OnsetDendrogram::isBuilt() const {
+    return built;
+}
+
+size_t OnsetDendrogram::onsetCount() const {
+    return onsetTimes.size();
+}
+
+std::vector<OnsetGroup> OnsetDendrogram::groupsForTolerance(uint32_t tolerance) const {
+    std::vector<OnsetGroup> groups;
+    if (onsetTimes.empty()) {
+        return groups;
+    }
+    
+    // In-order walk of the dendrogram nodes that split at this tolerance.
+    // A node whose gap is within the tolerance covers a subtree of smaller
+    // gaps, so the walk never descends below it.
+    size_t groupStart = 0;
+    std::vector<int32_t> stack;
+    int32_t node = root;
+    
+    while (node >= 0 || !stack.empty()) {
+        while (node >= 0 && gaps[node] > tolerance) {
+            stack.push_back(node);
+            node = leftChild[node];
+        }
+        if (stack.empty()) {
+            break;
+        }
+        
+        int32_t split = stack.back();
+        stack.pop_back();
+        groups.push_back({onsetTimes[groupStart], onsetTimes[split],
+                          groupStart, static_cast<size_t>(split)});
+        groupStart = split + 1;
+        node = rightChild[split];
+    }
+    
+    size_t lastOnset = onsetTimes.size() - 1;
+    groups.push_back({onsetTimes[groupStart], onsetTimes[lastOnset], groupStart, lastOnset});
+    return groups;
+}
+
+std::vector<uint8_t> OnsetDendrogram::groupPitches(const OnsetGroup& group) const {
+    return pitchTable.query(group.firstOnset, group.lastOnset).toNotes();
+}
+
+uint32_t OnsetDendrogram::groupMaxDuration(const OnsetGroup& group) const {
+    return durationTable.query(group.firstOnset, group.lastOnset);
+}
+
+} // namespace midi_transformer
\ No newline at end of file
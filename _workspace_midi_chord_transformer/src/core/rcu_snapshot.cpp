@@ -0,0 +1,98 @@
+#include "../../include/core/rcu_snapshot.h"
+
+namespace midi_transformer {
+
+namespace {
+
+const size_t READER_SLOTS = 128;
+
+// One cache line per reader so readers on different threads do not contend
+struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch;    // Epoch the reader entered at, 0 when outside
+    std::atomic<bool> claimed;
+};
+
+ReaderSlot readerSlots[READER_SLOTS];
+
+// Starts at 1 so that 0 can mark an idle slot
+std::atomic<uint64_t> globalEpoch(1);
+
+// Readers on threads that found every slot claimed; while any are inside,
+// nothing is reclaimed
+std::atomic<uint64_t> overflowReaders(0);
+
+// The calling thread's slot, claimed on its first guard and released when
+// the thread exits
+struct ThreadReader {
+    ReaderSlot* slot;
+    int depth;
+    
+    ThreadReader() : slot(nullptr), depth(0) {
+        for (auto& candidate : readerSlots) {
+            bool expected = false;
+            if (candidate.claimed.compare_exchange_strong(expected, true)) {
+                slot = &candidate;
+                break;
+            }
+        }
+    }
+    
+    ~ThreadReader() {
+        if (slot) {
+            slot->epoch.store(0);
+            slot->claimed.store(false);
+        }
+    }
+};
+
+thread_local ThreadReader threadReader;
+
+} // namespace
+
+RcuReadGuard::RcuReadGuard() {
+    ThreadReader& reader = threadReader;
+    if (reader.depth++ > 0) {
+        return;
+    }
+    
+    // Sequentially consistent: a writer that finds this slot idle swapped
+    // its pointer before this store, so the reader only sees the new one
+    if (reader.slot) {
+        reader.slot->epoch.store(globalEpoch.load());
+    } else {
+        overflowReaders.fetch_add(1);
+    }
+}
+
+RcuReadGuard::~RcuReadGuard() {
+    ThreadReader& reader = threadReader;
+    if (--reader.depth > 0) {
+        return;
+    }
+    
+    if (reader.slot) {
+        reader.slot->epoch.store(0);
+    } else {
+        overflowReaders.fetch_sub(1);
+    }
+}
+
+uint64_t RcuDomain::retireEpoch() {
+    return globalEpoch.fetch_add(1);
+}
+
+bool RcuDomain::isQuiescent(uint64_t retiredEpoch) {
+    if (overflowReaders.load() > 0) {
+        return false;
+    }
+    
+    for (const auto& slot : readerSlots) {
+        uint64_t epoch = slot.epoch.load();
+        if (epoch != 0 && epoch <= retiredEpoch) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
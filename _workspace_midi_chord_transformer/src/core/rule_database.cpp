@@ -0,0 +1,708 @@
+#include "../../include/core/rule_database.h"
+#include "../../include/utils/midi_utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace midi_transformer {
+
+static_assert(sizeof(RuleHeader) == 40, "RuleHeader layout changed");
+static_assert(sizeof(RuleSectionEntry) == 24, "RuleSectionEntry layout changed");
+static_assert(sizeof(RuleProgression) == 24, "RuleProgression layout changed");
+static_assert(sizeof(RuleLiteralSubstitution) == 32, "RuleLiteralSubstitution layout changed");
+static_assert(sizeof(RuleKey) == 88, "RuleKey layout changed");
+static_assert(sizeof(SubstitutionRule) == 12, "SubstitutionRule layout changed");
+
+namespace {
+
+const char RULE_MAGIC[8] = {'M', 'C', 'T', 'R', 'U', 'L', 'E', '\0'};
+
+std::shared_ptr<const RuleDatabase> sharedDatabase;
+
+// One section waiting to be laid out
+struct PendingSection {
+    RuleSection type;
+    uint32_t recordSize;
+    const void* records;
+    size_t count;
+};
+
+template <typename T>
+PendingSection pendingSection(RuleSection type, const std::vector<T>& records) {
+    return {type, static_cast<uint32_t>(sizeof(T)), records.data(), records.size()};
+}
+
+size_t alignTo8(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+bool rangeFits(uint64_t offset, uint64_t count, uint64_t limit) {
+    return offset <= limit && count <= limit - offset;
+}
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+std::vector<std::string> splitFields(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '|')) {
+        fields.push_back(trim(field));
+    }
+    return fields;
+}
+
+std::vector<std::string> splitWords(const std::string& text) {
+    std::vector<std::string> words;
+    std::stringstream stream(text);
+    std::string word;
+    while (stream >> word) {
+        words.push_back(word == "_" ? "" : word);
+    }
+    return words;
+}
+
+bool readText(const std::string& filename, std::string& text) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    text = contents.str();
+    return true;
+}
+
+uint64_t hashText(const std::string& text) {
+    return utils::hashBytes(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+
+// Scale and diatonic chords of one mode, from a "mode" line
+struct ModeDefinition {
+    std::string name;
+    int intervals[7];
+    std::string qualities[7];
+};
+
+bool compileText(const std::string& text, const std::string& name, std::vector<uint8_t>& image) {
+    std::vector<char> stringPool;
+    std::vector<RuleString> stringRefs;
+    
+    auto addString = [&](const std::string& value) {
+        RuleString reference;
+        reference.offset = static_cast<uint32_t>(stringPool.size());
+        reference.length = static_cast<uint32_t>(value.size());
+        stringPool.insert(stringPool.end(), value.begin(), value.end());
+        return reference;
+    };
+    auto addStringList = [&](const std::vector<std::string>& values) {
+        uint32_t offset = static_cast<uint32_t>(stringRefs.size());
+        for (const auto& value : values) {
+            stringRefs.push_back(addString(value));
+        }
+        return offset;
+    };
+    
+    std::vector<RuleProgression> progressions;
+    std::vector<std::vector<SubstitutionRule>> rulesByQuality(CHORD_QUALITY_COUNT);
+    std::vector<std::string> relationshipNames;
+    std::vector<RuleLiteralSubstitution> literals;
+    std::vector<ModeDefinition> modes;
+    std::vector<RuleKey> keys;
+    
+    std::stringstream lines(text);
+    std::string line;
+    size_t lineNumber = 0;
+    
+    auto fail = [&](const std::string& message) {
+        std::cerr << "Error: " << name << ":" << lineNumber << ": " << message << std::endl;
+        return false;
+    };
+    
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        // '#' only starts a comment at the beginning of a line, since it also spells sharps
+        std::string content = trim(line);
+        if (content.empty() || content[0] == '#') {
+            continue;
+        }
+        
+        std::vector<std::string> fields = splitFields(content);
+        const std::string& kind = fields[0];
+        
+        if (kind == "progression") {
+            if (fields.size() != 4) {
+                return fail("expected 'progression | name | qualities | keys'");
+            }
+            RuleProgression record;
+            record.name = addString(fields[1]);
+            std::vector<std::string> qualities = splitWords(fields[2]);
+            std::vector<std::string> commonKeys = splitWords(fields[3]);
+            if (qualities.empty()) {
+                return fail("progression has no chords");
+            }
+            record.qualitiesOffset = addStringList(qualities);
+            record.qualityCount = static_cast<uint32_t>(qualities.size());
+            record.keysOffset = addStringList(commonKeys);
+            record.keyCount = static_cast<uint32_t>(commonKeys.size());
+            progressions.push_back(record);
+        } else if (kind == "substitution") {
+            if (fields.size() != 6) {
+                return fail("expected 'substitution | from | to | relationship | tension | similarity'");
+            }
+            ChordSubstitution substitution;
+            substitution.originalChord = fields[1];
+            substitution.substitutionChord = fields[2];
+            substitution.relationship = fields[3];
+            try {
+                substitution.tensionChange = std::stof(fields[4]);
+                substitution.functionalSimilarity = std::stoi(fields[5]);
+            } catch (const std::exception&) {
+                return fail("invalid tension or similarity");
+            }
+            
+            SubstitutionRule rule;
+            if (!ChordSubstitutionEngine::makeRule(substitution, rule)) {
+                RuleLiteralSubstitution literal;
+                literal.originalChord = addString(substitution.originalChord);
+                literal.substitutionChord = addString(substitution.substitutionChord);
+                literal.relationship = addString(substitution.relationship);
+                literal.tensionChange = substitution.tensionChange;
+                literal.functionalSimilarity = substitution.functionalSimilarity;
+                literals.push_back(literal);
+                continue;
+            }
+            
+            auto relationship = std::find(relationshipNames.begin(), relationshipNames.end(), substitution.relationship);
+            if (relationship == relationshipNames.end()) {
+                if (relationshipNames.size() > UINT8_MAX) {
+                    return fail("too many relationship names");
+                }
+                relationship = relationshipNames.insert(relationshipNames.end(), substitution.relationship);
+            }
+            rule.relationshipId = static_cast<uint8_t>(relationship - relationshipNames.begin());
+            
+            // Examples in other keys of an existing rule add nothing
+            auto& group = rulesByQuality[static_cast<size_t>(rule.sourceQuality)];
+            bool duplicate = false;
+            for (const auto& existing : group) {
+                duplicate |= existing.targetQuality == rule.targetQuality &&
+                             existing.rootInterval == rule.rootInterval &&
+                             existing.relationshipId == rule.relationshipId;
+            }
+            if (!duplicate) {
+                group.push_back(rule);
+            }
+        } else if (kind == "mode") {
+            if (fields.size() != 4) {
+                return fail("expected 'mode | name | intervals | qualities'");
+            }
+            std::vector<std::string> intervals = splitWords(fields[2]);
+            std::vector<std::string> qualities = splitWords(fields[3]);
+            if (intervals.size() != 7 || qualities.size() != 7) {
+                return fail("a mode needs seven intervals and seven qualities");
+            }
+            ModeDefinition mode;
+            mode.name = fields[1];
+            for (int degree = 0; degree < 7; degree++) {
+                try {
+                    mode.intervals[degree] = std::stoi(intervals[degree]);
+                } catch (const std::exception&) {
+                    return fail("invalid interval " + intervals[degree]);
+                }
+                mode.qualities[degree] = qualities[degree];
+            }
+            modes.push_back(mode);
+        } else if (kind == "keys") {
+            if (fields.size() != 3) {
+                return fail("expected 'keys | mode | roots'");
+            }
+            const ModeDefinition* mode = nullptr;
+            for (const auto& candidate : modes) {
+                if (candidate.name == fields[1]) {
+                    mode = &candidate;
+                }
+            }
+            if (!mode) {
+                return fail("unknown mode " + fields[1]);
+            }
+            
+            bool isMajor = mode->name == "major";
+            std::string suffix = isMajor ? "" : (mode->name == "minor" ? "m" : " " + mode->name);
+            for (const auto& root : splitWords(fields[2])) {
+                RuleKey key;
+                std::memset(&key, 0, sizeof(key));
+                key.name = addString(root + suffix);
+                key.rootNote = addString(root);
+                key.isMajor = isMajor ? 1 : 0;
+                uint8_t rootPitchClass = utils::noteNameToMidi(root) % 12;
+                for (int degree = 0; degree < 7; degree++) {
+                    key.scaleDegrees[degree] = static_cast<uint8_t>((rootPitchClass + mode->intervals[degree]) % 12);
+                    key.diatonicQualities[degree] = addString(mode->qualities[degree]);
+                }
+                keys.push_back(key);
+            }
+        } else {
+            return fail("unknown rule kind '" + kind + "'");
+        }
+    }
+    
+    // Rules grouped by source quality, with each quality's range
+    std::vector<SubstitutionRule> rules;
+    std::vector<RuleRange> ranges(CHORD_QUALITY_COUNT);
+    for (size_t q = 0; q < CHORD_QUALITY_COUNT; q++) {
+        ranges[q].begin = static_cast<uint32_t>(rules.size());
+        rules.insert(rules.end(), rulesByQuality[q].begin(), rulesByQuality[q].end());
+        ranges[q].end = static_cast<uint32_t>(rules.size());
+    }
+    
+    std::vector<RuleString> relationships;
+    for (const auto& relationship : relationshipNames) {
+        relationships.push_back(addString(relationship));
+    }
+    
+    std::vector<PendingSection> pending = {
+        pendingSection(RuleSection::PROGRESSIONS, progressions),
+        pendingSection(RuleSection::SUBSTITUTION_RULES, rules),
+        pendingSection(RuleSection::QUALITY_RANGES, ranges),
+        pendingSection(RuleSection::RELATIONSHIPS, relationships),
+        pendingSection(RuleSection::LITERAL_SUBSTITUTIONS, literals),
+        pendingSection(RuleSection::KEYS, keys),
+        pendingSection(RuleSection::STRING_REFS, stringRefs),
+        pendingSection(RuleSection::STRING_POOL, stringPool)
+    };
+    
+    // Lay out the section table, then each section on an 8-byte boundary
+    std::vector<RuleSectionEntry> entries(pending.size());
+    size_t offset = sizeof(RuleHeader) + entries.size() * sizeof(RuleSectionEntry);
+    for (size_t i = 0; i < pending.size(); i++) {
+        offset = alignTo8(offset);
+        entries[i].type = static_cast<uint32_t>(pending[i].type);
+        entries[i].recordSize = pending[i].recordSize;
+        entries[i].offset = offset;
+        entries[i].count = pending[i].count;
+        offset += pending[i].count * pending[i].recordSize;
+    }
+    size_t imageSize = alignTo8(offset);
+    
+    image.assign(imageSize, 0);
+    std::memcpy(image.data() + sizeof(RuleHeader), entries.data(),
+                entries.size() * sizeof(RuleSectionEntry));
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].count > 0) {
+            std::memcpy(image.data() + entries[i].offset, pending[i].records,
+                        pending[i].count * pending[i].recordSize);
+        }
+    }
+    
+    RuleHeader header;
+    std::memcpy(header.magic, RULE_MAGIC, sizeof(header.magic));
+    header.version = RULE_DATABASE_VERSION;
+    header.sectionCount = static_cast<uint32_t>(entries.size());
+    header.fileSize = imageSize;
+    header.checksum = utils::hashBytes(image.data() + sizeof(RuleHeader), imageSize - sizeof(RuleHeader));
+    header.sourceHash = hashText(text);
+    std::memcpy(image.data(), &header, sizeof(header));
+    
+    return true;
+}
+
+// Replaced atomically: other processes may have the old image mapped, or be
+// opening it while it is rewritten
+bool writeImage(const std::string& filename, const std::vector<uint8_t>& image) {
+    return utils::writeFileAtomically(filename, image.data(), image.size());
+}
+
+} // namespace
+
+RuleDatabase::RuleDatabase()
+    : data(nullptr),
+      size(0),
+      mapping(nullptr),
+      sections(nullptr),
+      sectionCount(0),
+      stringRefs(nullptr),
+      stringPool(nullptr) {
+}
+
+RuleDatabase::~RuleDatabase() {
+#ifndef _WIN32
+    if (mapping) {
+        munmap(mapping, size);
+    }
+#endif
+}
+
+bool RuleDatabase::compile(const std::string& ruleFilename, std::vector<uint8_t>& image) {
+    std::string text;
+    if (!readText(ruleFilename, text)) {
+        std::cerr << "Error: Could not open rule file " << ruleFilename << std::endl;
+        return false;
+    }
+    return compileText(text, ruleFilename, image);
+}
+
+bool RuleDatabase::compileFile(const std::string& ruleFilename, const std::string& imageFilename) {
+    std::vector<uint8_t> image;
+    if (!compile(ruleFilename, image)) {
+        return false;
+    }
+    if (!writeImage(imageFilename, image)) {
+        std::cerr << "Error: Could not write rule image " << imageFilename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool RuleDatabase::open(const std::string& imageFilename) {
+    if (data) {
+        std::cerr << "Error: Rule database is already open" << std::endl;
+        return false;
+    }
+
+#ifndef _WIN32
+    int descriptor = ::open(imageFilename.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        std::cerr << "Error: Could not open rule image " << imageFilename << std::endl;
+        return false;
+    }
+    
+    // A shared read-only mapping: every process mapping the image uses the same pages
+    struct stat status;
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+        void* mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+        if (mapped != MAP_FAILED) {
+            mapping = mapped;
+            data = static_cast<const uint8_t*>(mapped);
+            size = static_cast<size_t>(status.st_size);
+        }
+    }
+    ::close(descriptor);
+#endif
+    
+    // Read the whole image where mapping is unavailable
+    if (!mapping) {
+        std::ifstream file(imageFilename, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open rule image " << imageFilename << std::endl;
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+    }
+    
+    if (!validate(imageFilename)) {
+#ifndef _WIN32
+        if (mapping) {
+            munmap(mapping, size);
+        }
+#endif
+        mapping = nullptr;
+        buffer.clear();
+        data = nullptr;
+        size = 0;
+        return false;
+    }
+    return true;
+}
+
+bool RuleDatabase::adopt(std::vector<uint8_t> image) {
+    if (data) {
+        std::cerr << "Error: Rule database is already open" << std::endl;
+        return false;
+    }
+    buffer = std::move(image);
+    data = buffer.data();
+    size = buffer.size();
+    if (!validate("in-memory rule image")) {
+        buffer.clear();
+        data = nullptr;
+        size = 0;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const RuleDatabase> RuleDatabase::openOrCompile(
+    const std::string& ruleFilename, const std::string& imageFilename) {
+    
+    std::string text;
+    if (!readText(ruleFilename, text)) {
+        std::cerr << "Error: Could not open rule file " << ruleFilename << std::endl;
+        return nullptr;
+    }
+    uint64_t sourceHash = hashText(text);
+    
+    // Reuse the compiled image if it was built from this exact rule text
+    if (std::ifstream(imageFilename).good()) {
+        auto database = std::make_shared<RuleDatabase>();
+        if (database->open(imageFilename) && database->getSourceHash() == sourceHash) {
+            return database;
+        }
+    }
+    
+    std::vector<uint8_t> image;
+    if (!compileText(text, ruleFilename, image)) {
+        return nullptr;
+    }
+    
+    if (writeImage(imageFilename, image)) {
+        auto database = std::make_shared<RuleDatabase>();
+        if (database->open(imageFilename)) {
+            return database;
+        }
+    }
+    
+    std::cerr << "Warning: Could not store rule image " << imageFilename
+              << ", keeping it in memory" << std::endl;
+    auto database = std::make_shared<RuleDatabase>();
+    if (!database->adopt(std::move(image))) {
+        return nullptr;
+    }
+    return database;
+}
+
+std::shared_ptr<const RuleDatabase> RuleDatabase::shared() {
+    return std::atomic_load(&sharedDatabase);
+}
+
+void RuleDatabase::setShared(std::shared_ptr<const RuleDatabase> database) {
+    std::atomic_store(&sharedDatabase, std::move(database));
+}
+
+bool RuleDatabase::isOpen() const {
+    return data != nullptr;
+}
+
+bool RuleDatabase::isMapped() const {
+    return mapping != nullptr;
+}
+
+uint64_t RuleDatabase::getSourceHash() const {
+    return data ? reinterpret_cast<const RuleHeader*>(data)->sourceHash : 0;
+}
+
+bool RuleDatabase::validate(const std::string& name) {
+    if (size < sizeof(RuleHeader)) {
+        std::cerr << "Error: " << name << " is too small to be a rule image" << std::endl;
+        return false;
+    }
+    
+    const RuleHeader* header = reinterpret_cast<const RuleHeader*>(data);
+    if (std::memcmp(header->magic, RULE_MAGIC, sizeof(RULE_MAGIC)) != 0) {
+        std::cerr << "Error: " << name << " is not a rule image" << std::endl;
+        return false;
+    }
+    
+    // Also rejects images written with the other byte order
+    if (header->version != RULE_DATABASE_VERSION) {
+        std::cerr << "Error: Unsupported rule image version " << header->version
+                  << " in " << name << std::endl;
+        return false;
+    }
+    
+    if (header->fileSize != size ||
+        !rangeFits(sizeof(RuleHeader),
+                   static_cast<uint64_t>(header->sectionCount) * sizeof(RuleSectionEntry), size)) {
+        std::cerr << "Error: Rule image " << name << " is truncated" << std::endl;
+        return false;
+    }
+    
+    if (utils::hashBytes(data + sizeof(RuleHeader), size - sizeof(RuleHeader)) != header->checksum) {
+        std::cerr << "Error: Rule image " << name << " failed its integrity check" << std::endl;
+        return false;
+    }
+    
+    sections = reinterpret_cast<const RuleSectionEntry*>(data + sizeof(RuleHeader));
+    sectionCount = header->sectionCount;
+    
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        const RuleSectionEntry& entry = sections[i];
+        if (entry.offset % 8 != 0 || entry.recordSize == 0 ||
+            entry.count > size / entry.recordSize ||
+            !rangeFits(entry.offset, entry.count * entry.recordSize, size)) {
+            std::cerr << "Error: Rule image " << name << " has an invalid section table" << std::endl;
+            return false;
+        }
+    }
+    
+    // Every reference must stay inside its pool or table, so accessors need no checks
+    const RuleSectionEntry* refSection = findSection(RuleSection::STRING_REFS, sizeof(RuleString));
+    const RuleSectionEntry* poolSection = findSection(RuleSection::STRING_POOL, sizeof(char));
+    const RuleSectionEntry* rangeSection = findSection(RuleSection::QUALITY_RANGES, sizeof(RuleRange));
+    if (!refSection || !poolSection || !rangeSection || rangeSection->count != CHORD_QUALITY_COUNT) {
+        std::cerr << "Error: Rule image " << name << " is missing required sections" << std::endl;
+        return false;
+    }
+    
+    auto stringFits = [&](const RuleString& reference) {
+        return rangeFits(reference.offset, reference.length, poolSection->count);
+    };
+    
+    size_t count = 0;
+    bool referencesValid = true;
+    
+    const RuleString* refs = records<RuleString>(RuleSection::STRING_REFS, count);
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        referencesValid = stringFits(refs[i]);
+    }
+    
+    const RuleString* relationshipRecords = records<RuleString>(RuleSection::RELATIONSHIPS, count);
+    size_t relationshipCount = count;
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        referencesValid = stringFits(relationshipRecords[i]);
+    }
+    
+    size_t ruleCount = 0;
+    const SubstitutionRule* ruleRecords = substitutionRules(ruleCount);
+    for (size_t i = 0; i < ruleCount && referencesValid; i++) {
+        referencesValid = ruleRecords[i].relationshipId < relationshipCount &&
+                          static_cast<size_t>(ruleRecords[i].targetQuality) < CHORD_QUALITY_COUNT;
+    }
+    
+    const RuleRange* ranges = records<RuleRange>(RuleSection::QUALITY_RANGES, count);
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        referencesValid = ranges[i].begin <= ranges[i].end && ranges[i].end <= ruleCount;
+    }
+    
+    const RuleProgression* progressionRecords = records<RuleProgression>(RuleSection::PROGRESSIONS, count);
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        const RuleProgression& progression = progressionRecords[i];
+        referencesValid = stringFits(progression.name) &&
+                          rangeFits(progression.qualitiesOffset, progression.qualityCount, refSection->count) &&
+                          rangeFits(progression.keysOffset, progression.keyCount, refSection->count);
+    }
+    
+    const RuleLiteralSubstitution* literalRecords = literalSubstitutions(count);
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        referencesValid = stringFits(literalRecords[i].originalChord) &&
+                          stringFits(literalRecords[i].substitutionChord) &&
+                          stringFits(literalRecords[i].relationship);
+    }
+    
+    const RuleKey* keyRecords = records<RuleKey>(RuleSection::KEYS, count);
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        referencesValid = stringFits(keyRecords[i].name) && stringFits(keyRecords[i].rootNote);
+        for (int degree = 0; degree < 7 && referencesValid; degree++) {
+            referencesValid = stringFits(keyRecords[i].diatonicQualities[degree]);
+        }
+    }
+    
+    if (!referencesValid) {
+        std::cerr << "Error: Rule image " << name << " has references outside its tables" << std::endl;
+        return false;
+    }
+    
+    stringRefs = refs;
+    stringPool = reinterpret_cast<const char*>(data + poolSection->offset);
+    
+    return true;
+}
+
+const RuleSectionEntry* RuleDatabase::findSection(RuleSection type, size_t recordSize) const {
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        if (sections[i].type == static_cast<uint32_t>(type) && sections[i].recordSize == recordSize) {
+            return &sections[i];
+        }
+    }
+    return nullptr;
+}
+
+const SubstitutionRule* RuleDatabase::substitutionRules(size_t& count) const {
+    return records<SubstitutionRule>(RuleSection::SUBSTITUTION_RULES, count);
+}
+
+RuleRange RuleDatabase::qualityRange(ChordQuality quality) const {
+    size_t count = 0;
+    const RuleRange* ranges = records<RuleRange>(RuleSection::QUALITY_RANGES, count);
+    size_t index = static_cast<size_t>(quality);
+    return index < count ? ranges[index] : RuleRange{0, 0};
+}
+
+size_t RuleDatabase::relationshipCount() const {
+    size_t count = 0;
+    records<RuleString>(RuleSection::RELATIONSHIPS, count);
+    return count;
+}
+
+std::string RuleDatabase::relationship(uint8_t relationshipId) const {
+    size_t count = 0;
+    const RuleString* relationships = records<RuleString>(RuleSection::RELATIONSHIPS, count);
+    return relationshipId < count ? string(relationships[relationshipId]) : std::string();
+}
+
+const RuleLiteralSubstitution* RuleDatabase::literalSubstitutions(size_t& count) const {
+    return records<RuleLiteralSubstitution>(RuleSection::LITERAL_SUBSTITUTIONS, count);
+}
+
+std::vector<std::shared_ptr<ProgressionPattern>> RuleDatabase::progressionPatterns() const {
+    std::vector<std::shared_ptr<ProgressionPattern>> patterns;
+    size_t count = 0;
+    const RuleProgression* progressionRecords = records<RuleProgression>(RuleSection::PROGRESSIONS, count);
+    
+    for (size_t i = 0; i < count; i++) {
+        const RuleProgression& record = progressionRecords[i];
+        auto pattern = std::make_shared<ProgressionPattern>();
+        pattern->name = string(record.name);
+        for (uint32_t q = 0; q < record.qualityCount; q++) {
+            pattern->chordQualities.push_back(string(stringRefs[record.qualitiesOffset + q]));
+        }
+        for (uint32_t k = 0; k < record.keyCount; k++) {
+            pattern->commonKeys.push_back(string(stringRefs[record.keysOffset + k]));
+        }
+        patterns.push_back(pattern);
+    }
+    
+    return patterns;
+}
+
+std::vector<std::shared_ptr<KeySignature>> RuleDatabase::keySignatures(std::vector<std::string>& names) const {
+    std::vector<std::shared_ptr<KeySignature>> keys;
+    names.clear();
+    size_t count = 0;
+    const RuleKey* keyRecords = records<RuleKey>(RuleSection::KEYS, count);
+    
+    for (size_t i = 0; i < count; i++) {
+        const RuleKey& record = keyRecords[i];
+        auto key = std::make_shared<KeySignature>();
+        key->rootNote = string(record.rootNote);
+        key->isMajor = record.isMajor != 0;
+        key->scaleDegrees.assign(record.scaleDegrees, record.scaleDegrees + 7);
+        for (int degree = 0; degree < 7; degree++) {
+            key->diatonicChords[degree + 1] = string(record.diatonicQualities[degree]);
+        }
+        names.push_back(string(record.name));
+        keys.push_back(key);
+    }
+    
+    return keys;
+}
+
+std::string RuleDatabase::string(const RuleString& reference) const {
+    return std::string(stringPool + reference.offset, reference.length);
+}
+
+bool RuleDatabase::equals(const RuleString& reference, const std::string& value) const {
+    return reference.length == value.size() &&
+           std::memcmp(stringPool + reference.offset, value.data(), value.size()) == 0;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "../../include/core/scale_table.h"
+
+namespace midi_transformer {
+
+namespace {
+
+const char* const SCALE_MODE_NAMES[SCALE_MODE_COUNT] = {
+    "major", "minor", "harmonic minor", "melodic minor",
+    "dorian", "phrygian", "lydian", "mixolydian", "locrian"
+};
+
+// Scale intervals above the tonic, bit i for i semitones
+const PitchClassMask SCALE_INTERVALS[SCALE_MODE_COUNT] = {
+    0xAB5,                          // major: 0 2 4 5 7 9 11
+    0x5AD,                          // natural minor: 0 2 3 5 7 8 10
+    0x9AD,                          // harmonic minor: 0 2 3 5 7 8 11
+    0xAAD,                          // melodic minor: 0 2 3 5 7 9 11
+    0x6AD,                          // dorian: 0 2 3 5 7 9 10
+    0x5AB,                          // phrygian: 0 1 3 5 7 8 10
+    0xAD5,                          // lydian: 0 2 4 6 7 9 11
+    0x6B5,                          // mixolydian: 0 2 4 5 7 9 10
+    0x56B                           // locrian: 0 1 3 5 6 8 10
+};
+
+PitchClassMask rotate(PitchClassMask mask, int semitones) {
+    semitones = ((semitones % 12) + 12) % 12;
+    return static_cast<PitchClassMask>(((mask << semitones) | (mask >> (12 - semitones))) & 0xFFF);
+}
+
+struct ScaleTable {
+    ScaleEntry entries[SCALE_MODE_COUNT][12];
+    
+    ScaleTable() {
+        for (size_t mode = 0; mode < SCALE_MODE_COUNT; mode++) {
+            for (int root = 0; root < 12; root++) {
+                ScaleEntry& entry = entries[mode][root];
+                entry.notes = rotate(SCALE_INTERVALS[mode], root);
+                
+                for (int chordRoot = 0; chordRoot < 12; chordRoot++) {
+                    entry.chordQualities[chordRoot] = 0;
+                    if (!((entry.notes >> chordRoot) & 1)) {
+                        continue;
+                    }
+                    for (size_t q = 0; q < CHORD_QUALITY_COUNT; q++) {
+                        if (scaleContains(entry.notes, chordMask(chordRoot, static_cast<ChordQuality>(q)))) {
+                            entry.chordQualities[chordRoot] |= 1u << q;
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+const ScaleTable& scaleTable() {
+    static const ScaleTable table;
+    return table;
+}
+
+} // namespace
+
+const ScaleEntry& scaleEntry(uint8_t root, ScaleMode mode) {
+    size_t index = static_cast<size_t>(mode);
+    return scaleTable().entries[index < SCALE_MODE_COUNT ? index : 0][root % 12];
+}
+
+PitchClassMask chordMask(int root, ChordQuality quality) {
+    return rotate(chordQualityIntervals(quality), root);
+}
+
+PitchClassMask pitchClassMask(const std::vector<uint8_t>& notes) {
+    PitchClassMask mask = 0;
+    for (uint8_t note : notes) {
+        mask |= static_cast<PitchClassMask>(1u << (note % 12));
+    }
+    return mask;
+}
+
+uint8_t snapToScale(PitchClassMask scale, uint8_t pitchClass) {
+    pitchClass %= 12;
+    if ((scale & 0xFFF) == 0) {
+        return pitchClass;
+    }
+    
+    for (int distance = 0; distance <= 6; distance++) {
+        int below = (pitchClass + 12 - distance) % 12;
+        if ((scale >> below) & 1) {
+            return static_cast<uint8_t>(below);
+        }
+        int above = (pitchClass + distance) % 12;
+        if ((scale >> above) & 1) {
+            return static_cast<uint8_t>(above);
+        }
+    }
+    return pitchClass;
+}
+
+const char* scaleModeName(ScaleMode mode) {
+    size_t index = static_cast<size_t>(mode);
+    return index < SCALE_MODE_COUNT ? SCALE_MODE_NAMES[index] : "";
+}
+
+bool scaleModeFromName(const std::string& name, ScaleMode& mode) {
+    for (size_t i = 0; i < SCALE_MODE_COUNT; i++) {
+        if (name == SCALE_MODE_NAMES[i]) {
+            mode = static_cast<ScaleMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
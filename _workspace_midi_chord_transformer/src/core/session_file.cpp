@@ -0,0 +1,463 @@
+#include "../../include/core/session_file.h"
+#include "../../include/utils/midi_utils.h"
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace midi_transformer {
+
+static_assert(sizeof(SessionHeader) == 32, "SessionHeader layout changed");
+static_assert(sizeof(SessionSectionEntry) == 24, "SessionSectionEntry layout changed");
+static_assert(sizeof(SessionInfo) == 88, "SessionInfo layout changed");
+static_assert(sizeof(SessionNote) == 12, "SessionNote layout changed");
+static_assert(sizeof(SessionSustainSpan) == 12, "SessionSustainSpan layout changed");
+static_assert(sizeof(SessionChord) == 40, "SessionChord layout changed");
+static_assert(sizeof(SessionKeyRegion) == 16, "SessionKeyRegion layout changed");
+static_assert(sizeof(SessionProgression) == 24, "SessionProgression layout changed");
+
+namespace {
+
+const char SESSION_MAGIC[8] = {'M', 'C', 'T', 'S', 'E', 'S', 'S', '\0'};
+
+// One section waiting to be laid out
+struct PendingSection {
+    SessionSection type;
+    uint32_t recordSize;
+    const void* records;
+    size_t count;
+};
+
+template <typename T>
+PendingSection pendingSection(SessionSection type, const std::vector<T>& records) {
+    return {type, static_cast<uint32_t>(sizeof(T)), records.data(), records.size()};
+}
+
+size_t alignTo8(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+bool rangeFits(uint64_t offset, uint64_t count, uint64_t limit) {
+    return offset <= limit && count <= limit - offset;
+}
+
+} // namespace
+
+// SessionWriter
+
+bool SessionWriter::write(const std::string& filename, const SessionContents& contents) {
+    std::vector<uint8_t> pitchPool;
+    std::vector<int32_t> indexPool;
+    std::vector<char> stringPool;
+    
+    auto addString = [&](const std::string& text) {
+        SessionString reference;
+        reference.offset = static_cast<uint32_t>(stringPool.size());
+        reference.length = static_cast<uint32_t>(text.size());
+        stringPool.insert(stringPool.end(), text.begin(), text.end());
+        return reference;
+    };
+    auto addPitches = [&](const std::vector<uint8_t>& pitches) {
+        uint32_t offset = static_cast<uint32_t>(pitchPool.size());
+        pitchPool.insert(pitchPool.end(), pitches.begin(), pitches.end());
+        return offset;
+    };
+    
+    std::vector<SessionInfo> info(1);
+    std::memset(info.data(), 0, sizeof(SessionInfo));
+    info[0].sourceFilename = addString(contents.sourceFilename);
+    info[0].sourceHash = addString(contents.sourceHash);
+    info[0].timeTolerance = contents.timeTolerance;
+    info[0].autoTimeTolerance = contents.autoTimeTolerance ? 1 : 0;
+    info[0].detectionMode = static_cast<uint32_t>(contents.detectionMode);
+    info[0].parseProfile = static_cast<uint32_t>(contents.parseOptions.profile);
+    info[0].excludedChannels = contents.parseOptions.excludedChannels;
+    info[0].activeTracksOffset = static_cast<uint32_t>(indexPool.size());
+    info[0].activeTrackCount = static_cast<uint32_t>(contents.activeTracks.size());
+    for (size_t track : contents.activeTracks) {
+        indexPool.push_back(static_cast<int32_t>(track));
+    }
+    info[0].calibrationGrid = contents.calibrationGrid;
+    info[0].calibrationSpread = contents.calibrationSpread;
+    info[0].calibrationTolerance = contents.calibrationTolerance;
+    info[0].calibrationIntervals = contents.calibrationIntervals;
+    info[0].calibrationConfidence = contents.calibrationConfidence;
+    info[0].musicHash = contents.musicHash;
+    info[0].noteEditCount = contents.noteEditCount;
+    
+    std::vector<SessionNote> notes;
+    if (contents.notes) {
+        notes.resize(contents.notes->size());
+        for (size_t i = 0; i < notes.size(); i++) {
+            const Note& note = (*contents.notes)[i];
+            notes[i].startTime = note.startTime;
+            notes[i].duration = note.duration;
+            notes[i].pitch = note.pitch;
+            notes[i].velocity = note.velocity;
+            notes[i].channel = note.channel;
+            notes[i].reserved = 0;
+        }
+    }
+    
+    std::vector<SessionSustainSpan> spans;
+    if (contents.sustainSpans) {
+        for (const auto& span : *contents.sustainSpans) {
+            spans.push_back({span.startTime, span.endTime, span.channel});
+        }
+    }
+    
+    std::vector<SessionChord> chords;
+    if (contents.chords) {
+        chords.resize(contents.chords->size());
+        for (size_t i = 0; i < chords.size(); i++) {
+            const Chord& chord = *(*contents.chords)[i];
+            SessionChord& record = chords[i];
+            std::memset(&record, 0, sizeof(record));
+            record.startTime = chord.startTime;
+            record.duration = chord.duration;
+            record.notesOffset = addPitches(chord.notes);
+            record.noteCount = static_cast<uint16_t>(chord.notes.size());
+            record.originalNotesOffset = addPitches(chord.originalNotes);
+            record.originalNoteCount = static_cast<uint16_t>(chord.originalNotes.size());
+            record.isTransformed = chord.isTransformed ? 1 : 0;
+            record.name = addString(chord.name);
+            record.originalName = addString(chord.originalName);
+        }
+    }
+    
+    std::vector<SessionKeyRegion> keyRegions;
+    if (contents.keyTimeline) {
+        for (const auto& region : *contents.keyTimeline) {
+            SessionKeyRegion record;
+            record.startTime = region.startTime;
+            record.isMajor = region.isMajor ? 1 : 0;
+            record.rootNote = addString(region.rootNote);
+            keyRegions.push_back(record);
+        }
+    }
+    
+    std::vector<SessionProgression> progressions;
+    if (contents.progressions) {
+        for (const auto& progression : *contents.progressions) {
+            SessionProgression record;
+            std::memset(&record, 0, sizeof(record));
+            record.indicesOffset = static_cast<uint32_t>(indexPool.size());
+            record.indexCount = static_cast<uint32_t>(progression->chordIndices.size());
+            indexPool.insert(indexPool.end(), progression->chordIndices.begin(), progression->chordIndices.end());
+            record.name = addString(progression->progressionName);
+            record.confidence = progression->confidence;
+            progressions.push_back(record);
+        }
+    }
+    
+    std::vector<PendingSection> pending = {
+        pendingSection(SessionSection::INFO, info),
+        {SessionSection::SMF_IMAGE, 1, contents.smfImage, contents.smfImage ? contents.smfImageSize : 0},
+        pendingSection(SessionSection::NOTES, notes),
+        pendingSection(SessionSection::SUSTAIN_SPANS, spans),
+        pendingSection(SessionSection::CHORDS, chords),
+        pendingSection(SessionSection::KEY_REGIONS, keyRegions),
+        pendingSection(SessionSection::PROGRESSIONS, progressions),
+        pendingSection(SessionSection::PITCH_POOL, pitchPool),
+        pendingSection(SessionSection::INDEX_POOL, indexPool),
+        pendingSection(SessionSection::STRING_POOL, stringPool)
+    };
+    
+    // Lay out the section table, then each section on an 8-byte boundary
+    std::vector<SessionSectionEntry> entries(pending.size());
+    size_t offset = sizeof(SessionHeader) + entries.size() * sizeof(SessionSectionEntry);
+    for (size_t i = 0; i < pending.size(); i++) {
+        offset = alignTo8(offset);
+        entries[i].type = static_cast<uint32_t>(pending[i].type);
+        entries[i].recordSize = pending[i].recordSize;
+        entries[i].offset = offset;
+        entries[i].count = pending[i].count;
+        offset += pending[i].count * pending[i].recordSize;
+    }
+    size_t fileSize = alignTo8(offset);
+    
+    std::vector<uint8_t> image(fileSize, 0);
+    std::memcpy(image.data() + sizeof(SessionHeader), entries.data(),
+                entries.size() * sizeof(SessionSectionEntry));
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].count > 0) {
+            std::memcpy(image.data() + entries[i].offset, pending[i].records,
+                        pending[i].count * pending[i].recordSize);
+        }
+    }
+    
+    SessionHeader header;
+    std::memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    header.version = SESSION_FORMAT_VERSION;
+    header.sectionCount = static_cast<uint32_t>(entries.size());
+    header.fileSize = fileSize;
+    header.checksum = utils::hashBytes(image.data() + sizeof(SessionHeader), fileSize - sizeof(SessionHeader));
+    std::memcpy(image.data(), &header, sizeof(header));
+    
+    // Replaced atomically: the session being saved over may be the one whose
+    // mapping backs the processor's file bytes
+    if (!utils::writeFileAtomically(filename, image.data(), image.size())) {
+        std::cerr << "Error: Failed to write session file " << filename << std::endl;
+        return false;
+    }
+    
+    return true;
+}
+
+// SessionView
+
+SessionView::SessionView()
+    : data(nullptr),
+      size(0),
+      mapping(nullptr),
+      sections(nullptr),
+      sectionCount(0),
+      pitchPool(nullptr),
+      indexPool(nullptr),
+      stringPool(nullptr) {
+}
+
+SessionView::~SessionView() {
+    close();
+}
+
+bool SessionView::open(const std::string& filename) {
+    close();
+
+#ifndef _WIN32
+    int descriptor = ::open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        std::cerr << "Error: Could not open session file " << filename << std::endl;
+        return false;
+    }
+    
+    struct stat status;
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+        void* mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapped != MAP_FAILED) {
+            mapping = mapped;
+            data = static_cast<const uint8_t*>(mapped);
+            size = static_cast<size_t>(status.st_size);
+        }
+    }
+    ::close(descriptor);
+#endif
+    
+    // Read the whole file where mapping is unavailable
+    if (!mapping) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open session file " << filename << std::endl;
+            return false;
+        }
+        file.seekg(0, std::ios::end);
+        size_t fileSize = file.tellg();
+        file.seekg(0, std::ios::beg);
+        fallbackBuffer.resize(fileSize);
+        file.read(reinterpret_cast<char*>(fallbackBuffer.data()), fileSize);
+        data = fallbackBuffer.data();
+        size = fallbackBuffer.size();
+    }
+    
+    if (!validate(filename)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SessionView::close() {
+#ifndef _WIN32
+    if (mapping) {
+        munmap(mapping, size);
+    }
+#endif
+    mapping = nullptr;
+    fallbackBuffer.clear();
+    fallbackBuffer.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+    sections = nullptr;
+    sectionCount = 0;
+    pitchPool = nullptr;
+    indexPool = nullptr;
+    stringPool = nullptr;
+}
+
+bool SessionView::isOpen() const {
+    return data != nullptr;
+}
+
+bool SessionView::validate(const std::string& filename) {
+    if (size < sizeof(SessionHeader)) {
+        std::cerr << "Error: " << filename << " is too small to be a session file" << std::endl;
+        return false;
+    }
+    
+    const SessionHeader* header = reinterpret_cast<const SessionHeader*>(data);
+    if (std::memcmp(header->magic, SESSION_MAGIC, sizeof(SESSION_MAGIC)) != 0) {
+        std::cerr << "Error: " << filename << " is not a session file" << std::endl;
+        return false;
+    }
+    
+    // Also rejects files written with the other byte order
+    if (header->version != SESSION_FORMAT_VERSION) {
+        std::cerr << "Error: Unsupported session format version " << header->version
+                  << " in " << filename << std::endl;
+        return false;
+    }
+    
+    if (header->fileSize != size ||
+        !rangeFits(sizeof(SessionHeader),
+                   static_cast<uint64_t>(header->sectionCount) * sizeof(SessionSectionEntry), size)) {
+        std::cerr << "Error: Session file " << filename << " is truncated" << std::endl;
+        return false;
+    }
+    
+    if (utils::hashBytes(data + sizeof(SessionHeader), size - sizeof(SessionHeader)) != header->checksum) {
+        std::cerr << "Error: Session file " << filename << " failed its integrity check" << std::endl;
+        return false;
+    }
+    
+    sections = reinterpret_cast<const SessionSectionEntry*>(data + sizeof(SessionHeader));
+    sectionCount = header->sectionCount;
+    
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        const SessionSectionEntry& entry = sections[i];
+        if (entry.offset % 8 != 0 || entry.recordSize == 0 ||
+            entry.count > size / entry.recordSize ||
+            !rangeFits(entry.offset, entry.count * entry.recordSize, size)) {
+            std::cerr << "Error: Session file " << filename << " has an invalid section table" << std::endl;
+            return false;
+        }
+    }
+    
+    // Every pool reference must stay inside its pool, so accessors need no checks
+    const SessionSectionEntry* infoSection = findSection(SessionSection::INFO, sizeof(SessionInfo));
+    const SessionSectionEntry* pitchSection = findSection(SessionSection::PITCH_POOL, sizeof(uint8_t));
+    const SessionSectionEntry* indexSection = findSection(SessionSection::INDEX_POOL, sizeof(int32_t));
+    const SessionSectionEntry* stringSection = findSection(SessionSection::STRING_POOL, sizeof(char));
+    if (!infoSection || infoSection->count != 1 || !pitchSection || !indexSection || !stringSection) {
+        std::cerr << "Error: Session file " << filename << " is missing required sections" << std::endl;
+        return false;
+    }
+    
+    auto stringFits = [&](const SessionString& reference) {
+        return rangeFits(reference.offset, reference.length, stringSection->count);
+    };
+    
+    bool referencesValid = true;
+    const SessionInfo* sessionInfo = info();
+    referencesValid &= stringFits(sessionInfo->sourceFilename) && stringFits(sessionInfo->sourceHash);
+    referencesValid &= rangeFits(sessionInfo->activeTracksOffset, sessionInfo->activeTrackCount, indexSection->count);
+    
+    size_t count = 0;
+    const SessionChord* chordRecords = chords(count);
+    size_t chordCount = count;
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        const SessionChord& chord = chordRecords[i];
+        referencesValid = rangeFits(chord.notesOffset, chord.noteCount, pitchSection->count) &&
+                          rangeFits(chord.originalNotesOffset, chord.originalNoteCount, pitchSection->count) &&
+                          stringFits(chord.name) && stringFits(chord.originalName);
+    }
+    
+    const SessionKeyRegion* keyRecords = keyRegions(count);
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        referencesValid = stringFits(keyRecords[i].rootNote);
+    }
+    
+    // Progressions also index the chords
+    const int32_t* indexRecords = reinterpret_cast<const int32_t*>(data + indexSection->offset);
+    const SessionProgression* progressionRecords = progressions(count);
+    for (size_t i = 0; i < count && referencesValid; i++) {
+        const SessionProgression& progression = progressionRecords[i];
+        referencesValid = rangeFits(progression.indicesOffset, progression.indexCount, indexSection->count) &&
+                          stringFits(progression.name);
+        for (uint32_t j = 0; j < progression.indexCount && referencesValid; j++) {
+            int32_t chordIndex = indexRecords[progression.indicesOffset + j];
+            referencesValid = chordIndex >= 0 && static_cast<size_t>(chordIndex) < chordCount;
+        }
+    }
+    
+    if (!referencesValid) {
+        std::cerr << "Error: Session file " << filename << " has references outside its pools" << std::endl;
+        return false;
+    }
+    
+    pitchPool = data + pitchSection->offset;
+    indexPool = reinterpret_cast<const int32_t*>(data + indexSection->offset);
+    stringPool = reinterpret_cast<const char*>(data + stringSection->offset);
+    
+    return true;
+}
+
+const SessionSectionEntry* SessionView::findSection(SessionSection type, size_t recordSize) const {
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        if (sections[i].type == static_cast<uint32_t>(type) && sections[i].recordSize == recordSize) {
+            return &sections[i];
+        }
+    }
+    return nullptr;
+}
+
+const SessionInfo* SessionView::info() const {
+    const SessionSectionEntry* section = findSection(SessionSection::INFO, sizeof(SessionInfo));
+    return section ? reinterpret_cast<const SessionInfo*>(data + section->offset) : nullptr;
+}
+
+const uint8_t* SessionView::smfImage(size_t& length) const {
+    const SessionSectionEntry* section = findSection(SessionSection::SMF_IMAGE, sizeof(uint8_t));
+    length = section ? static_cast<size_t>(section->count) : 0;
+    return section ? data + section->offset : nullptr;
+}
+
+const SessionNote* SessionView::notes(size_t& count) const {
+    const SessionSectionEntry* section = findSection(SessionSection::NOTES, sizeof(SessionNote));
+    count = section ? static_cast<size_t>(section->count) : 0;
+    return section ? reinterpret_cast<const SessionNote*>(data + section->offset) : nullptr;
+}
+
+const SessionSustainSpan* SessionView::sustainSpans(size_t& count) const {
+    const SessionSectionEntry* section = findSection(SessionSection::SUSTAIN_SPANS, sizeof(SessionSustainSpan));
+    count = section ? static_cast<size_t>(section->count) : 0;
+    return section ? reinterpret_cast<const SessionSustainSpan*>(data + section->offset) : nullptr;
+}
+
+const SessionChord* SessionView::chords(size_t& count) const {
+    const SessionSectionEntry* section = findSection(SessionSection::CHORDS, sizeof(SessionChord));
+    count = section ? static_cast<size_t>(section->count) : 0;
+    return section ? reinterpret_cast<const SessionChord*>(data + section->offset) : nullptr;
+}
+
+const SessionKeyRegion* SessionView::keyRegions(size_t& count) const {
+    const SessionSectionEntry* section = findSection(SessionSection::KEY_REGIONS, sizeof(SessionKeyRegion));
+    count = section ? static_cast<size_t>(section->count) : 0;
+    return section ? reinterpret_cast<const SessionKeyRegion*>(data + section->offset) : nullptr;
+}
+
+const SessionProgression* SessionView::progressions(size_t& count) const {
+    const SessionSectionEntry* section = findSection(SessionSection::PROGRESSIONS, sizeof(SessionProgression));
+    count = section ? static_cast<size_t>(section->count) : 0;
+    return section ? reinterpret_cast<const SessionProgression*>(data + section->offset) : nullptr;
+}
+
+const uint8_t* SessionView::pitches(uint32_t offset) const {
+    return pitchPool + offset;
+}
+
+const int32_t* SessionView::indices(uint32_t offset) const {
+    return indexPool + offset;
+}
+
+std::string SessionView::string(const SessionString& reference) const {
+    return std::string(stringPool + reference.offset, reference.length);
+}
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "../../include/core/voice_assignment.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace midi_transformer {
+
+namespace {
+
+const int UNREACHABLE = std::numeric_limits<int>::max() / 4;
+
+// Pitches in ascending order along with their input indices; chords are
+// small, so an insertion sort beats anything fancier
+void sortPitches(const uint8_t* pitches, size_t count, int* sorted, size_t* order) {
+    for (size_t i = 0; i < count; i++) {
+        int pitch = pitches[i];
+        size_t j = i;
+        while (j > 0 && sorted[j - 1] > pitch) {
+            sorted[j] = sorted[j - 1];
+            order[j] = order[j - 1];
+            j--;
+        }
+        sorted[j] = pitch;
+        order[j] = i;
+    }
+}
+
+} // namespace
+
+VoiceAssigner::VoiceAssigner(int maxMovement, int penalty)
+    : maxVoiceMovement(maxMovement), overLimitPenalty(penalty) {
+}
+
+int VoiceAssigner::assign(const uint8_t* originals, size_t originalCount,
+                          const uint8_t* targets, size_t targetCount,
+                          int* targetForOriginal) const {
+    if (targetForOriginal) {
+        std::fill(targetForOriginal, targetForOriginal + originalCount, -1);
+    }
+    if (originalCount == 0 || targetCount == 0) {
+        return 0;
+    }
+    
+    if (originalCount <= MAX_STACK_VOICES && targetCount <= MAX_STACK_VOICES) {
+        int sortedOriginals[MAX_STACK_VOICES];
+        int sortedTargets[MAX_STACK_VOICES];
+        size_t originalOrder[MAX_STACK_VOICES];
+        size_t targetOrder[MAX_STACK_VOICES];
+        int table[(MAX_STACK_VOICES + 1) * (MAX_STACK_VOICES + 1)];
+        sortPitches(originals, originalCount, sortedOriginals, originalOrder);
+        sortPitches(targets, targetCount, sortedTargets, targetOrder);
+        return solveSorted(sortedOriginals, originalOrder, originalCount,
+                           sortedTargets, targetOrder, targetCount, table, targetForOriginal);
+    }
+    
+    // Dense clusters beyond the stack capacity fall back to heap storage
+    std::vector<int> sortedOriginals(originalCount);
+    std::vector<int> sortedTargets(targetCount);
+    std::vector<size_t> originalOrder(originalCount);
+    std::vector<size_t> targetOrder(targetCount);
+    std::vector<int> table((originalCount + 1) * (targetCount + 1));
+    sortPitches(originals, originalCount, sortedOriginals.data(), originalOrder.data());
+    sortPitches(targets, targetCount, sortedTargets.data(), targetOrder.data());
+    return solveSorted(sortedOriginals.data(), originalOrder.data(), originalCount,
+                       sortedTargets.data(), targetOrder.data(), targetCount, table.data(), targetForOriginal);
+}
+
+int VoiceAssigner::assign(const std::vector<uint8_t>& originals,
+                          const std::vector<uint8_t>& targets,
+                          std::vector<int>* targetForOriginal) const {
+    if (targetForOriginal) {
+        targetForOriginal->resize(originals.size());
+    }
+    return assign(originals.data(), originals.size(), targets.data(), targets.size(),
+                  targetForOriginal ? targetForOriginal->data() : nullptr);
+}
+
+int VoiceAssigner::cost(const int* sortedOriginals, size_t originalCount,
+                        const uint8_t* targets, size_t targetCount) const {
+    if (originalCount == 0 || targetCount == 0) {
+        return 0;
+    }
+    
+    if (originalCount <= MAX_STACK_VOICES && targetCount <= MAX_STACK_VOICES) {
+        int sortedTargets[MAX_STACK_VOICES];
+        size_t targetOrder[MAX_STACK_VOICES];
+        int table[(MAX_STACK_VOICES + 1) * (MAX_STACK_VOICES + 1)];
+        sortPitches(targets, targetCount, sortedTargets, targetOrder);
+        return solveSorted(sortedOriginals, nullptr, originalCount,
+                           sortedTargets, targetOrder, targetCount, table, nullptr);
+    }
+    
+    std::vector<int> sortedTargets(targetCount);
+    std::vector<size_t> targetOrder(targetCount);
+    std::vector<int> table((originalCount + 1) * (targetCount + 1));
+    sortPitches(targets, targetCount, sortedTargets.data(), targetOrder.data());
+    return solveSorted(sortedOriginals, nullptr, originalCount,
+                       sortedTargets.data(), targetOrder.data(), targetCount, table.data(), nullptr);
+}
+
+int VoiceAssigner::solveSorted(const int* originals, const size_t* originalOrder, size_t originalCount,
+                               const int* targets, const size_t* targetOrder, size_t targetCount,
+                               int* table, int* targetForOriginal) const {
+    const size_t n = originalCount;
+    const size_t m = targetCount;
+    const size_t width = m + 1;
+    
+    // Equal voice counts: without crossings the k-th lowest voice takes the k-th lowest pitch
+    if (n == m) {
+        int total = 0;
+        for (size_t k = 0; k < n; k++) {
+            total += moveCost(targets[k] - originals[k]);
+            if (targetForOriginal) {
+                targetForOriginal[originalOrder[k]] = static_cast<int>(targetOrder[k]);
+            }
+        }
+        return total;
+    }
+    
+    if (n < m) {
+        // Every original takes its own target and spare = m - n targets stay
+        // unused. table[i][j]: best cost for the lowest i originals within the
+        // lowest j targets; only j in [i, i + spare] can lead to a full assignment.
+        const size_t spare = m - n;
+        for (size_t j = 0; j <= spare; j++) {
+            table[j] = 0;
+        }
+        for (size_t i = 1; i <= n; i++) {
+            int* row = table + i * width;
+            const int* previous = row - width;
+            row[i] = previous[i - 1] + moveCost(targets[i - 1] - originals[i - 1]);
+            for (size_t j = i + 1; j <= i + spare; j++) {
+                int takeTarget = previous[j - 1] + moveCost(targets[j - 1] - originals[i - 1]);
+                row[j] = std::min(row[j - 1], takeTarget);
+            }
+        }
+        
+        if (targetForOriginal) {
+            size_t i = n;
+            size_t j = m;
+            while (i > 0) {
+                if (j > i && table[i * width + j] == table[i * width + j - 1]) {
+                    j--;
+                } else {
+                    targetForOriginal[originalOrder[i - 1]] = static_cast<int>(targetOrder[j - 1]);
+                    i--;
+                    j--;
+                }
+            }
+        }
+        return table[n * width + m];
+    }
+    
+    // More originals than targets: every target is reached and neighbouring
+    // voices merge. table[i][j]: best cost with original i-1 moving to target
+    // j-1; only j in [first(i), last(i)] leaves every target reachable.
+    const size_t surplus = n - m;
+    auto first = [&](size_t i) { return i == 0 ? 0 : std::max<size_t>(1, i > surplus ? i - surplus : 1); };
+    auto last = [&](size_t i) { return std::min(i, m); };
+    auto reachable = [&](size_t i, size_t j) { return j >= first(i) && j <= last(i); };
+    
+    table[0] = 0;
+    for (size_t i = 1; i <= n; i++) {
+        int* row = table + i * width;
+        const int* previous = row - width;
+        for (size_t j = first(i); j <= last(i); j++) {
+            int best = UNREACHABLE;
+            if (reachable(i - 1, j)) {
+                best = previous[j];
+            }
+            if (reachable(i - 1, j - 1)) {
+                best = std::min(best, previous[j - 1]);
+            }
+            row[j] = best + moveCost(targets[j - 1] - originals[i - 1]);
+        }
+    }
+    
+    if (targetForOriginal) {
+        size_t i = n;
+        size_t j = m;
+        while (i > 0) {
+            targetForOriginal[originalOrder[i - 1]] = static_cast<int>(targetOrder[j - 1]);
+            int remaining = table[i * width + j] - moveCost(targets[j - 1] - originals[i - 1]);
+            i--;
+            if (!reachable(i, j) || table[i * width + j] != remaining) {
+                j--;
+            }
+        }
+    }
+    return table[n * width + m];
+}
+
+} // namespace midi_transformer
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "../../include/core/voice_leading_engine.h"
+#include "../../include/core/voice_assignment.h"
 #include "../../include/utils/midi_utils.h"
 
 #include <algorithm>
@@ -9,6 +10,90 @@
 
 namespace midi_transformer {
 
+namespace {
+
+// Inputs and running state of one candidate scan
+struct CandidateScan {
+    const uint8_t* voicings;        // Row-major, voiceCount pitches per candidate
+    size_t count;
+    size_t voiceCount;
+    const uint8_t* hasParallels;    // One flag per candidate when screening
+    const int* sortedOriginals;
+    size_t originalCount;
+    int maxVoiceMovement;
+    int lowerBound;
+    size_t nodeBudget;
+    int timeBudgetMicros;
+    std::chrono::steady_clock::time_point start;
+    
+    size_t nodesVisited;
+    bool budgetExhausted;
+    size_t bestCandidate;
+    int bestCost;
+};
+
+// The candidate loop with every option fixed at compile time. The voice
+// count penalty is the same for all candidates of a scan but is still added
+// per candidate, so costs stay comparable with calculateMovementCost.
+template <bool AvoidParallels, bool MinimizeMovement, bool MaintainVoiceCount, bool Budgeted>
+void scanKernel(CandidateScan& scan) {
+    VoiceAssigner assigner(scan.maxVoiceMovement);
+    const int countPenalty = (MaintainVoiceCount && scan.originalCount != scan.voiceCount) ? 1000 : 0;
+    
+    for (size_t c = 0; c < scan.count; c++) {
+        if (AvoidParallels && scan.hasParallels[c]) {
+            continue;
+        }
+        
+        // Same rules as VoiceLeadingEngine::searchBudgetSpent
+        if (Budgeted && scan.nodesVisited > 0) {
+            bool spent = scan.nodeBudget > 0 && scan.nodesVisited >= scan.nodeBudget;
+            if (!spent && scan.timeBudgetMicros > 0 && scan.nodesVisited % 32 == 0) {
+                auto elapsed = std::chrono::steady_clock::now() - scan.start;
+                spent = elapsed >= std::chrono::microseconds(scan.timeBudgetMicros);
+            }
+            if (spent) {
+                scan.budgetExhausted = true;
+                break;
+            }
+        }
+        
+        int cost = countPenalty + assigner.cost(scan.sortedOriginals, scan.originalCount,
+                                                scan.voicings + c * scan.voiceCount, scan.voiceCount);
+        if (MinimizeMovement) {
+            cost *= 2;
+        }
+        scan.nodesVisited++;
+        
+        if (cost < scan.bestCost) {
+            scan.bestCost = cost;
+            scan.bestCandidate = c;
+            
+            // Nothing later can undercut the bound, and ties keep the earlier candidate
+            if (cost <= scan.lowerBound) {
+                break;
+            }
+        }
+    }
+}
+
+// Kernel index bits: 1 avoidParallels, 2 minimizeMovement, 4 maintainVoiceCount, 8 budgeted
+template <unsigned Flags>
+void scanKernelFor(CandidateScan& scan) {
+    scanKernel<(Flags & 1) != 0, (Flags & 2) != 0, (Flags & 4) != 0, (Flags & 8) != 0>(scan);
+}
+
+typedef void (*ScanKernel)(CandidateScan&);
+
+const ScanKernel SCAN_KERNELS[16] = {
+    scanKernelFor<0>, scanKernelFor<1>, scanKernelFor<2>, scanKernelFor<3>,
+    scanKernelFor<4>, scanKernelFor<5>, scanKernelFor<6>, scanKernelFor<7>,
+    scanKernelFor<8>, scanKernelFor<9>, scanKernelFor<10>, scanKernelFor<11>,
+    scanKernelFor<12>, scanKernelFor<13>, scanKernelFor<14>, scanKernelFor<15>
+};
+
+} // namespace
+
 VoiceLeadingEngine::VoiceLeadingEngine(const VoiceLeadingOptions& opts) {
     options = std::make_shared<VoiceLeadingOptions>(opts);
 }
@@ -114,59 +199,40 @@ std::vector<uint8_t> VoiceLeadingEngine::transformChord(
             // Interpolate between original and target
             std::vector<uint8_t> result;
             
-            // Match original notes to target notes
+            // Move each original voice along its optimal one-to-one assignment
             std::vector<std::pair<uint8_t, uint8_t>> notePairs;
+            std::vector<int> targetForOriginal;
+            VoiceAssigner assigner(options->maxVoiceMovement);
+            assigner.assign(originalNotes, targetWithVoiceLeading, &targetForOriginal);
             
-            // Create pairs of original and target notes
-            if (originalNotes.size() == targetWithVoiceLeading.size()) {
-                // Simple case: same number of notes
-                for (size_t i = 0; i < originalNotes.size(); i++) {
-                    notePairs.push_back({originalNotes[i], targetWithVoiceLeading[i]});
+            std::vector<bool> targetReached(targetWithVoiceLeading.size(), false);
+            for (size_t i = 0; i < originalNotes.size(); i++) {
+                int target = targetForOriginal[i];
+                if (target >= 0) {
+                    notePairs.push_back({originalNotes[i], targetWithVoiceLeading[target]});
+                    targetReached[target] = true;
                 }
-            } else {
-                // Complex case: different number of notes
-                // For each original note, find the closest target note
-                for (uint8_t origNote : originalNotes) {
-                    uint8_t closestTargetNote = 0;
-                    int minDistance = std::numeric_limits<int>::max();
-                    
-                    for (uint8_t targetNote : targetWithVoiceLeading) {
-                        int distance = std::abs(static_cast<int>(origNote) - static_cast<int>(targetNote));
-                        if (distance < minDistance) {
-                            minDistance = distance;
-                            closestTargetNote = targetNote;
-                        }
-                    }
-                    
-                    notePairs.push_back({origNote, closestTargetNote});
+            }
+            
+            // New voices grow out of the closest original note
+            for (size_t t = 0; t < targetWithVoiceLeading.size(); t++) {
+                if (targetReached[t]) {
+                    continue;
                 }
                 
-                // Add any remaining target notes
-                for (uint8_t targetNote : targetWithVoiceLeading) {
-                    bool found = false;
-                    for (const auto& pair : notePairs) {
-                        if (pair.second == targetNote) {
-                            found = true;
-                            break;
-                        }
-                    }
-                    
-                    if (!found) {
-                        // Find the closest original note
-                        uint8_t closestOrigNote = 0;
-                        int minDistance = std::numeric_limits<int>::max();
-                        
-                        for (uint8_t origNote : originalNotes) {
-                            int distance = std::abs(static_cast<int>(origNote) - static_cast<int>(targetNote));
-                            if (distance < minDistance) {
-                                minDistance = distance;
-                                closestOrigNote = origNote;
-                            }
-                        }
-                        
-                        notePairs.push_back({closestOrigNote, targetNote});
+                uint8_t targetNote = targetWithVoiceLeading[t];
+                uint8_t closestOrigNote = targetNote;
+                int minDistance = std::numeric_limits<int>::max();
+                
+                for (uint8_t origNote : originalNotes) {
+                    int distance = std::abs(static_cast<int>(origNote) - static_cast<int>(targetNote));
+                    if (distance < minDistance) {
+                        minDistance = distance;
+                        closestOrigNote = origNote;
                     }
                 }
+                
+                notePairs.push_back({closestOrigNote, targetNote});
             }
             
             // Interpolate each note pair
@@ -187,6 +253,28 @@ std::vector<uint8_t> VoiceLeadingEngine::transformChord(
             return findOptimalVoicing(targetChordNotes, originalNotes);
         }
         
+        case TransformationType::KEY_CONSTRAINED: {
+            // Chord tones outside the key snap to the nearest scale degree
+            // before the search, so every candidate voicing is already in
+            // key and tones that snap together are placed only once
+            PitchClassMask scale = transformOptions.keyScale & 0xFFF;
+            if (scale == 0) {
+                return findOptimalVoicing(targetChordNotes, originalNotes);
+            }
+            
+            PitchClassMask placed = 0;
+            keyPitchClasses.clear();
+            for (uint8_t note : targetChordNotes) {
+                uint8_t pitchClass = snapToScale(scale, note % 12);
+                if (!((placed >> pitchClass) & 1)) {
+                    placed |= static_cast<PitchClassMask>(1u << pitchClass);
+                    keyPitchClasses.push_back(pitchClass);
+                }
+            }
+            
+            return findOptimalVoicing(keyPitchClasses, originalNotes);
+        }
+        
         default:
             // Default to standard transformation
             return findOptimalVoicing(targetChordNotes, originalNotes);
@@ -197,160 +285,448 @@ std::vector<uint8_t> VoiceLeadingEngine::findOptimalVoicing(
     const std::vector<uint8_t>& targetPitches,
     const std::vector<uint8_t>& originalNotes) {
     
+    lastSearchResult = searchVoicing(targetPitches, originalNotes);
+    return lastSearchResult.voicing;
+}
+
+VoicingSearchResult VoiceLeadingEngine::searchVoicing(
+    const std::vector<uint8_t>& targetPitches,
+    const std::vector<uint8_t>& originalNotes) {
+    
+    auto start = std::chrono::steady_clock::now();
+    VoicingSearchResult result;
+    
     // First, normalize the target pitches to the same octave range
     std::vector<uint8_t> normalizedTargetPitches;
     for (uint8_t pitch : targetPitches) {
         normalizedTargetPitches.push_back(pitch % 12);
     }
     
-    // Create all possible voicings of the target chord
-    std::vector<std::vector<uint8_t>> possibleVoicings;
+    if (!originalNotes.empty() && !normalizedTargetPitches.empty()) {
+        // Determine the octave range to consider
+        uint8_t minOriginalNote = *std::min_element(originalNotes.begin(), originalNotes.end());
+        uint8_t maxOriginalNote = *std::max_element(originalNotes.begin(), originalNotes.end());
+        
+        int minOctave = std::max(0, static_cast<int>(minOriginalNote / 12) - 1);
+        int maxOctave = std::min(10, static_cast<int>(maxOriginalNote / 12) + 1);
+        
+        result.lowerBound = movementLowerBound(originalNotes, normalizedTargetPitches, minOctave, maxOctave);
+        
+        // Size of the voicing space, counted only up to the exhaustive limit
+        size_t candidateCount = 1;
+        for (uint8_t pitchClass : normalizedTargetPitches) {
+            int highestOctave = std::min(maxOctave, (127 - pitchClass) / 12);
+            candidateCount *= static_cast<size_t>(std::max(0, highestOctave - minOctave + 1));
+            if (candidateCount > options->exhaustiveSearchLimit) {
+                break;
+            }
+        }
+        
+        if (candidateCount <= options->exhaustiveSearchLimit) {
+            exhaustiveVoicingSearch(normalizedTargetPitches, originalNotes, minOctave, maxOctave, start, result);
+        } else {
+            beamVoicingSearch(normalizedTargetPitches, originalNotes, minOctave, maxOctave, start, result);
+        }
+    }
+    
+    // If we still don't have a voicing, use the target pitches in a middle octave
+    if (result.voicing.empty()) {
+        for (uint8_t pitch : normalizedTargetPitches) {
+            result.voicing.push_back(pitch + (5 * 12)); // Octave 5
+        }
+        result.cost = calculateMovementCost(originalNotes, result.voicing);
+        result.provablyOptimal = false;
+    }
+    
+    return result;
+}
+
+const VoicingSearchResult& VoiceLeadingEngine::getLastSearchResult() const {
+    return lastSearchResult;
+}
+
+void VoiceLeadingEngine::exhaustiveVoicingSearch(
+    const std::vector<uint8_t>& pitchClasses,
+    const std::vector<uint8_t>& originalNotes,
+    int minOctave, int maxOctave,
+    std::chrono::steady_clock::time_point start,
+    VoicingSearchResult& result) {
+    
+    result.exhaustive = true;
     
-    // Determine the octave range to consider
-    uint8_t minOriginalNote = *std::min_element(originalNotes.begin(), originalNotes.end());
-    uint8_t maxOriginalNote = *std::max_element(originalNotes.begin(), originalNotes.end());
+    // All octave placements of the target chord within the range, shared across calls
+    std::shared_ptr<const VoicingTable> table =
+        VoicingDictionary::shared().lookup(pitchClasses, minOctave, maxOctave);
+    const VoicingCandidates& candidates = table->candidates;
     
-    int minOctave = std::max(0, static_cast<int>(minOriginalNote / 12) - 1);
-    int maxOctave = std::min(10, static_cast<int>(maxOriginalNote / 12) + 1);
+    // Screen every candidate for parallels up front, so only the survivors are costed
+    std::vector<uint8_t> hasParallels;
+    if (options->avoidParallels) {
+        markParallelFifthsOrOctaves(originalNotes, candidates, hasParallels);
+    }
     
-    // Generate voicings within the octave range
-    std::function<void(std::vector<uint8_t>&, size_t, int)> generateVoicings = 
-        [&](std::vector<uint8_t>& currentVoicing, size_t index, int currentOctave) {
-            if (index == normalizedTargetPitches.size()) {
-                possibleVoicings.push_back(currentVoicing);
-                return;
+    // Find the voicing with the minimum movement cost
+    int minCost = std::numeric_limits<int>::max();
+    size_t bestCandidate = scanCandidates(originalNotes, table->voicings.data(), candidates.count,
+                                          candidates.voiceCount, hasParallels, start, result, minCost);
+    
+    // If we couldn't find a valid voicing, just use the first one
+    bool foundValid = bestCandidate < candidates.count;
+    if (!foundValid && candidates.count > 0) {
+        bestCandidate = 0;
+        minCost = calculateMovementCost(originalNotes, table->voicing(0), candidates.voiceCount);
+    }
+    
+    if (bestCandidate < candidates.count) {
+        const uint8_t* voicing = table->voicing(bestCandidate);
+        result.voicing.assign(voicing, voicing + candidates.voiceCount);
+        result.cost = minCost;
+        result.provablyOptimal = foundValid && (!result.budgetExhausted || minCost <= result.lowerBound);
+    }
+}
+
+void VoiceLeadingEngine::beamVoicingSearch(
+    const std::vector<uint8_t>& pitchClasses,
+    const std::vector<uint8_t>& originalNotes,
+    int minOctave, int maxOctave,
+    std::chrono::steady_clock::time_point start,
+    VoicingSearchResult& result) {
+    
+    const size_t voiceCount = pitchClasses.size();
+    const size_t beamWidth = std::max<size_t>(1, options->beamWidth);
+    VoiceAssigner assigner(options->maxVoiceMovement);
+    
+    // Octave placements of each voice that stay within MIDI range (0-127)
+    std::vector<std::vector<uint8_t>> placements(voiceCount);
+    for (size_t k = 0; k < voiceCount; k++) {
+        for (int octave = minOctave; octave <= maxOctave; octave++) {
+            int pitch = pitchClasses[k] + octave * 12;
+            if (pitch <= 127) {
+                placements[k].push_back(static_cast<uint8_t>(pitch));
             }
-            
-            for (int octave = minOctave; octave <= maxOctave; octave++) {
-                uint8_t pitch = normalizedTargetPitches[index] + (octave * 12);
-                
-                // Check if the pitch is within MIDI range (0-127)
-                if (pitch <= 127) {
-                    currentVoicing[index] = pitch;
-                    generateVoicings(currentVoicing, index + 1, octave);
+        }
+        if (placements[k].empty()) {
+            return;
+        }
+    }
+    
+    // Seed: each voice in the octave closest to any original note, so there is
+    // an answer even if the budget runs out during the first layer
+    std::vector<uint8_t> seed(voiceCount);
+    for (size_t k = 0; k < voiceCount; k++) {
+        int bestDistance = std::numeric_limits<int>::max();
+        for (uint8_t pitch : placements[k]) {
+            for (uint8_t original : originalNotes) {
+                int distance = std::abs(static_cast<int>(pitch) - static_cast<int>(original));
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    seed[k] = pitch;
                 }
             }
-        };
+        }
+    }
+    result.voicing = seed;
+    result.cost = calculateMovementCost(originalNotes, seed);
+    result.nodesVisited++;
     
-    std::vector<uint8_t> currentVoicing(normalizedTargetPitches.size());
-    generateVoicings(currentVoicing, 0, minOctave);
+    bool seedValid = true;
+    if (options->avoidParallels) {
+        VoicingCandidates single;
+        single.voiceCount = voiceCount;
+        single.count = 1;
+        single.stride = VoicingCandidates::BATCH;
+        single.pitches.assign(voiceCount * single.stride, 0);
+        for (size_t v = 0; v < voiceCount; v++) {
+            single.pitches[v * single.stride] = seed[v];
+        }
+        std::vector<uint8_t> seedParallels;
+        markParallelFifthsOrOctaves(originalNotes, single, seedParallels);
+        seedValid = !seedParallels[0];
+    }
     
-    // Find the voicing with the minimum movement cost
-    int minCost = std::numeric_limits<int>::max();
-    std::vector<uint8_t> bestVoicing;
+    // Layer k holds voicings of voices 0..k, scored by how cheaply the placed
+    // voices can each be reached from distinct original voices
+    std::vector<uint8_t> beam;                  // Row-major prefixes of length k
+    std::vector<uint8_t> children;
+    std::vector<std::pair<int, size_t>> scores; // (score, child index)
+    size_t beamSize = 1;
     
-    for (const auto& voicing : possibleVoicings) {
-        // Skip voicings with parallel fifths/octaves if we're avoiding them
-        if (options->avoidParallels && hasParallelFifthsOrOctaves(originalNotes, voicing)) {
-            continue;
+    for (size_t k = 0; k < voiceCount; k++) {
+        const size_t length = k + 1;
+        const bool lastVoice = (length == voiceCount);
+        children.clear();
+        scores.clear();
+        
+        for (size_t b = 0; b < beamSize; b++) {
+            for (uint8_t pitch : placements[k]) {
+                if (!lastVoice && searchBudgetSpent(result, start)) {
+                    result.budgetExhausted = true;
+                    return;
+                }
+                
+                size_t child = children.size() / length;
+                children.insert(children.end(), beam.begin() + b * k, beam.begin() + (b + 1) * k);
+                children.push_back(pitch);
+                
+                if (!lastVoice) {
+                    int score = assigner.assign(&children[child * length], length,
+                                                originalNotes.data(), originalNotes.size());
+                    scores.push_back({score, child});
+                    result.nodesVisited++;
+                }
+            }
         }
         
-        // Calculate movement cost
-        int cost = calculateMovementCost(originalNotes, voicing);
+        if (lastVoice) {
+            break;
+        }
         
-        if (cost < minCost) {
-            minCost = cost;
-            bestVoicing = voicing;
+        // Keep the best beamWidth prefixes, ties in generation order
+        size_t kept = std::min(beamWidth, scores.size());
+        std::partial_sort(scores.begin(), scores.begin() + kept, scores.end());
+        beam.resize(kept * length);
+        for (size_t i = 0; i < kept; i++) {
+            std::copy(children.begin() + scores[i].second * length,
+                      children.begin() + (scores[i].second + 1) * length,
+                      beam.begin() + i * length);
         }
+        beamSize = kept;
     }
     
-    // If we couldn't find a valid voicing, just use the first one
-    if (bestVoicing.empty() && !possibleVoicings.empty()) {
-        bestVoicing = possibleVoicings[0];
+    // Complete voicings: screen the whole last layer for parallels, then cost the rest
+    VoicingCandidates finalists;
+    finalists.voiceCount = voiceCount;
+    finalists.count = children.size() / voiceCount;
+    finalists.stride = (finalists.count + VoicingCandidates::BATCH - 1) / VoicingCandidates::BATCH * VoicingCandidates::BATCH;
+    finalists.pitches.assign(voiceCount * finalists.stride, 0);
+    for (size_t c = 0; c < finalists.count; c++) {
+        for (size_t v = 0; v < voiceCount; v++) {
+            finalists.pitches[v * finalists.stride + c] = children[c * voiceCount + v];
+        }
     }
     
-    // If we still don't have a voicing, use the target pitches in a middle octave
-    if (bestVoicing.empty()) {
-        for (uint8_t pitch : normalizedTargetPitches) {
-            bestVoicing.push_back(pitch + (5 * 12)); // Octave 5
+    std::vector<uint8_t> hasParallels;
+    if (options->avoidParallels) {
+        markParallelFifthsOrOctaves(originalNotes, finalists, hasParallels);
+    }
+    
+    int minCost = std::numeric_limits<int>::max();
+    size_t bestCandidate = scanCandidates(originalNotes, children.data(), finalists.count,
+                                          voiceCount, hasParallels, start, result, minCost);
+    
+    // A seed with parallels only stands if no finalist avoids them
+    if (bestCandidate < finalists.count && (!seedValid || minCost <= result.cost)) {
+        result.voicing.assign(children.begin() + bestCandidate * voiceCount,
+                              children.begin() + (bestCandidate + 1) * voiceCount);
+        result.cost = minCost;
+        seedValid = true;
+    }
+    result.provablyOptimal = seedValid && result.cost <= result.lowerBound;
+}
+
+size_t VoiceLeadingEngine::scanCandidates(
+    const std::vector<uint8_t>& originalNotes,
+    const uint8_t* voicings, size_t count, size_t voiceCount,
+    const std::vector<uint8_t>& hasParallels,
+    std::chrono::steady_clock::time_point start,
+    VoicingSearchResult& result,
+    int& bestCost) const {
+    
+    // Options are read once here rather than per candidate
+    std::vector<int> sortedOriginals(originalNotes.begin(), originalNotes.end());
+    std::sort(sortedOriginals.begin(), sortedOriginals.end());
+    
+    CandidateScan scan;
+    scan.voicings = voicings;
+    scan.count = count;
+    scan.voiceCount = voiceCount;
+    scan.hasParallels = hasParallels.empty() ? nullptr : hasParallels.data();
+    scan.sortedOriginals = sortedOriginals.data();
+    scan.originalCount = sortedOriginals.size();
+    scan.maxVoiceMovement = options->maxVoiceMovement;
+    scan.lowerBound = result.lowerBound;
+    scan.nodeBudget = options->searchNodeBudget;
+    scan.timeBudgetMicros = options->searchTimeBudgetMicros;
+    scan.start = start;
+    scan.nodesVisited = result.nodesVisited;
+    scan.budgetExhausted = false;
+    scan.bestCandidate = count;
+    scan.bestCost = bestCost;
+    
+    bool budgeted = scan.nodeBudget > 0 || scan.timeBudgetMicros > 0;
+    unsigned flags = (scan.hasParallels ? 1u : 0u)
+                   | (options->minimizeMovement ? 2u : 0u)
+                   | (options->maintainVoiceCount ? 4u : 0u)
+                   | (budgeted ? 8u : 0u);
+    SCAN_KERNELS[flags](scan);
+    
+    result.nodesVisited = scan.nodesVisited;
+    result.budgetExhausted = result.budgetExhausted || scan.budgetExhausted;
+    bestCost = scan.bestCost;
+    return scan.bestCandidate;
+}
+
+bool VoiceLeadingEngine::searchBudgetSpent(
+    const VoicingSearchResult& result,
+    std::chrono::steady_clock::time_point start) const {
+    
+    // The first voicing is always scored, so every search has an answer
+    if (result.nodesVisited == 0) {
+        return false;
+    }
+    if (options->searchNodeBudget > 0 && result.nodesVisited >= options->searchNodeBudget) {
+        return true;
+    }
+    
+    // Reading the clock for every node would dominate small searches
+    if (options->searchTimeBudgetMicros > 0 && result.nodesVisited % 32 == 0) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed >= std::chrono::microseconds(options->searchTimeBudgetMicros);
+    }
+    return false;
+}
+
+int VoiceLeadingEngine::movementLowerBound(
+    const std::vector<uint8_t>& originalNotes,
+    const std::vector<uint8_t>& pitchClasses,
+    int minOctave, int maxOctave) const {
+    
+    VoiceAssigner assigner(options->maxVoiceMovement);
+    int bound = 0;
+    
+    for (uint8_t original : originalNotes) {
+        int cheapest = std::numeric_limits<int>::max();
+        for (uint8_t pitchClass : pitchClasses) {
+            for (int octave = minOctave; octave <= maxOctave; octave++) {
+                int pitch = pitchClass + octave * 12;
+                if (pitch <= 127) {
+                    cheapest = std::min(cheapest, assigner.moveCost(pitch - original));
+                }
+            }
+        }
+        if (cheapest != std::numeric_limits<int>::max()) {
+            bound += cheapest;
         }
     }
     
-    return bestVoicing;
+    // Same adjustments as calculateMovementCost
+    if (options->maintainVoiceCount && originalNotes.size() != pitchClasses.size()) {
+        bound += 1000;
+    }
+    if (options->minimizeMovement) {
+        bound *= 2;
+    }
+    
+    return bound;
 }
 
-bool VoiceLeadingEngine::hasParallelFifthsOrOctaves(
+void VoiceLeadingEngine::markParallelFifthsOrOctaves(
     const std::vector<uint8_t>& originalNotes,
-    const std::vector<uint8_t>& newNotes) {
+    const VoicingCandidates& candidates,
+    std::vector<uint8_t>& hasParallels) const {
+    
+    hasParallels.assign(candidates.count, 0);
     
     // We need at least 2 notes in each chord to check for parallels
-    if (originalNotes.size() < 2 || newNotes.size() < 2) {
-        return false;
+    const size_t voiceCount = candidates.voiceCount;
+    if (originalNotes.size() < 2 || voiceCount < 2 || candidates.count == 0) {
+        return;
     }
     
-    // Check all pairs of notes for parallel fifths or octaves
+    // Perfect intervals of the original chord, computed once. Every candidate
+    // keeps each voice's pitch class, so whether a pair lands on the same
+    // interval only depends on which of its two voices ends up higher.
+    struct PerfectPair {
+        const uint8_t* columnI;
+        const uint8_t* columnJ;
+        uint8_t originalI;
+        uint8_t originalJ;
+        uint8_t matchWhenIAbove;
+        uint8_t matchWhenIBelow;
+    };
+    std::vector<PerfectPair> pairs;
+    
     for (size_t i = 0; i < originalNotes.size(); i++) {
         for (size_t j = i + 1; j < originalNotes.size(); j++) {
-            // Calculate interval between notes in original chord
             int originalInterval = std::abs(static_cast<int>(originalNotes[i]) - static_cast<int>(originalNotes[j])) % 12;
             
             // Check if this is a fifth (7 semitones) or octave (0 semitones)
-            if (originalInterval == 7 || originalInterval == 0) {
-                // Find corresponding notes in new chord
-                size_t newI = i < newNotes.size() ? i : 0;
-                size_t newJ = j < newNotes.size() ? j : newNotes.size() - 1;
-                
-                // Calculate interval between notes in new chord
-                int newInterval = std::abs(static_cast<int>(newNotes[newI]) - static_cast<int>(newNotes[newJ])) % 12;
-                
-                // Check if the interval is preserved (parallel motion)
-                if (newInterval == originalInterval) {
-                    // Check if both notes moved in the same direction
-                    bool iMoved = originalNotes[i] != newNotes[newI];
-                    bool jMoved = originalNotes[j] != newNotes[newJ];
-                    
-                    if (iMoved && jMoved) {
-                        int iDirection = newNotes[newI] > originalNotes[i] ? 1 : -1;
-                        int jDirection = newNotes[newJ] > originalNotes[j] ? 1 : -1;
-                        
-                        if (iDirection == jDirection) {
-                            return true; // Parallel fifth or octave found
-                        }
-                    }
-                }
+            if (originalInterval != 7 && originalInterval != 0) {
+                continue;
+            }
+            
+            // Find corresponding voices in the candidates
+            size_t newI = i < voiceCount ? i : 0;
+            size_t newJ = j < voiceCount ? j : voiceCount - 1;
+            
+            PerfectPair pair;
+            pair.columnI = candidates.pitches.data() + newI * candidates.stride;
+            pair.columnJ = candidates.pitches.data() + newJ * candidates.stride;
+            pair.originalI = originalNotes[i];
+            pair.originalJ = originalNotes[j];
+            
+            int classI = pair.columnI[0] % 12;
+            int classJ = pair.columnJ[0] % 12;
+            pair.matchWhenIAbove = ((classI - classJ + 12) % 12) == originalInterval;
+            pair.matchWhenIBelow = ((classJ - classI + 12) % 12) == originalInterval;
+            
+            if (pair.matchWhenIAbove || pair.matchWhenIBelow) {
+                pairs.push_back(pair);
             }
         }
     }
     
-    return false;
+    if (pairs.empty()) {
+        return;
+    }
+    
+    // Branch-free lanes over fixed-size batches, which the compiler vectorizes.
+    // A pair moves in parallel when it keeps its interval and both voices move
+    // in the same direction.
+    const size_t BATCH = VoicingCandidates::BATCH;
+    for (size_t base = 0; base < candidates.count; base += BATCH) {
+        uint8_t flags[BATCH] = {};
+        
+        for (const auto& pair : pairs) {
+            const uint8_t* newI = pair.columnI + base;
+            const uint8_t* newJ = pair.columnJ + base;
+            
+            for (size_t lane = 0; lane < BATCH; lane++) {
+                uint8_t a = newI[lane];
+                uint8_t b = newJ[lane];
+                uint8_t sameInterval = a >= b ? pair.matchWhenIAbove : pair.matchWhenIBelow;
+                uint8_t bothUp = (a > pair.originalI) & (b > pair.originalJ);
+                uint8_t bothDown = (a < pair.originalI) & (b < pair.originalJ);
+                flags[lane] |= sameInterval & (bothUp | bothDown);
+            }
+        }
+        
+        size_t lanes = std::min(BATCH, candidates.count - base);
+        std::copy(flags, flags + lanes, hasParallels.begin() + base);
+    }
 }
 
 int VoiceLeadingEngine::calculateMovementCost(
     const std::vector<uint8_t>& originalNotes,
     const std::vector<uint8_t>& newNotes) {
     
+    return calculateMovementCost(originalNotes, newNotes.data(), newNotes.size());
+}
+
+int VoiceLeadingEngine::calculateMovementCost(
+    const std::vector<uint8_t>& originalNotes,
+    const uint8_t* newNotes, size_t newCount) {
+    
     int cost = 0;
     
     // If we want to maintain voice count and the counts don't match, apply a high penalty
-    if (options->maintainVoiceCount && originalNotes.size() != newNotes.size()) {
+    if (options->maintainVoiceCount && originalNotes.size() != newCount) {
         cost += 1000;
     }
     
-    // Calculate total movement distance
-    std::vector<int> movements;
-    
-    // Match each original note to the closest new note
-    for (uint8_t origNote : originalNotes) {
-        int minDistance = std::numeric_limits<int>::max();
-        
-        for (uint8_t newNote : newNotes) {
-            int distance = std::abs(static_cast<int>(newNote) - static_cast<int>(origNote));
-            minDistance = std::min(minDistance, distance);
-        }
-        
-        movements.push_back(minDistance);
-    }
-    
-    // Apply cost based on movement distance
-    for (int movement : movements) {
-        // Penalize movements beyond the max voice movement
-        if (movement > options->maxVoiceMovement) {
-            cost += (movement - options->maxVoiceMovement) * 10;
-        }
-        
-        // Basic movement cost
-        cost += movement;
-    }
+    // Optimal one-to-one movement, with penalties beyond the max voice movement
+    VoiceAssigner assigner(options->maxVoiceMovement);
+    cost += assigner.assign(originalNotes.data(), originalNotes.size(), newNotes, newCount);
     
     // If we're minimizing movement, apply a higher weight to the total distance
     if (options->minimizeMovement) {
@@ -366,23 +742,23 @@ std::vector<std::shared_ptr<VoiceMovement>> VoiceLeadingEngine::analyzeVoiceMove
     
     std::vector<std::shared_ptr<VoiceMovement>> movements;
     
-    // Match each original note to the closest new note
-    for (uint8_t origNote : originalNotes) {
-        uint8_t closestNewNote = 0;
-        int minDistance = std::numeric_limits<int>::max();
-        
-        for (uint8_t newNote : newNotes) {
-            int distance = std::abs(static_cast<int>(newNote) - static_cast<int>(origNote));
-            if (distance < minDistance) {
-                minDistance = distance;
-                closestNewNote = newNote;
-            }
+    // Follow each original voice along the optimal one-to-one assignment
+    std::vector<int> targetForOriginal;
+    VoiceAssigner assigner(options->maxVoiceMovement);
+    assigner.assign(originalNotes, newNotes, &targetForOriginal);
+    
+    std::vector<bool> newNoteReached(newNotes.size(), false);
+    for (size_t i = 0; i < originalNotes.size(); i++) {
+        int target = targetForOriginal[i];
+        if (target < 0) {
+            continue;
         }
+        newNoteReached[target] = true;
         
         auto movement = std::make_shared<VoiceMovement>();
-        movement->originalPitch = origNote;
-        movement->newPitch = closestNewNote;
-        movement->movement = static_cast<int>(closestNewNote) - static_cast<int>(origNote);
+        movement->originalPitch = originalNotes[i];
+        movement->newPitch = newNotes[target];
+        movement->movement = static_cast<int>(newNotes[target]) - static_cast<int>(originalNotes[i]);
         
         // Determine if this is the smallest possible move
         movement->isSmallestPossibleMove = (std::abs(movement->movement) <= options->maxVoiceMovement);
@@ -391,19 +767,11 @@ std::vector<std::shared_ptr<VoiceMovement>> VoiceLeadingEngine::analyzeVoiceMove
     }
     
     // Add any new notes that weren't matched to original notes
-    for (uint8_t newNote : newNotes) {
-        bool found = false;
-        for (const auto& movement : movements) {
-            if (movement->newPitch == newNote) {
-                found = true;
-                break;
-            }
-        }
-        
-        if (!found) {
+    for (size_t t = 0; t < newNotes.size(); t++) {
+        if (!newNoteReached[t]) {
             auto movement = std::make_shared<VoiceMovement>();
             movement->originalPitch = 0; // No original pitch
-            movement->newPitch = newNote;
+            movement->newPitch = newNotes[t];
             movement->movement = 0; // New note, not a movement
             movement->isSmallestPossibleMove = true;
             
@@ -0,0 +1,124 @@
+#include "../../include/core/voicing_dictionary.h"
+
+#include <algorithm>
+
+namespace midi_transformer {
+
+VoicingDictionary& VoicingDictionary::shared() {
+    static VoicingDictionary dictionary;
+    return dictionary;
+}
+
+std::shared_ptr<const VoicingTable> VoicingDictionary::lookup(
+    const std::vector<uint8_t>& pitchClasses, int minOctave, int maxOctave) {
+    
+    // Sequences too long for the packed key are built without caching
+    if (pitchClasses.size() > MAX_KEYED_VOICES || minOctave < 0 || maxOctave > 15) {
+        return buildTable(pitchClasses, minOctave, maxOctave);
+    }
+    
+    // 4 bits per pitch class, then the voice count and the octave window
+    uint64_t key = 0;
+    for (uint8_t pitchClass : pitchClasses) {
+        key = (key << 4) | (pitchClass % 12);
+    }
+    key = (key << 4) | pitchClasses.size();
+    key = (key << 4) | static_cast<uint64_t>(minOctave);
+    key = (key << 4) | static_cast<uint64_t>(std::max(maxOctave, 0));
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = tables.find(key);
+        if (it != tables.end()) {
+            return it->second;
+        }
+    }
+    
+    // Build outside the lock; if another thread got there first, keep its table
+    std::shared_ptr<const VoicingTable> table = buildTable(pitchClasses, minOctave, maxOctave);
+    std::lock_guard<std::mutex> lock(mutex);
+    return tables.emplace(key, table).first->second;
+}
+
+size_t VoicingDictionary::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tables.size();
+}
+
+void VoicingDictionary::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    tables.clear();
+}
+
+std::shared_ptr<const VoicingTable> VoicingDictionary::buildTable(
+    const std::vector<uint8_t>& pitchClasses, int minOctave, int maxOctave) {
+    
+    auto table = std::make_shared<VoicingTable>();
+    VoicingCandidates& candidates = table->candidates;
+    const size_t voiceCount = pitchClasses.size();
+    candidates.voiceCount = voiceCount;
+    
+    if (voiceCount == 0) {
+        return table;
+    }
+    
+    // Octaves that keep each voice within MIDI range (0-127)
+    std::vector<int> octaveCounts(voiceCount);
+    size_t total = 1;
+    for (size_t k = 0; k < voiceCount; k++) {
+        int highestOctave = std::min(maxOctave, (127 - pitchClasses[k] % 12) / 12);
+        octaveCounts[k] = std::max(0, highestOctave - minOctave + 1);
+        total *= octaveCounts[k];
+    }
+    if (total == 0) {
+        return table;
+    }
+    
+    // Columns are padded to whole batches; padded lanes are never reported
+    candidates.count = total;
+    candidates.stride = (total + VoicingCandidates::BATCH - 1) / VoicingCandidates::BATCH * VoicingCandidates::BATCH;
+    candidates.pitches.assign(voiceCount * candidates.stride, 0);
+    
+    // Odometer order with the last voice turning fastest: voice k holds each
+    // octave for a run of repeat candidates, the product of later voices' counts
+    size_t repeat = 1;
+    for (size_t k = voiceCount; k-- > 0;) {
+        uint8_t* column = candidates.pitches.data() + k * candidates.stride;
+        size_t c = 0;
+        while (c < total) {
+            for (int octave = minOctave; octave < minOctave + octaveCounts[k]; octave++) {
+                std::fill(column + c, column + c + repeat, static_cast<uint8_t>(pitchClasses[k] % 12 + octave * 12));
+                c += repeat;
+            }
+        }
+        repeat *= octaveCounts[k];
+    }
+    
+    // Row copy, spans and interval signatures
+    table->voicings.resize(voiceCount * total);
+    table->spans.resize(total);
+    table->intervalSignatures.resize(total);
+    
+    for (size_t c = 0; c < total; c++) {
+        uint8_t* row = table->voicings.data() + c * voiceCount;
+        for (size_t k = 0; k < voiceCount; k++) {
+            row[k] = candidates.pitches[k * candidates.stride + c];
+        }
+        
+        auto [lowest, highest] = std::minmax_element(row, row + voiceCount);
+        table->spans[c] = *highest - *lowest;
+        
+        uint16_t signature = 0;
+        for (size_t i = 0; i < voiceCount; i++) {
+            for (size_t j = i + 1; j < voiceCount; j++) {
+                int interval = row[i] > row[j] ? row[i] - row[j] : row[j] - row[i];
+                signature |= static_cast<uint16_t>(1u << (interval % 12));
+            }
+        }
+        table->intervalSignatures[c] = signature;
+    }
+    
+    return table;
+}
+
+} // namespace midi_transformer
\ No newline at end of file
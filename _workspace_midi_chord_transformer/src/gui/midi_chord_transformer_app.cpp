@@ -1,4 +1,6 @@
 #include "../../include/gui/midi_chord_transformer_app.h"
+#include "../../include/core/input_deduplicator.h"
+#include "../../include/core/batch_supervisor.h"
 #include "../../include/utils/midi_utils.h"
 
 #include <iostream>
@@ -133,6 +135,13 @@ void MidiChordTransformerApp::renderMainWindow() {
                 }
             }
             ImGui::Separator();
+            if (ImGui::MenuItem("Open Session")) {
+                handleLoadSession();
+            }
+            if (ImGui::MenuItem("Save Session")) {
+                handleSaveSession();
+            }
+            ImGui::Separator();
             if (ImGui::MenuItem("Exit", "Alt+F4")) {
                 glfwSetWindowShouldClose(ImGui::GetCurrentContext()->PlatformHandleRaw, true);
             }
@@ -208,10 +217,50 @@ void MidiChordTransformerApp::renderControlPanel() {
         handleLoadFile();
     }
     
+    // Chord detection mode; chords are re-detected on the next use
+    bool useSegmentation = processor->getDetectionMode() == ChordDetectionMode::HARMONIC_SEGMENTATION;
+    if (ImGui::Checkbox("Overlap-aware detection (held notes, sustain pedal)", &useSegmentation)) {
+        processor->setDetectionMode(useSegmentation ? ChordDetectionMode::HARMONIC_SEGMENTATION 
+                                                    : ChordDetectionMode::ONSET_GROUPING);
+    }
+    
+    // Parser options (applied on the next load)
+    ParseOptions parseOptions = processor->getParseOptions();
+    bool ignoreDrums = (parseOptions.excludedChannels & DRUM_CHANNEL_MASK) != 0;
+    if (ImGui::Checkbox("Ignore drum channel (10)", &ignoreDrums)) {
+        parseOptions.excludedChannels ^= DRUM_CHANNEL_MASK;
+        processor->setParseOptions(parseOptions);
+    }
+    bool analysisOnly = parseOptions.profile == ParseProfile::ANALYSIS_ONLY;
+    if (ImGui::Checkbox("Analysis only (faster, cannot save MIDI)", &analysisOnly)) {
+        parseOptions.profile = analysisOnly ? ParseProfile::ANALYSIS_ONLY : ParseProfile::FULL;
+        processor->setParseOptions(parseOptions);
+    }
+    
+    // Chord grouping tolerance, calibrated per file unless set by hand
+    bool autoTolerance = processor->isAutoTimeTolerance();
+    if (ImGui::Checkbox("Auto time tolerance", &autoTolerance)) {
+        processor->setAutoTimeTolerance(autoTolerance);
+    }
+    if (autoTolerance && !processor->getCurrentFilename().empty()) {
+        ToleranceCalibration calibration = processor->getToleranceCalibration();
+        ImGui::Text("Tolerance: %u ticks (grid %u, spread %u)", 
+                    calibration.tolerance, calibration.grid, calibration.humanizationSpread);
+    }
+    
     // Display current file info
     if (!processor->getCurrentFilename().empty()) {
         ImGui::Text("Current File: %s", processor->getCurrentFilename().c_str());
         
+        renderTrackList();
+        
+        // Regrouping reads off precomputed onset clusters, so the slider updates live
+        int tolerance = static_cast<int>(processor->getTimeTolerance());
+        if (ImGui::SliderInt("Time Tolerance (ticks)", &tolerance, 0, 960)) {
+            processor->setTimeTolerance(static_cast<uint32_t>(tolerance));
+            resetChordSelection();
+        }
+        
         auto chords = processor->getChords();
         ImGui::Text("Detected Chords: %zu", chords.size());
         
@@ -248,7 +297,7 @@ void MidiChordTransformerApp::renderControlPanel() {
         
         // Transformation type
         static int transformType = 0;
-        ImGui::Combo("Transformation Type", &transformType, "Standard\0Inversion\0Percentage\0Switch Tonality\0");
+        ImGui::Combo("Transformation Type", &transformType, "Standard\0Inversion\0Percentage\0Switch Tonality\0Key Constrained\0");
         
         // Options based on transformation type
         switch (transformType) {
@@ -267,6 +316,9 @@ void MidiChordTransformerApp::renderControlPanel() {
                 
             case 3: // Switch Tonality
                 break;
+            
+            case 4: // Key Constrained
+                break;
         }
         
         // Voice leading options
@@ -310,6 +362,33 @@ void MidiChordTransformerApp::renderControlPanel() {
     ImGui::EndChild();
 }
 
+void MidiChordTransformerApp::renderTrackList() {
+    // Listed straight from the chunk directory; tracks are decoded only when analyzed
+    auto tracks = processor->getTrackDirectory();
+    if (selectedTracks.size() != tracks.size()) {
+        selectedTracks.assign(tracks.size(), false);
+    }
+    
+    if (ImGui::CollapsingHeader("Tracks")) {
+        ImGui::BeginChild("TrackList", ImVec2(0, 150), true);
+        for (size_t i = 0; i < tracks.size(); i++) {
+            std::string label = std::to_string(i + 1) + ": " + 
+                                (tracks[i].name.empty() ? std::string("Unnamed Track") : tracks[i].name) + 
+                                (tracks[i].decoded ? "" : " (not loaded)");
+            bool selected = selectedTracks[i];
+            if (ImGui::Checkbox(label.c_str(), &selected)) {
+                selectedTracks[i] = selected;
+            }
+        }
+        ImGui::EndChild();
+        
+        // An empty selection analyzes every track
+        if (ImGui::Button("Analyze Selected Tracks")) {
+            handleAnalyzeTracks();
+        }
+    }
+}
+
 void MidiChordTransformerApp::renderOutputPanel() {
     ImGui::BeginChild("OutputPanel", ImVec2(0, 0), true);
     
@@ -589,13 +668,44 @@ void MidiChordTransformerApp::handleLoadFile() {
     // For this example, we'll use a hardcoded filename
     std::string filename = "example.mid";
     
-    if (processor->loadMidiFile(filename)) {
-        updateConsoleOutput("Loaded MIDI file: " + filename);
+    // Opening reads only the track directory. Small files are analyzed right
+    // away; larger ones wait until tracks are picked from the list.
+    const size_t autoAnalyzeTrackLimit = 16;
+    
+    if (processor->openMidiFile(filename)) {
+        size_t trackCount = processor->getTrackDirectory().size();
+        selectedTracks.assign(trackCount, false);
+        updateConsoleOutput("Opened MIDI file: " + filename + " (" + 
+                            std::to_string(trackCount) + " tracks)");
+        
+        if (trackCount <= autoAnalyzeTrackLimit) {
+            handleAnalyzeTracks();
+        } else {
+            updateConsoleOutput("Select the tracks to analyze");
+        }
+    } else {
+        updateConsoleOutput("Failed to load MIDI file: " + filename);
+    }
+}
+
+void MidiChordTransformerApp::handleAnalyzeTracks() {
+    std::vector<size_t> trackIndices;
+    for (size_t i = 0; i < selectedTracks.size(); i++) {
+        if (selectedTracks[i]) {
+            trackIndices.push_back(i);
+        }
+    }
+    processor->setActiveTracks(trackIndices);
+    
+    if (processor->analyzeActiveTracks()) {
+        updateConsoleOutput("Analyzed " + 
+                            (trackIndices.empty() ? std::string("all") : std::to_string(trackIndices.size())) + 
+                            " tracks of " + processor->getCurrentFilename());
         
         // Reset selection and options
         resetChordSelection();
     } else {
-        updateConsoleOutput("Failed to load MIDI file: " + filename);
+        updateConsoleOutput("Failed to analyze MIDI file: " + processor->getCurrentFilename());
     }
 }
 
@@ -616,14 +726,46 @@ void MidiChordTransformerApp::handleSaveFile() {
     }
 }
 
+void MidiChordTransformerApp::handleSaveSession() {
+    if (processor->getCurrentFilename().empty()) {
+        updateConsoleOutput("No MIDI file loaded");
+        return;
+    }
+    
+    std::string sessionFile = utils::getBaseFilename(processor->getCurrentFilename()) + ".mcsession";
+    
+    if (processor->saveSession(sessionFile)) {
+        updateConsoleOutput("Saved session to " + sessionFile);
+    } else {
+        updateConsoleOutput("Failed to save session");
+    }
+}
+
+void MidiChordTransformerApp::handleLoadSession() {
+    // In a real implementation, this would open a file dialog
+    // For this example, we'll use a hardcoded filename
+    std::string sessionFile = "example.mcsession";
+    
+    if (processor->loadSession(sessionFile)) {
+        updateConsoleOutput("Opened session: " + sessionFile + " (" + processor->getCurrentFilename() + ")");
+        selectedTracks.assign(processor->getTrackDirectory().size(), false);
+        
+        // Reset selection and options
+        resetChordSelection();
+    } else {
+        updateConsoleOutput("Failed to open session: " + sessionFile);
+    }
+}
+
 void MidiChordTransformerApp::handleBatchProcess() {
-    // Count selected files
-    int selectedCount = 0;
-    for (bool selected : selectedFiles) {
-        if (selected) {
-            selectedCount++;
+    // Collect selected files
+    std::vector<std::string> selectedPaths;
+    for (size_t i = 0; i < loadedFiles.size(); i++) {
+        if (selectedFiles[i]) {
+            selectedPaths.push_back(loadedFiles[i]);
         }
     }
+    int selectedCount = static_cast<int>(selectedPaths.size());
     
     if (selectedCount == 0) {
         updateConsoleOutput("No files selected for batch processing");
@@ -632,29 +774,54 @@ void MidiChordTransformerApp::handleBatchProcess() {
     
     updateConsoleOutput("Starting batch processing of " + std::to_string(selectedCount) + " files");
     
-    // Process each selected file
+    // Same-named files from different folders get distinct outputs
+    std::vector<BatchJob> jobs = BatchSupervisor::makeJobs(
+        selectedPaths, "", "_processed_" + utils::generateTimestamp());
+    
+    // Workers analyze with the current settings, so a file that crashes or
+    // hangs the parser takes down only its worker. Each piece of content is
+    // analyzed once: byte-identical files copy the output of the first one,
+    // and files with the same tracks share its cached session.
+    BatchSupervisorOptions batchOptions;
+    batchOptions.cacheDirectory = "batch_cache";
+    batchOptions.parseOptions = processor->getParseOptions();
+    batchOptions.detectionMode = processor->getDetectionMode();
+    batchOptions.timeTolerance = processor->getTimeTolerance();
+    batchOptions.autoTimeTolerance = processor->isAutoTimeTolerance();
+    
+    BatchSupervisor supervisor(batchOptions);
+    if (!supervisor.run(jobs)) {
+        updateConsoleOutput("Some files were not processed: batch workers could not be restarted");
+    }
+    
+    size_t duplicateCount = 0;
+    for (const BatchJob& job : jobs) {
+        if (job.duplicateKind != DuplicateKind::UNIQUE) {
+            duplicateCount++;
+        }
+    }
+    if (duplicateCount > 0) {
+        updateConsoleOutput("Found " + std::to_string(duplicateCount) + " duplicate files; analyzed " + 
+                            std::to_string(jobs.size() - duplicateCount) + " unique files");
+    }
+    
+    // Report each job
     int processedCount = 0;
-    for (size_t i = 0; i < loadedFiles.size(); i++) {
-        if (selectedFiles[i]) {
-            updateConsoleOutput("Processing " + loadedFiles[i]);
-            
-            if (processor->loadMidiFile(loadedFiles[i])) {
-                // Apply transformations
-                // TODO: Implement batch transformation logic
-                
-                // Save transformed file
-                std::string baseFilename = utils::getBaseFilename(loadedFiles[i]);
-                std::string outputFile = baseFilename + "_transformed_" + utils::generateTimestamp() + ".mid";
-                
-                if (processor->writeMidiFile(outputFile)) {
-                    updateConsoleOutput("Saved transformed MIDI to " + outputFile);
-                    processedCount++;
-                } else {
-                    updateConsoleOutput("Failed to save transformed MIDI for " + loadedFiles[i]);
-                }
-            } else {
-                updateConsoleOutput("Failed to load MIDI file: " + loadedFiles[i]);
+    for (const BatchJob& job : jobs) {
+        if (job.status == BatchJobStatus::DONE) {
+            std::string source;
+            if (job.duplicateKind == DuplicateKind::IDENTICAL_BYTES) {
+                source = " (same as " + jobs[job.duplicateOf].inputPath + ")";
+            } else if (job.fromCache) {
+                source = " (cached)";
             }
+            updateConsoleOutput("Saved processed MIDI to " + job.outputPath + source);
+            processedCount++;
+        } else if (job.status == BatchJobStatus::QUARANTINED) {
+            updateConsoleOutput("Quarantined " + job.inputPath + ": it crashed or hung " + 
+                                std::to_string(job.crashCount) + " batch workers");
+        } else {
+            updateConsoleOutput("Failed to process MIDI file: " + job.inputPath);
         }
     }
     
@@ -1,9 +1,100 @@
 #include "../include/gui/midi_chord_transformer_app.h"
+#include "../include/core/rule_database.h"
+#include "../include/core/chord_index.h"
+#include "../include/core/corpus_statistics.h"
+#include "../include/core/batch_supervisor.h"
+#include "../include/utils/midi_utils.h"
 #include <iostream>
+#include <fstream>
+#include <string>
 #include <exception>
+#include <algorithm>
+#include <filesystem>
 
 int main(int argc, char** argv) {
     try {
+        // Rule database: "--rules <file>", or the default rule file when present
+        std::string ruleFilename = "rules/default.rules";
+        bool rulesRequested = false;
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::string(argv[i]) == "--rules") {
+                ruleFilename = argv[i + 1];
+                rulesRequested = true;
+            }
+        }
+        
+        if (rulesRequested || std::ifstream(ruleFilename).good()) {
+            auto database = midi_transformer::RuleDatabase::openOrCompile(ruleFilename, ruleFilename + ".bin");
+            if (database) {
+                midi_transformer::RuleDatabase::setShared(database);
+            } else {
+                std::cerr << "Warning: Using the built-in rules" << std::endl;
+            }
+        }
+        
+        // Corpus indexing: "--build-index <midi directory> <index file>" builds
+        // the chord n-gram index instead of starting the application
+        for (int i = 1; i + 2 < argc; i++) {
+            if (std::string(argv[i]) == "--build-index") {
+                std::vector<std::string> midiFiles = midi_transformer::utils::findMidiFiles(argv[i + 1]);
+                std::sort(midiFiles.begin(), midiFiles.end());
+                
+                midi_transformer::ChordIndexBuilder builder;
+                if (!builder.ingest(midiFiles) || !builder.write(argv[i + 2])) {
+                    return 1;
+                }
+                std::cout << "Indexed " << midiFiles.size() << " MIDI files into " << argv[i + 2] << std::endl;
+                return 0;
+            }
+        }
+        
+        // Corpus statistics: "--corpus-stats <midi directory> <json file>"
+        for (int i = 1; i + 2 < argc; i++) {
+            if (std::string(argv[i]) == "--corpus-stats") {
+                std::vector<std::string> midiFiles = midi_transformer::utils::findMidiFiles(argv[i + 1]);
+                
+                midi_transformer::CorpusStatisticsOptions options;
+                midi_transformer::CorpusStatistics statistics(options.gramLength, options.topGramCount);
+                if (!midi_transformer::CorpusStatistics::collect(midiFiles, options, statistics) ||
+                    !statistics.writeJson(argv[i + 2])) {
+                    return 1;
+                }
+                std::cout << "Wrote statistics of " << statistics.getFileCount() << " MIDI files to " 
+                          << argv[i + 2] << std::endl;
+                return 0;
+            }
+        }
+        
+        // Batch processing: "--batch <midi directory> <output directory>" runs
+        // every file in crash-isolated worker processes, analyzing duplicate
+        // content once and caching sessions under the output directory
+        for (int i = 1; i + 2 < argc; i++) {
+            if (std::string(argv[i]) == "--batch") {
+                std::vector<std::string> midiFiles = midi_transformer::utils::findMidiFiles(argv[i + 1]);
+                std::sort(midiFiles.begin(), midiFiles.end());
+                
+                std::filesystem::path outputDirectory(argv[i + 2]);
+                std::error_code error;
+                std::filesystem::create_directories(outputDirectory, error);
+                
+                std::vector<midi_transformer::BatchJob> jobs = midi_transformer::BatchSupervisor::makeJobs(
+                    midiFiles, outputDirectory.string(), "_processed");
+                
+                midi_transformer::BatchSupervisorOptions options;
+                options.cacheDirectory = (outputDirectory / "cache").string();
+                midi_transformer::BatchSupervisor supervisor(options);
+                bool complete = supervisor.run(jobs);
+                
+                size_t doneCount = midi_transformer::BatchSupervisor::countStatus(
+                    jobs, midi_transformer::BatchJobStatus::DONE);
+                std::cout << "Processed " << doneCount << " of " << jobs.size() << " MIDI files; " 
+                          << midi_transformer::BatchSupervisor::countStatus(
+                                 jobs, midi_transformer::BatchJobStatus::QUARANTINED) 
+                          << " quarantined" << std::endl;
+                return complete && doneCount == jobs.size() ? 0 : 1;
+            }
+        }
+        
         // Create and run the application
         midi_transformer::MidiChordTransformerApp app;
         app.run();
@@ -9,6 +9,12 @@
 #include <filesystem>
 #include <unordered_map>
 #include <cctype>
+#include <cstring>
+#include <atomic>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 namespace midi_transformer {
 namespace utils {
@@ -61,6 +67,39 @@ bool createDirectory(const std::string& path) {
     }
 }
 
+bool writeFileAtomically(const std::string& filename, const void* data, size_t size) {
+    // Process id and a counter keep writers in other processes and threads
+    // off each other's temporary files
+    static std::atomic<uint64_t> temporaryCount(0);
+    std::string temporaryFile = filename + ".tmp";
+#ifndef _WIN32
+    temporaryFile += std::to_string(getpid()) + ".";
+#endif
+    temporaryFile += std::to_string(temporaryCount.fetch_add(1));
+    
+    {
+        std::ofstream file(temporaryFile, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        file.close();
+        if (!file) {
+            std::error_code error;
+            std::filesystem::remove(temporaryFile, error);
+            return false;
+        }
+    }
+    
+    std::error_code error;
+    std::filesystem::rename(temporaryFile, filename, error);
+    if (error) {
+        std::filesystem::remove(temporaryFile, error);
+        return false;
+    }
+    return true;
+}
+
 std::string midiNoteToName(uint8_t noteNumber) {
     static const std::vector<std::string> noteNames = {
         "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
@@ -329,5 +368,43 @@ std::string calculateDataHash(const std::vector<uint8_t>& data) {
     return hashStr.str();
 }
 
+uint64_t hashBytes(const uint8_t* data, size_t size) {
+    // Word-at-a-time multiply-rotate hash over four independent lanes, so it
+    // runs near memory speed. Good for integrity checks, not cryptographic.
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    auto rotl = [](uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); };
+    auto round = [&](uint64_t lane, uint64_t word) { return rotl(lane + word * prime2, 31) * prime1; };
+    
+    uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+    size_t position = 0;
+    for (; position + 32 <= size; position += 32) {
+        uint64_t words[4];
+        std::memcpy(words, data + position, sizeof(words));
+        for (int lane = 0; lane < 4; lane++) {
+            lanes[lane] = round(lanes[lane], words[lane]);
+        }
+    }
+    
+    uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    hash += static_cast<uint64_t>(size);
+    for (; position + 8 <= size; position += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + position, sizeof(word));
+        hash = rotl(hash ^ round(0, word), 27) * prime1 + prime2;
+    }
+    for (; position < size; position++) {
+        hash = rotl(hash ^ (data[position] * prime1), 11) * prime2;
+    }
+    
+    // Final avalanche so every input bit affects every output bit
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
 } // namespace utils
 } // namespace midi_transformer
\ No newline at end of file